@@ -0,0 +1,27 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <functional>
+#include <map>
+#include <string>
+
+// Runs the measured operation `n` times
+typedef std::function<void(size_t n)> BenchFunc;
+
+// Registers a benchmark. `cleanup` runs untimed after every measured run
+// with the same iteration count, e.g. to drain queues that `body` filled.
+void addBenchmark(std::string name, BenchFunc body, BenchFunc cleanup = nullptr);
+
+// A typical set of request headers, shared between benchmarks
+std::map<std::string, std::string> sampleHeaders();
+
+void registerLuaBenchmarks();
+void registerQueueBenchmarks();
+void registerResponseBenchmarks();
+void registerEndToEndBenchmarks();
+void registerNativeBenchmarks();
+void registerHistogramBenchmarks();
+void registerJSONBenchmarks();
+void registerDeflateBenchmarks();
+
+#endif
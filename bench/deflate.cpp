@@ -0,0 +1,42 @@
+#include <string>
+#include "bench.h"
+#include "deflate.h"
+
+// Analytics log lines like the ones our servers upload, about `bytes` long
+static std::string eventLog(size_t bytes) {
+	std::string log;
+
+	for (int i = 0; log.size() < bytes; i++) {
+		log += "{\"time\":" + std::to_string(1792310400 + i / 4)
+		     + ",\"event\":\"" + (i % 5 ? "player_spawn" : "round_end") + "\""
+		     + ",\"steamid\":\"7656119800" + std::to_string(1000000 + i % 64) + "\""
+		     + ",\"map\":\"gm_construct\",\"players\":" + std::to_string(10 + i % 23)
+		     + ",\"fps\":" + std::to_string(60 + (i * 7919) % 90) + "}\n";
+	}
+
+	return log;
+}
+
+static void addLevelBenchmark(const std::string& log, int level) {
+	addBenchmark("deflate/gzip-1m-level" + std::to_string(level), [=](size_t n) {
+		std::string out;
+
+		for (size_t i = 0; i < n; i++) {
+			out.clear();
+			gzipCompress(log.data(), log.size(), level, &out);
+		}
+	});
+}
+
+void registerDeflateBenchmarks() {
+	std::string log = eventLog(1 << 20);
+
+	addLevelBenchmark(log, 1);
+	addLevelBenchmark(log, 6);
+	addLevelBenchmark(log, 9);
+
+	addBenchmark("deflate/crc32-1m", [=](size_t n) {
+		for (size_t i = 0; i < n; i++)
+			crc32(log.data(), log.size());
+	});
+}
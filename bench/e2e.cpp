@@ -0,0 +1,123 @@
+#include <string>
+#include "bench.h"
+#include "fakelua.h"
+#include "mockbackend.h"
+#include "steamhttp.h"
+#include "submission.h"
+#include "completion.h"
+#include "client.h"
+
+static FakeLua lua;
+static MockBackend mock;
+static size_t completed;
+
+static void sendRequest(FakeLua *LUA, const char *url) {
+	LUA->PushCFunction(STEAMHTTP);
+	LUA->CreateTable();
+	LUA->PushString(url);
+	LUA->SetField(-2, "url");
+	LUA->pushFunction([](FakeLua *) {
+		completed++;
+		return 0;
+	});
+	LUA->SetField(-2, "success");
+	LUA->Call(1, 1);
+	LUA->Pop();
+}
+
+// Lets the submission thread and the completion pool catch up, instead
+// of waiting for the pool's poll interval, then runs one Think tick
+static void think(FakeLua *LUA) {
+	submitter.wait();
+	completions.settle();
+
+	LUA->PushCFunction(callbackHook);
+	LUA->Call(0, 0);
+}
+
+void registerEndToEndBenchmarks() {
+	FakeLua *LUA = &lua;
+
+	MockResponse scripted;
+	scripted.body = std::string(1024, 'x');
+	scripted.headers["Content-Type"] = "application/json";
+	mock.setDefault(scripted);
+
+	// One request at a time: parse, submit, Think until the success handler ran
+	addBenchmark("e2e/mock-roundtrip", [=](size_t n) {
+		backend = &mock;
+		completed = 0;
+
+		for (size_t i = 0; i < n; i++) {
+			sendRequest(LUA, "http://127.0.0.1/api");
+
+			while (completed <= i)
+				think(LUA);
+		}
+	});
+
+	// What issuing a burst costs the game thread, without waiting for it
+	addBenchmark("e2e/mock-issue-100", [=](size_t n) {
+		backend = &mock;
+
+		for (size_t i = 0; i < n; i++) {
+			for (int j = 0; j < 100; j++)
+				sendRequest(LUA, "http://127.0.0.1/api");
+		}
+	}, [=](size_t n) {
+		completed = 0;
+
+		while (completed < n * 100)
+			think(LUA);
+	});
+
+	// A burst of 100 requests in one tick, then ticking until all are done
+	addBenchmark("e2e/mock-burst-100", [=](size_t n) {
+		backend = &mock;
+
+		for (size_t i = 0; i < n; i++) {
+			completed = 0;
+
+			for (int j = 0; j < 100; j++)
+				sendRequest(LUA, "http://127.0.0.1/api");
+
+			while (completed < 100)
+				think(LUA);
+		}
+	});
+
+	// The same burst through a client, with one ondone_batch call per tick
+	// instead of a handler per request
+	addBenchmark("e2e/mock-burst-100-ondone-batch", [=](size_t n) {
+		backend = &mock;
+		registerClient(LUA);
+
+		LUA->PushCFunction(Client);
+		LUA->CreateTable();
+		LUA->PushString("http://127.0.0.1");
+		LUA->SetField(-2, "base");
+		LUA->pushFunction([](FakeLua *LUA) {
+			completed += LUA->ObjLen(1);
+			return 0;
+		});
+		LUA->SetField(-2, "ondone_batch");
+		LUA->Call(1, 1);
+
+		for (size_t i = 0; i < n; i++) {
+			completed = 0;
+
+			for (int j = 0; j < 100; j++) {
+				LUA->GetField(-1, "Request");
+				LUA->Push(-2);
+				LUA->PushString("/api");
+				LUA->Call(2, 1);
+				LUA->Pop();
+			}
+
+			while (completed < 100)
+				think(LUA);
+		}
+
+		LUA->Pop();
+	});
+}
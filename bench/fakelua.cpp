@@ -0,0 +1,649 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include "fakelua.h"
+
+static const char *TYPE_NAMES[] = {
+	"nil", "bool", "lightuserdata", "number", "string",
+	"table", "function", "userdata", "thread",
+};
+
+bool FakeLua::Value::operator<(const Value& other) const {
+	if (type != other.type)
+		return type < other.type;
+
+	switch (type) {
+	case Lua::Type::BOOL:
+		return boolean < other.boolean;
+	case Lua::Type::NUMBER:
+		return number < other.number;
+	case Lua::Type::STRING:
+		return string < other.string;
+	case Lua::Type::TABLE:
+		return table < other.table;
+	case Lua::Type::FUNCTION:
+		return cfunc != other.cfunc ? cfunc < other.cfunc : function < other.function;
+	case Lua::Type::USERDATA:
+		return userdata < other.userdata;
+	case Lua::Type::LIGHTUSERDATA:
+		return lightuserdata < other.lightuserdata;
+	}
+
+	return false;
+}
+
+bool FakeLua::Value::operator==(const Value& other) const {
+	return !(*this < other) && !(other < *this);
+}
+
+FakeLua::FakeLua() : globals(new Table()), registry(new Table()) {
+	state.luabase = this;
+
+	// print() is used by the module for logging
+	pushFunction([](FakeLua *LUA) {
+		LUA->printed.push_back(LUA->GetString(1) ? LUA->GetString(1) : "");
+		return 0;
+	});
+	setGlobal("print");
+
+	// hook.Add() just stores the function in hook.Hooks[event][name]
+	CreateTable();
+	CreateTable();
+	SetField(-2, "Hooks");
+	pushFunction([](FakeLua *LUA) {
+		LUA->PushSpecial(Lua::SPECIAL_GLOB);
+		LUA->GetField(-1, "hook");
+		LUA->GetField(-1, "Hooks");
+		LUA->GetField(-1, LUA->GetString(1));
+		if (!LUA->IsType(-1, Lua::Type::TABLE)) {
+			LUA->Pop();
+			LUA->CreateTable();
+			LUA->Push(-1);
+			LUA->SetField(-3, LUA->GetString(1));
+		}
+		LUA->Push(3);
+		LUA->SetField(-2, LUA->GetString(2));
+		LUA->Pop(4);
+		return 0;
+	});
+	SetField(-2, "Add");
+	setGlobal("hook");
+}
+
+FakeLua::Value& FakeLua::at(int pos) {
+	static Value none;
+
+	if (pos == Lua::INDEX_GLOBAL) {
+		static Value global;
+		global.type = Lua::Type::TABLE;
+		global.table = globals;
+		return global;
+	}
+
+	if (pos == Lua::INDEX_REGISTRY) {
+		static Value reg;
+		reg.type = Lua::Type::TABLE;
+		reg.table = registry;
+		return reg;
+	}
+
+	size_t abs = pos > 0 ? base + pos - 1 : stack.size() + pos;
+
+	if (pos == 0 || abs >= stack.size() || abs < base) {
+		none = Value();
+		none.type = Lua::Type::NONE;
+		return none;
+	}
+
+	return stack[abs];
+}
+
+FakeLua::Value FakeLua::pop1() {
+	if (stack.size() <= base)
+		throw std::runtime_error("stack underflow");
+
+	Value value = stack.back();
+	stack.pop_back();
+	return value;
+}
+
+void FakeLua::push(Value value) {
+	if (value.type == Lua::Type::NONE)
+		value.type = Lua::Type::NIL;
+
+	stack.push_back(value);
+}
+
+std::shared_ptr<FakeLua::Table> FakeLua::metatableOf(const Value& value) {
+	if (value.type == Lua::Type::TABLE)
+		return value.table->metatable;
+
+	if (value.type == Lua::Type::USERDATA) {
+		auto it = userdatameta.find(value.userdata.get());
+		if (it != userdatameta.end())
+			return it->second;
+	}
+
+	return nullptr;
+}
+
+// Table access including __index, like lua_gettable
+FakeLua::Value FakeLua::index(const Value& object, const Value& key) {
+	if (object.type == Lua::Type::TABLE) {
+		auto it = object.table->entries.find(key);
+		if (it != object.table->entries.end())
+			return it->second;
+	} else if (object.type != Lua::Type::USERDATA) {
+		throw std::runtime_error(std::string("attempt to index a ") + GetTypeName(object.type) + " value");
+	}
+
+	std::shared_ptr<Table> meta = metatableOf(object);
+	if (!meta)
+		return Value();
+
+	Value name;
+	name.type = Lua::Type::STRING;
+	name.string = "__index";
+
+	auto it = meta->entries.find(name);
+	if (it == meta->entries.end())
+		return Value();
+
+	if (it->second.type == Lua::Type::TABLE)
+		return index(it->second, key);
+
+	if (it->second.type == Lua::Type::FUNCTION) {
+		push(it->second);
+		push(object);
+		push(key);
+		Call(2, 1);
+		return pop1();
+	}
+
+	return Value();
+}
+
+size_t FakeLua::depth() {
+	return stack.size();
+}
+
+void FakeLua::pushFunction(Function function) {
+	Value value;
+	value.type = Lua::Type::FUNCTION;
+	value.function = std::make_shared<Function>(function);
+	push(value);
+}
+
+void FakeLua::setGlobal(const char *name) {
+	Value key;
+	key.type = Lua::Type::STRING;
+	key.string = name;
+	globals->entries[key] = pop1();
+}
+
+size_t FakeLua::referenceCount() {
+	return references.size();
+}
+
+int FakeLua::Top(void) {
+	return stack.size() - base;
+}
+
+void FakeLua::Push(int iStackPos) {
+	push(at(iStackPos));
+}
+
+void FakeLua::Pop(int iAmt) {
+	for (int i = 0; i < iAmt; i++)
+		pop1();
+}
+
+void FakeLua::GetTable(int iStackPos) {
+	Value object = at(iStackPos);
+	Value key = pop1();
+	push(index(object, key));
+}
+
+void FakeLua::GetField(int iStackPos, const char *strName) {
+	Value object = at(iStackPos);
+	Value key;
+	key.type = Lua::Type::STRING;
+	key.string = strName;
+	push(index(object, key));
+}
+
+void FakeLua::SetField(int iStackPos, const char *strName) {
+	Value object = at(iStackPos);
+	Value value = pop1();
+	Value key;
+	key.type = Lua::Type::STRING;
+	key.string = strName;
+
+	if (object.type != Lua::Type::TABLE)
+		throw std::runtime_error("attempt to index a non-table value");
+
+	if (value.type == Lua::Type::NIL)
+		object.table->entries.erase(key);
+	else
+		object.table->entries[key] = value;
+}
+
+void FakeLua::CreateTable() {
+	Value value;
+	value.type = Lua::Type::TABLE;
+	value.table = std::make_shared<Table>();
+	push(value);
+}
+
+void FakeLua::SetTable(int iStackPos) {
+	RawSet(iStackPos);
+}
+
+void FakeLua::SetMetaTable(int iStackPos) {
+	Value& object = at(iStackPos);
+	Value meta = pop1();
+	std::shared_ptr<Table> table = meta.type == Lua::Type::TABLE ? meta.table : nullptr;
+
+	if (object.type == Lua::Type::TABLE)
+		object.table->metatable = table;
+	else if (object.type == Lua::Type::USERDATA)
+		userdatameta[object.userdata.get()] = table;
+}
+
+bool FakeLua::GetMetaTable(int i) {
+	std::shared_ptr<Table> meta = metatableOf(at(i));
+
+	if (!meta)
+		return false;
+
+	Value value;
+	value.type = Lua::Type::TABLE;
+	value.table = meta;
+	push(value);
+	return true;
+}
+
+void FakeLua::Call(int iArgs, int iResults) {
+	size_t funcpos = stack.size() - iArgs - 1;
+	Value func = stack[funcpos];
+
+	// Callable tables and userdata
+	if (func.type != Lua::Type::FUNCTION) {
+		std::shared_ptr<Table> meta = metatableOf(func);
+		Value name;
+		name.type = Lua::Type::STRING;
+		name.string = "__call";
+
+		if (!meta || !meta->entries.count(name))
+			throw std::runtime_error(std::string("attempt to call a ") + GetTypeName(func.type) + " value");
+
+		stack.insert(stack.begin() + funcpos, meta->entries[name]);
+		iArgs++;
+		func = stack[funcpos];
+	}
+
+	size_t oldbase = base;
+	int results;
+
+	base = funcpos + 1;
+	try {
+		if (func.cfunc)
+			results = func.cfunc(&state);
+		else
+			results = (*func.function)(this);
+	} catch (...) {
+		base = oldbase;
+		throw;
+	}
+	base = oldbase;
+
+	// Move the results down to where the function was
+	std::vector<Value> ret(stack.end() - results, stack.end());
+	stack.resize(funcpos);
+
+	if (iResults < 0)
+		iResults = results;
+
+	for (int i = 0; i < iResults; i++)
+		push(i < results ? ret[i] : Value());
+}
+
+int FakeLua::PCall(int iArgs, int iResults, int /* iErrorFunc */) {
+	size_t funcpos = stack.size() - iArgs - 1;
+
+	try {
+		Call(iArgs, iResults);
+	} catch (std::exception& e) {
+		stack.resize(funcpos);
+		PushString(e.what());
+		return 2;
+	}
+
+	return 0;
+}
+
+int FakeLua::Equal(int iA, int iB) {
+	return at(iA) == at(iB);
+}
+
+int FakeLua::RawEqual(int iA, int iB) {
+	return at(iA) == at(iB);
+}
+
+void FakeLua::Insert(int iStackPos) {
+	size_t abs = iStackPos > 0 ? base + iStackPos - 1 : stack.size() + iStackPos;
+	Value value = pop1();
+	stack.insert(stack.begin() + abs, value);
+}
+
+void FakeLua::Remove(int iStackPos) {
+	size_t abs = iStackPos > 0 ? base + iStackPos - 1 : stack.size() + iStackPos;
+	stack.erase(stack.begin() + abs);
+}
+
+int FakeLua::Next(int iStackPos) {
+	Value object = at(iStackPos);
+	Value key = pop1();
+	auto& entries = object.table->entries;
+	auto it = key.type == Lua::Type::NIL ? entries.begin() : entries.upper_bound(key);
+
+	if (it == entries.end())
+		return 0;
+
+	push(it->first);
+	push(it->second);
+	return 1;
+}
+
+void *FakeLua::NewUserdata(unsigned int iSize) {
+	Value value;
+	value.type = Lua::Type::USERDATA;
+	value.userdata = std::make_shared<std::vector<char>>(iSize);
+	push(value);
+	return value.userdata->data();
+}
+
+void FakeLua::ThrowError(const char *strError) {
+	throw std::runtime_error(strError);
+}
+
+void FakeLua::CheckType(int iStackPos, int iType) {
+	if (GetType(iStackPos) != iType)
+		ArgError(iStackPos, (std::string(GetTypeName(iType)) + " expected").c_str());
+}
+
+void FakeLua::ArgError(int iArgNum, const char *strMessage) {
+	throw std::runtime_error("bad argument #" + std::to_string(iArgNum) + " (" + strMessage + ")");
+}
+
+void FakeLua::RawGet(int iStackPos) {
+	Value object = at(iStackPos);
+	Value key = pop1();
+	auto it = object.table->entries.find(key);
+	push(it == object.table->entries.end() ? Value() : it->second);
+}
+
+void FakeLua::RawSet(int iStackPos) {
+	Value object = at(iStackPos);
+	Value value = pop1();
+	Value key = pop1();
+
+	if (object.type != Lua::Type::TABLE)
+		throw std::runtime_error("attempt to index a non-table value");
+
+	if (value.type == Lua::Type::NIL)
+		object.table->entries.erase(key);
+	else
+		object.table->entries[key] = value;
+}
+
+const char *FakeLua::GetString(int iStackPos, unsigned int *iOutLen) {
+	Value& value = at(iStackPos);
+
+	// Numbers are converted in place, just like lua_tolstring does
+	if (value.type == Lua::Type::NUMBER) {
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "%.14g", value.number);
+		value.type = Lua::Type::STRING;
+		value.string = buffer;
+	}
+
+	if (value.type != Lua::Type::STRING)
+		return nullptr;
+
+	if (iOutLen)
+		*iOutLen = value.string.size();
+
+	return value.string.c_str();
+}
+
+double FakeLua::GetNumber(int iStackPos) {
+	Value& value = at(iStackPos);
+
+	if (value.type == Lua::Type::NUMBER)
+		return value.number;
+	if (value.type == Lua::Type::STRING)
+		return strtod(value.string.c_str(), nullptr);
+
+	return 0;
+}
+
+bool FakeLua::GetBool(int iStackPos) {
+	Value& value = at(iStackPos);
+
+	if (value.type == Lua::Type::BOOL)
+		return value.boolean;
+
+	return value.type != Lua::Type::NIL && value.type != Lua::Type::NONE;
+}
+
+Lua::CFunc FakeLua::GetCFunction(int iStackPos) {
+	return at(iStackPos).cfunc;
+}
+
+void *FakeLua::GetUserdata(int iStackPos) {
+	Value& value = at(iStackPos);
+
+	if (value.type == Lua::Type::USERDATA)
+		return value.userdata->data();
+	if (value.type == Lua::Type::LIGHTUSERDATA)
+		return value.lightuserdata;
+
+	return nullptr;
+}
+
+void FakeLua::PushNil() {
+	push(Value());
+}
+
+void FakeLua::PushString(const char *val, unsigned int iLen) {
+	Value value;
+	value.type = Lua::Type::STRING;
+	value.string.assign(val, iLen ? iLen : strlen(val));
+	push(value);
+}
+
+void FakeLua::PushNumber(double val) {
+	Value value;
+	value.type = Lua::Type::NUMBER;
+	value.number = val;
+	push(value);
+}
+
+void FakeLua::PushBool(bool val) {
+	Value value;
+	value.type = Lua::Type::BOOL;
+	value.boolean = val;
+	push(value);
+}
+
+void FakeLua::PushCFunction(Lua::CFunc val) {
+	Value value;
+	value.type = Lua::Type::FUNCTION;
+	value.cfunc = val;
+	push(value);
+}
+
+void FakeLua::PushCClosure(Lua::CFunc val, int iVars) {
+	// Upvalues are not modeled
+	Pop(iVars);
+	PushCFunction(val);
+}
+
+void FakeLua::PushUserdata(void *data) {
+	Value value;
+	value.type = Lua::Type::LIGHTUSERDATA;
+	value.lightuserdata = data;
+	push(value);
+}
+
+int FakeLua::ReferenceCreate() {
+	int ref = nextreference++;
+	references[ref] = pop1();
+	return ref;
+}
+
+void FakeLua::ReferenceFree(int i) {
+	references.erase(i);
+}
+
+void FakeLua::ReferencePush(int i) {
+	auto it = references.find(i);
+	push(it == references.end() ? Value() : it->second);
+}
+
+void FakeLua::PushSpecial(int iType) {
+	Value value;
+	value.type = Lua::Type::TABLE;
+	value.table = iType == Lua::SPECIAL_REG ? registry : globals;
+	push(value);
+}
+
+bool FakeLua::IsType(int iStackPos, int iType) {
+	return GetType(iStackPos) == iType;
+}
+
+int FakeLua::GetType(int iStackPos) {
+	return at(iStackPos).type;
+}
+
+const char *FakeLua::GetTypeName(int iType) {
+	if (iType >= 0 && iType <= Lua::Type::THREAD)
+		return TYPE_NAMES[iType];
+
+	for (auto const& e : metatypes) {
+		if (e.second == iType)
+			return e.first.c_str();
+	}
+
+	return "no value";
+}
+
+void FakeLua::CreateMetaTableType(const char *strName, int iType) {
+	metatypes[strName] = iType;
+	metatables[iType] = std::make_shared<Table>();
+
+	Value value;
+	value.type = Lua::Type::TABLE;
+	value.table = metatables[iType];
+	push(value);
+}
+
+const char *FakeLua::CheckString(int iStackPos) {
+	const char *str = GetString(iStackPos);
+
+	if (!str)
+		ArgError(iStackPos, "string expected");
+
+	return str;
+}
+
+double FakeLua::CheckNumber(int iStackPos) {
+	if (!IsType(iStackPos, Lua::Type::NUMBER))
+		ArgError(iStackPos, "number expected");
+
+	return GetNumber(iStackPos);
+}
+
+int FakeLua::ObjLen(int iStackPos) {
+	Value& value = at(iStackPos);
+
+	if (value.type == Lua::Type::STRING)
+		return value.string.size();
+
+	if (value.type != Lua::Type::TABLE)
+		return 0;
+
+	Value key;
+	key.type = Lua::Type::NUMBER;
+	int n = 0;
+
+	for (key.number = 1; value.table->entries.count(key); key.number++)
+		n++;
+
+	return n;
+}
+
+const QAngle& FakeLua::GetAngle(int /* iStackPos */) {
+	static QAngle angle = {};
+	return angle;
+}
+
+const Vector& FakeLua::GetVector(int /* iStackPos */) {
+	static Vector vector = {};
+	return vector;
+}
+
+void FakeLua::PushAngle(const QAngle& /* val */) {
+	PushNil();
+}
+
+void FakeLua::PushVector(const Vector& /* val */) {
+	PushNil();
+}
+
+void FakeLua::SetState(lua_State * /* L */) {
+}
+
+int FakeLua::CreateMetaTable(const char *strName) {
+	auto it = metatypes.find(strName);
+
+	if (it == metatypes.end()) {
+		int type = Lua::Type::COUNT + metatypes.size();
+		CreateMetaTableType(strName, type);
+		return type;
+	}
+
+	PushMetaTable(it->second);
+	return it->second;
+}
+
+bool FakeLua::PushMetaTable(int iType) {
+	auto it = metatables.find(iType);
+
+	if (it == metatables.end())
+		return false;
+
+	Value value;
+	value.type = Lua::Type::TABLE;
+	value.table = it->second;
+	push(value);
+	return true;
+}
+
+void FakeLua::PushUserType(void *data, int iType) {
+	UserData *ud = static_cast<UserData *>(NewUserdata(sizeof(UserData)));
+	ud->data = data;
+	ud->type = iType;
+
+	if (PushMetaTable(iType))
+		SetMetaTable(-2);
+}
+
+void FakeLua::SetUserType(int iStackPos, void *data) {
+	UserData *ud = static_cast<UserData *>(GetUserdata(iStackPos));
+
+	if (ud)
+		ud->data = data;
+}
@@ -0,0 +1,139 @@
+#ifndef _FAKELUA_H
+#define _FAKELUA_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <GarrysMod/Lua/Interface.h>
+
+using namespace GarrysMod;
+
+// A small stand-in for GMod's ILuaBase, good enough to drive the module's
+// Lua glue outside of srcds. It models the Lua stack, tables, registry
+// references, metatables and userdata, but no garbage collection and no
+// actual Lua code: "Lua functions" are native callbacks (see pushFunction).
+class FakeLua : public Lua::ILuaBase {
+public:
+	struct Table;
+	struct Value;
+	typedef std::function<int(FakeLua *)> Function;
+
+	struct Value {
+		int type = Lua::Type::NIL;
+		bool boolean = false;
+		double number = 0;
+		std::string string;
+		std::shared_ptr<Table> table;
+		Lua::CFunc cfunc = nullptr;
+		std::shared_ptr<Function> function;
+		std::shared_ptr<std::vector<char>> userdata;
+		void *lightuserdata = nullptr;
+
+		bool operator<(const Value& other) const;
+		bool operator==(const Value& other) const;
+	};
+
+	struct Table {
+		std::map<Value, Value> entries;
+		std::shared_ptr<Table> metatable;
+	};
+
+private:
+	std::vector<Value> stack;
+	size_t base = 0;
+
+	std::shared_ptr<Table> globals;
+	std::shared_ptr<Table> registry;
+	std::map<int, Value> references;
+	int nextreference = 1;
+
+	std::map<std::string, int> metatypes;
+	std::map<int, std::shared_ptr<Table>> metatables;
+	std::map<const void *, std::shared_ptr<Table>> userdatameta;
+
+	lua_State state;
+
+	Value& at(int pos);
+	Value pop1();
+	void push(Value value);
+	std::shared_ptr<Table> metatableOf(const Value& value);
+	Value index(const Value& object, const Value& key);
+
+public:
+	FakeLua();
+
+	// Number of values on the whole stack, regardless of frames
+	size_t depth();
+
+	// Pushes a native callback that behaves like a Lua function
+	void pushFunction(Function function);
+
+	// Sets a global to the value at the top of the stack and pops it
+	void setGlobal(const char *name);
+
+	// Number of live registry references, to spot leaks
+	size_t referenceCount();
+
+	// Messages passed to the global `print`
+	std::vector<std::string> printed;
+
+	int Top(void);
+	void Push(int iStackPos);
+	void Pop(int iAmt = 1);
+	void GetTable(int iStackPos);
+	void GetField(int iStackPos, const char *strName);
+	void SetField(int iStackPos, const char *strName);
+	void CreateTable();
+	void SetTable(int iStackPos);
+	void SetMetaTable(int iStackPos);
+	bool GetMetaTable(int i);
+	void Call(int iArgs, int iResults);
+	int PCall(int iArgs, int iResults, int iErrorFunc);
+	int Equal(int iA, int iB);
+	int RawEqual(int iA, int iB);
+	void Insert(int iStackPos);
+	void Remove(int iStackPos);
+	int Next(int iStackPos);
+	void *NewUserdata(unsigned int iSize);
+	[[noreturn]] void ThrowError(const char *strError);
+	void CheckType(int iStackPos, int iType);
+	[[noreturn]] void ArgError(int iArgNum, const char *strMessage);
+	void RawGet(int iStackPos);
+	void RawSet(int iStackPos);
+	const char *GetString(int iStackPos = -1, unsigned int *iOutLen = NULL);
+	double GetNumber(int iStackPos = -1);
+	bool GetBool(int iStackPos = -1);
+	Lua::CFunc GetCFunction(int iStackPos = -1);
+	void *GetUserdata(int iStackPos = -1);
+	void PushNil();
+	void PushString(const char *val, unsigned int iLen = 0);
+	void PushNumber(double val);
+	void PushBool(bool val);
+	void PushCFunction(Lua::CFunc val);
+	void PushCClosure(Lua::CFunc val, int iVars);
+	void PushUserdata(void *);
+	int ReferenceCreate();
+	void ReferenceFree(int i);
+	void ReferencePush(int i);
+	void PushSpecial(int iType);
+	bool IsType(int iStackPos, int iType);
+	int GetType(int iStackPos);
+	const char *GetTypeName(int iType);
+	void CreateMetaTableType(const char *strName, int iType);
+	const char *CheckString(int iStackPos = -1);
+	double CheckNumber(int iStackPos = -1);
+	int ObjLen(int iStackPos = -1);
+	const QAngle& GetAngle(int iStackPos = -1);
+	const Vector& GetVector(int iStackPos = -1);
+	void PushAngle(const QAngle& val);
+	void PushVector(const Vector& val);
+	void SetState(lua_State *L);
+	int CreateMetaTable(const char *strName);
+	bool PushMetaTable(int iType);
+	void PushUserType(void *data, int iType);
+	void SetUserType(int iStackPos, void *data);
+};
+
+#endif
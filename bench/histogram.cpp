@@ -0,0 +1,29 @@
+#include "bench.h"
+#include "histogram.h"
+
+void registerHistogramBenchmarks() {
+	// What the completion path pays per request
+	addBenchmark("histogram/record", [](size_t n) {
+		static LatencyHistogram histogram;
+
+		for (size_t i = 0; i < n; i++)
+			histogram.record(1000 + (i & 0xffff));
+	});
+
+	addBenchmark("histogram/recordLatency", [](size_t n) {
+		HostLatency *latency = hostLatency("bench.example.com");
+
+		for (size_t i = 0; i < n; i++)
+			recordLatency(latency, 1000 + (i & 0xffff), 200);
+	});
+
+	addBenchmark("histogram/percentile", [](size_t n) {
+		static LatencyHistogram histogram;
+
+		for (int i = 0; i < 10000; i++)
+			histogram.record(i * 37);
+
+		for (size_t i = 0; i < n; i++)
+			histogram.percentile(0.99);
+	});
+}
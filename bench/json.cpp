@@ -0,0 +1,150 @@
+#include <string>
+#include "bench.h"
+#include "fakelua.h"
+#include "extract.h"
+#include "json.h"
+#include "lua.h"
+
+static FakeLua lua;
+
+// A leaderboard as our web API returns it, about `bytes` long
+static std::string leaderboard(size_t bytes) {
+	std::string json = "{\"board\":\"weekly\",\"updated\":1792310400,\"entries\":[";
+
+	for (int i = 0; json.size() < bytes; i++) {
+		if (i)
+			json += ",";
+
+		json += "{\"rank\":" + std::to_string(i + 1)
+		      + ",\"steamid\":\"7656119800" + std::to_string(1000000 + i) + "\""
+		      + ",\"name\":\"Player \\u00e9" + std::to_string(i) + "\""
+		      + ",\"score\":" + std::to_string(1000000 - i * 7) + "." + std::to_string(i % 100)
+		      + ",\"vip\":" + (i % 3 ? "false" : "true")
+		      + ",\"clan\":null,\"tags\":[\"regular\",\"builder\"]}";
+	}
+
+	return json + "]}";
+}
+
+static void addJSONBenchmarks(std::string suffix, size_t bytes) {
+	std::string json = leaderboard(bytes);
+
+	addBenchmark("json/parse-" + suffix, [=](size_t n) {
+		JSONTape tape;
+		std::string error;
+
+		for (size_t i = 0; i < n; i++)
+			parseJSON(json.data(), json.size(), &tape, &error);
+	});
+
+	// Parsing plus picking one field per entry, and pushing only that
+	addBenchmark("json/extract-" + suffix, [=](size_t n) {
+		JSONTape tape;
+		std::string error;
+		ExtractPath path;
+		FakeLua *LUA = &lua;
+
+		parseExtractPath("entries[*].steamid", &path, &error);
+
+		for (size_t i = 0; i < n; i++) {
+			parseJSON(json.data(), json.size(), &tape, &error);
+			extractPaths(&tape, {path});
+			pushJSON(LUA, tape);
+			LUA->Pop();
+		}
+	});
+
+	addBenchmark("json/push-" + suffix, [=](size_t n) {
+		JSONTape tape;
+		std::string error;
+		FakeLua *LUA = &lua;
+
+		parseJSON(json.data(), json.size(), &tape, &error);
+
+		for (size_t i = 0; i < n; i++) {
+			pushJSON(LUA, tape);
+			LUA->Pop();
+		}
+	});
+}
+
+// A batched stats upload: `players` rows of per-player counters
+static void pushStatsUpload(FakeLua *LUA, int players) {
+	LUA->CreateTable();
+	LUA->PushString("27015");
+	LUA->SetField(-2, "server");
+
+	LUA->CreateTable();
+	for (int i = 1; i <= players; i++) {
+		LUA->PushNumber(i);
+		LUA->CreateTable();
+		LUA->PushString(("7656119800" + std::to_string(1000000 + i)).c_str());
+		LUA->SetField(-2, "steamid");
+		LUA->PushNumber(i * 13);
+		LUA->SetField(-2, "kills");
+		LUA->PushNumber(i * 0.25);
+		LUA->SetField(-2, "playtime");
+		LUA->PushBool(i % 2 == 0);
+		LUA->SetField(-2, "alive");
+		LUA->SetTable(-3);
+	}
+	LUA->SetField(-2, "players");
+}
+
+// The same leaderboard as MessagePack, converted through Lua
+static std::string leaderboardMsgPack(size_t bytes) {
+	std::string json = leaderboard(bytes), msgpack, error;
+	JSONTape tape;
+	FakeLua *LUA = &lua;
+
+	parseJSON(json.data(), json.size(), &tape, &error);
+	pushJSON(LUA, tape);
+	encodeMsgPack(LUA, -1, &msgpack, &error);
+	LUA->Pop();
+
+	return msgpack;
+}
+
+void registerJSONBenchmarks() {
+	addBenchmark("json/encode-stats-1000", [](size_t n) {
+		FakeLua *LUA = &lua;
+		std::string body, error;
+
+		pushStatsUpload(LUA, 1000);
+
+		for (size_t i = 0; i < n; i++) {
+			body.clear();
+			encodeJSON(LUA, -1, &body, &error);
+		}
+
+		LUA->Pop();
+	});
+
+
+	addJSONBenchmarks("1k", 1024);
+	addJSONBenchmarks("2m", 2 * 1024 * 1024);
+
+	std::string msgpack = leaderboardMsgPack(2 * 1024 * 1024);
+
+	addBenchmark("msgpack/parse-2m", [=](size_t n) {
+		JSONTape tape;
+		std::string error;
+
+		for (size_t i = 0; i < n; i++)
+			parseMsgPack(msgpack.data(), msgpack.size(), &tape, &error);
+	});
+
+	addBenchmark("msgpack/encode-stats-1000", [](size_t n) {
+		FakeLua *LUA = &lua;
+		std::string body, error;
+
+		pushStatsUpload(LUA, 1000);
+
+		for (size_t i = 0; i < n; i++) {
+			body.clear();
+			encodeMsgPack(LUA, -1, &body, &error);
+		}
+
+		LUA->Pop();
+	});
+}
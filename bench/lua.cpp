@@ -0,0 +1,175 @@
+#include <string>
+#include "bench.h"
+#include "fakelua.h"
+#include "mockbackend.h"
+#include "steamhttp.h"
+#include "submission.h"
+#include "completion.h"
+#include "lua.h"
+#include "responseobject.h"
+#include "prepared.h"
+#include "batch.h"
+
+static FakeLua lua;
+static MockBackend mock;
+
+// Pushes a request table like an addon would build it for STEAMHTTP
+static void pushRequestTable(FakeLua *LUA) {
+	LUA->CreateTable();
+	LUA->PushString("POST");
+	LUA->SetField(-2, "method");
+	LUA->PushString("http://127.0.0.1/api/v1/stats");
+	LUA->SetField(-2, "url");
+	LUA->PushString("application/json");
+	LUA->SetField(-2, "type");
+	LUA->PushString(std::string(512, 'x').c_str());
+	LUA->SetField(-2, "body");
+	mapToLuaTable(LUA, sampleHeaders());
+	LUA->SetField(-2, "headers");
+	LUA->pushFunction([](FakeLua *) { return 0; });
+	LUA->SetField(-2, "success");
+	LUA->pushFunction([](FakeLua *) { return 0; });
+	LUA->SetField(-2, "failed");
+}
+
+// Completes everything that the benchmark queued up
+static void drain(size_t n) {
+	FakeLua *LUA = &lua;
+
+	submitter.wait();
+	completions.settle();
+
+	for (size_t i = 0; i < n; i++) {
+		LUA->PushCFunction(callbackHook);
+		LUA->Call(0, 0);
+	}
+}
+
+void registerLuaBenchmarks() {
+	FakeLua *LUA = &lua;
+
+	addBenchmark("lua/mapToLuaTable", [=](size_t n) {
+		std::map<std::string, std::string> headers = sampleHeaders();
+
+		for (size_t i = 0; i < n; i++) {
+			mapToLuaTable(LUA, headers);
+			LUA->Pop();
+		}
+	});
+
+	addBenchmark("lua/mapFromLuaTable", [=](size_t n) {
+		mapToLuaTable(LUA, sampleHeaders());
+
+		for (size_t i = 0; i < n; i++)
+			mapFromLuaTable(LUA, -1);
+
+		LUA->Pop();
+	});
+
+	addBenchmark("lua/runSuccessHandler", [=](size_t n) {
+		HTTPResponse response;
+		response.code = 200;
+		response.body = std::string(1024, 'x');
+		response.headers = sampleHeaders();
+
+		for (size_t i = 0; i < n; i++) {
+			LUA->pushFunction([](FakeLua *) { return 0; });
+			runSuccessHandler(LUA, LUA->ReferenceCreate(), response);
+		}
+	});
+
+	// A handler that only looks at the status, with the body pushed as a
+	// string and as a response object
+	addBenchmark("lua/runSuccessHandler-64k", [=](size_t n) {
+		HTTPResponse response;
+		response.code = 200;
+		response.body = std::string(64 * 1024, 'x');
+		response.headers = sampleHeaders();
+
+		for (size_t i = 0; i < n; i++) {
+			HTTPResponse copy = response;
+			LUA->pushFunction([](FakeLua *) { return 0; });
+			runSuccessHandler(LUA, LUA->ReferenceCreate(), copy);
+		}
+	});
+
+	addBenchmark("lua/runSuccessHandler-lazy-64k", [=](size_t n) {
+		HTTPResponse response;
+		response.code = 200;
+		response.body = std::string(64 * 1024, 'x');
+		response.headers = sampleHeaders();
+
+		registerResponseObject(LUA);
+
+		for (size_t i = 0; i < n; i++) {
+			HTTPResponse copy = response;
+			LUA->pushFunction([](FakeLua *LUA) {
+				LUA->GetField(1, "Status");
+				LUA->Push(1);
+				LUA->Call(1, 1);
+				LUA->Pop();
+
+				LUA->GetField(1, "Close");
+				LUA->Push(1);
+				LUA->Call(1, 0);
+				return 0;
+			});
+			runSuccessHandler(LUA, LUA->ReferenceCreate(), copy, "", nullptr, true);
+		}
+	});
+
+	// Request table parsing plus handing the request to the submission thread
+	addBenchmark("lua/STEAMHTTP", [=](size_t n) {
+		backend = &mock;
+
+		for (size_t i = 0; i < n; i++) {
+			LUA->PushCFunction(STEAMHTTP);
+			pushRequestTable(LUA);
+			LUA->Call(1, 1);
+			LUA->Pop();
+		}
+	}, drain);
+
+	// 100 requests per call, against 100 calls of lua/STEAMHTTP
+	addBenchmark("lua/Batch-100", [=](size_t n) {
+		backend = &mock;
+
+		for (size_t i = 0; i < n; i++) {
+			LUA->PushCFunction(Batch);
+			LUA->CreateTable();
+			for (int j = 1; j <= 100; j++) {
+				LUA->PushNumber(j);
+				pushRequestTable(LUA);
+				LUA->SetTable(-3);
+			}
+			LUA->Call(1, 1);
+			LUA->Pop();
+		}
+	}, [](size_t n) { drain(n * 100); });
+
+	// The same request from a template, with only the body and handlers per call
+	addBenchmark("lua/Send", [=](size_t n) {
+		backend = &mock;
+		registerPreparedRequest(LUA);
+
+		LUA->PushCFunction(Prepare);
+		pushRequestTable(LUA);
+		LUA->Call(1, 1);
+
+		for (size_t i = 0; i < n; i++) {
+			LUA->GetField(-1, "Send");
+			LUA->Push(-2);
+			LUA->CreateTable();
+			LUA->PushString(std::string(512, 'x').c_str());
+			LUA->SetField(-2, "body");
+			LUA->pushFunction([](FakeLua *) { return 0; });
+			LUA->SetField(-2, "success");
+			LUA->pushFunction([](FakeLua *) { return 0; });
+			LUA->SetField(-2, "failed");
+			LUA->Call(2, 1);
+			LUA->Pop();
+		}
+
+		LUA->Pop();
+	}, drain);
+}
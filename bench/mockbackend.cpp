@@ -0,0 +1,336 @@
+#include <cctype>
+#include <cstring>
+#include "mockbackend.h"
+
+// What would be IPC calls on the Steam backend, per thread like there
+static thread_local uint64 mockcalls = 0;
+
+MockRequest *MockBackend::find(HTTPRequestHandle request) {
+	auto it = handles.find(request);
+
+	if (it == handles.end())
+		return nullptr;
+
+	return &it->second;
+}
+
+MockRequest *MockBackend::findCall(SteamAPICall_t apicall) {
+	auto it = calls.find(apicall);
+
+	if (it == calls.end())
+		return nullptr;
+
+	return find(it->second);
+}
+
+static bool equalsIgnoreCase(const std::string& a, const char *b) {
+	size_t i;
+
+	for (i = 0; i < a.size() && b[i]; i++) {
+		if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i]))
+			return false;
+	}
+
+	return i == a.size() && !b[i];
+}
+
+// Header names are case-insensitive, so is the lookup.
+static const std::string *findHeader(MockRequest *req, const char *name) {
+	for (auto const& e : req->response.headers) {
+		if (equalsIgnoreCase(e.first, name))
+			return &e.second;
+	}
+
+	return nullptr;
+}
+
+void MockBackend::script(std::string url, MockResponse response) {
+	std::lock_guard<std::mutex> lock(mutex);
+	scripts[url] = response;
+}
+
+void MockBackend::scriptNext(MockResponse response) {
+	std::lock_guard<std::mutex> lock(mutex);
+	queued.push_back(response);
+}
+
+void MockBackend::setDefault(MockResponse response) {
+	std::lock_guard<std::mutex> lock(mutex);
+	fallback = response;
+}
+
+void MockBackend::advance(uint64 ms) {
+	std::lock_guard<std::mutex> lock(mutex);
+	clock += ms;
+}
+
+uint64 MockBackend::now() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return clock;
+}
+
+size_t MockBackend::pending() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return handles.size();
+}
+
+size_t MockBackend::cookieContainers() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return containers.size();
+}
+
+void MockBackend::keepSent(bool keep) {
+	std::lock_guard<std::mutex> lock(mutex);
+	keeping = keep;
+}
+
+std::vector<MockRequest> MockBackend::takeSent() {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<MockRequest> taken;
+	taken.swap(sent);
+	return taken;
+}
+
+HTTPRequestHandle MockBackend::createRequest(EHTTPMethod method, const char *url) {
+	mockcalls++;
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Steam refuses anything that is not an absolute http(s) URL
+	if (strncmp(url, "http://", 7) != 0 && strncmp(url, "https://", 8) != 0)
+		return INVALID_HTTPREQUEST_HANDLE;
+
+	HTTPRequestHandle handle = nexthandle++;
+	MockRequest& req = handles[handle];
+	req.method = method;
+	req.url = url;
+
+	return handle;
+}
+
+bool MockBackend::setHeader(HTTPRequestHandle request, const char *name, const char *value) {
+	mockcalls++;
+	std::lock_guard<std::mutex> lock(mutex);
+	MockRequest *req = find(request);
+
+	if (!req || req->sent)
+		return false;
+
+	req->headers[name] = value;
+	return true;
+}
+
+bool MockBackend::setUserAgent(HTTPRequestHandle request, const char *useragent) {
+	mockcalls++;
+	std::lock_guard<std::mutex> lock(mutex);
+	MockRequest *req = find(request);
+
+	if (!req || req->sent)
+		return false;
+
+	req->useragent = useragent;
+	return true;
+}
+
+bool MockBackend::setParameter(HTTPRequestHandle request, const char *name, const char *value) {
+	mockcalls++;
+	std::lock_guard<std::mutex> lock(mutex);
+	MockRequest *req = find(request);
+
+	if (!req || req->sent)
+		return false;
+
+	req->parameters[name] = value;
+	return true;
+}
+
+bool MockBackend::setBody(HTTPRequestHandle request, const char *type, uint8 *body, uint32 size) {
+	mockcalls++;
+	std::lock_guard<std::mutex> lock(mutex);
+	MockRequest *req = find(request);
+
+	if (!req || req->sent)
+		return false;
+
+	req->type = type;
+	req->body.assign(reinterpret_cast<char *>(body), size);
+	return true;
+}
+
+bool MockBackend::setTimeout(HTTPRequestHandle request, uint32 ms) {
+	mockcalls++;
+	std::lock_guard<std::mutex> lock(mutex);
+	MockRequest *req = find(request);
+
+	if (!req || req->sent)
+		return false;
+
+	req->timeout = ms;
+	return true;
+}
+
+HTTPCookieContainerHandle MockBackend::createCookieContainer(bool /* allowresponses */) {
+	mockcalls++;
+	std::lock_guard<std::mutex> lock(mutex);
+	containers.insert(nextcontainer);
+	return nextcontainer++;
+}
+
+bool MockBackend::releaseCookieContainer(HTTPCookieContainerHandle container) {
+	mockcalls++;
+	std::lock_guard<std::mutex> lock(mutex);
+	return containers.erase(container) > 0;
+}
+
+bool MockBackend::setCookieContainer(HTTPRequestHandle request, HTTPCookieContainerHandle container) {
+	mockcalls++;
+	std::lock_guard<std::mutex> lock(mutex);
+	MockRequest *req = find(request);
+
+	if (!req || req->sent)
+		return false;
+
+	req->cookies = container;
+	return true;
+}
+
+bool MockBackend::sendRequest(HTTPRequestHandle request, SteamAPICall_t *apicall) {
+	mockcalls++;
+	std::lock_guard<std::mutex> lock(mutex);
+	MockRequest *req = find(request);
+
+	if (!req || req->sent)
+		return false;
+
+	auto script = scripts.find(req->url);
+	if (!queued.empty()) {
+		req->response = queued.front();
+		queued.pop_front();
+	} else {
+		req->response = script != scripts.end() ? script->second : fallback;
+	}
+	req->sent = true;
+	req->sendtime = clock;
+	req->apicall = nextcall++;
+
+	calls[req->apicall] = request;
+	*apicall = req->apicall;
+
+	if (keeping)
+		sent.push_back(*req);
+
+	return true;
+}
+
+bool MockBackend::isCompleted(SteamAPICall_t apicall, bool *failed) {
+	mockcalls++;
+	std::lock_guard<std::mutex> lock(mutex);
+	MockRequest *req = findCall(apicall);
+
+	if (!req) {
+		*failed = true;
+		return true;
+	}
+
+	if (clock - req->sendtime < req->response.latency)
+		return false;
+
+	*failed = req->response.apifailure;
+	return true;
+}
+
+std::string MockBackend::getFailureReason(SteamAPICall_t apicall) {
+	mockcalls++;
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (!findCall(apicall))
+		return "The API call handle is invalid.";
+
+	return "Scripted API call failure.";
+}
+
+bool MockBackend::getResult(SteamAPICall_t apicall, HTTPRequestCompleted_t *result, bool *failed) {
+	mockcalls++;
+	std::lock_guard<std::mutex> lock(mutex);
+	MockRequest *req = findCall(apicall);
+
+	if (!req || clock - req->sendtime < req->response.latency)
+		return false;
+
+	*failed = req->response.apifailure;
+	result->m_hRequest = calls[apicall];
+	result->m_ulContextValue = 0;
+	result->m_bRequestSuccessful = !req->response.unsuccessful;
+	result->m_eStatusCode = static_cast<EHTTPStatusCode>(req->response.code);
+	result->m_unBodySize = req->response.body.size();
+
+	return true;
+}
+
+bool MockBackend::getDownloadProgress(HTTPRequestHandle request, float *percent, uint64 *received) {
+	mockcalls++;
+	std::lock_guard<std::mutex> lock(mutex);
+	MockRequest *req = find(request);
+
+	if (!req)
+		return false;
+
+	bool completed = req->sent && clock - req->sendtime >= req->response.latency;
+	*percent = completed ? 100 : 0;
+	*received = completed ? req->response.body.size() : 0;
+	return true;
+}
+
+bool MockBackend::getBodyData(HTTPRequestHandle request, uint8 *buffer, uint32 size) {
+	mockcalls++;
+	std::lock_guard<std::mutex> lock(mutex);
+	MockRequest *req = find(request);
+
+	if (!req || size < req->response.body.size())
+		return false;
+
+	memcpy(buffer, req->response.body.data(), req->response.body.size());
+	return true;
+}
+
+bool MockBackend::getHeaderSize(HTTPRequestHandle request, const char *name, uint32 *size) {
+	mockcalls++;
+	std::lock_guard<std::mutex> lock(mutex);
+	MockRequest *req = find(request);
+	const std::string *value;
+
+	if (!req || !(value = findHeader(req, name)))
+		return false;
+
+	*size = value->size();
+	return true;
+}
+
+bool MockBackend::getHeaderValue(HTTPRequestHandle request, const char *name, uint8 *buffer, uint32 size) {
+	mockcalls++;
+	std::lock_guard<std::mutex> lock(mutex);
+	MockRequest *req = find(request);
+	const std::string *value;
+
+	if (!req || !(value = findHeader(req, name)) || size < value->size())
+		return false;
+
+	memcpy(buffer, value->data(), value->size());
+	return true;
+}
+
+bool MockBackend::releaseRequest(HTTPRequestHandle request) {
+	mockcalls++;
+	std::lock_guard<std::mutex> lock(mutex);
+	MockRequest *req = find(request);
+
+	if (!req)
+		return false;
+
+	calls.erase(req->apicall);
+	handles.erase(request);
+	return true;
+}
+
+uint64 MockBackend::ipcCalls() {
+	return mockcalls;
+}
@@ -0,0 +1,118 @@
+#ifndef _MOCKBACKEND_H
+#define _MOCKBACKEND_H
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include "backend.h"
+
+// A scripted response for the mock backend.
+struct MockResponse {
+	// Simulates a failed API call (IsAPICallCompleted reports failure)
+	bool apifailure = false;
+
+	// Simulates an unsuccessful HTTP request (e.g. connection refused)
+	bool unsuccessful = false;
+
+	long code = 200;
+	std::string body;
+	std::map<std::string, std::string> headers;
+
+	// Time in (virtual) milliseconds between send and completion
+	uint64 latency = 0;
+};
+
+// Everything the mock recorded about a request that was sent through it.
+struct MockRequest {
+	EHTTPMethod method;
+	std::string url;
+	std::string useragent;
+	std::map<std::string, std::string> headers;
+	std::map<std::string, std::string> parameters;
+	std::string type;
+	std::string body;
+	uint32 timeout = 0;
+	HTTPCookieContainerHandle cookies = INVALID_HTTPCOOKIE_HANDLE;
+
+	bool sent = false;
+	uint64 sendtime = 0;
+	SteamAPICall_t apicall = 0;
+	MockResponse response;
+};
+
+// Deterministic in-process backend. Each sent request takes the next
+// queued response if there is one, otherwise it is looked up by exact URL,
+// falling back to a default response. Time only moves when advance() is
+// called, so a given script always completes in the same order.
+class MockBackend : public HTTPBackend {
+	std::mutex mutex;
+	std::map<std::string, MockResponse> scripts;
+	std::deque<MockResponse> queued;
+	MockResponse fallback;
+
+	std::map<HTTPRequestHandle, MockRequest> handles;
+	std::map<SteamAPICall_t, HTTPRequestHandle> calls;
+	HTTPRequestHandle nexthandle = 1;
+	SteamAPICall_t nextcall = 1;
+	HTTPCookieContainerHandle nextcontainer = 1;
+	std::set<HTTPCookieContainerHandle> containers;
+	uint64 clock = 0;
+
+	bool keeping = false;
+	std::vector<MockRequest> sent;
+
+	MockRequest *find(HTTPRequestHandle request);
+	MockRequest *findCall(SteamAPICall_t apicall);
+
+public:
+	void script(std::string url, MockResponse response);
+	void scriptNext(MockResponse response);
+	void setDefault(MockResponse response);
+
+	void advance(uint64 ms);
+	uint64 now();
+
+	// Number of requests that have not been released yet
+	size_t pending();
+
+	// Number of cookie containers that have not been released yet
+	size_t cookieContainers();
+
+	// With keepSent(true), a copy of every request is kept as it was
+	// sent. takeSent() hands them over, oldest first, and forgets them.
+	void keepSent(bool keep);
+	std::vector<MockRequest> takeSent();
+
+	HTTPRequestHandle createRequest(EHTTPMethod method, const char *url);
+	bool setHeader(HTTPRequestHandle request, const char *name, const char *value);
+	bool setUserAgent(HTTPRequestHandle request, const char *useragent);
+	bool setParameter(HTTPRequestHandle request, const char *name, const char *value);
+	bool setBody(HTTPRequestHandle request, const char *type, uint8 *body, uint32 size);
+	bool sendRequest(HTTPRequestHandle request, SteamAPICall_t *apicall);
+	bool setTimeout(HTTPRequestHandle request, uint32 ms);
+
+	// Containers are only handed out and attached, the mock keeps no cookies
+	HTTPCookieContainerHandle createCookieContainer(bool allowresponses);
+	bool releaseCookieContainer(HTTPCookieContainerHandle container);
+	bool setCookieContainer(HTTPRequestHandle request, HTTPCookieContainerHandle container);
+
+	bool isCompleted(SteamAPICall_t apicall, bool *failed);
+	std::string getFailureReason(SteamAPICall_t apicall);
+	bool getResult(SteamAPICall_t apicall, HTTPRequestCompleted_t *result, bool *failed);
+
+	// Known for every live handle: the whole body once completed, else none
+	bool getDownloadProgress(HTTPRequestHandle request, float *percent, uint64 *received);
+
+	bool getBodyData(HTTPRequestHandle request, uint8 *buffer, uint32 size);
+	bool getHeaderSize(HTTPRequestHandle request, const char *name, uint32 *size);
+	bool getHeaderValue(HTTPRequestHandle request, const char *name, uint8 *buffer, uint32 size);
+
+	bool releaseRequest(HTTPRequestHandle request);
+
+	uint64 ipcCalls();
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include "bench.h"
+#include "nativebackend.h"
+
+#ifdef NATIVE_BACKEND_AVAILABLE
+
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "fakelua.h"
+#include "steamhttp.h"
+
+static FakeLua lua;
+static NativeBackend *native;
+static bool completed;
+
+// Minimal blocking HTTP/1.1 server, one thread per connection. Answers
+// every request with a fixed body and optionally closes the connection.
+static void serveConnection(int fd, bool close) {
+	std::string in;
+	char buffer[16384];
+	std::string body(1024, 'x');
+	std::string response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: "
+	                       + std::to_string(body.size()) + "\r\n"
+	                       + (close ? "Connection: close\r\n" : "") + "\r\n" + body;
+
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	while (true) {
+		size_t end = in.find("\r\n\r\n");
+
+		if (end == std::string::npos) {
+			ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+			if (received <= 0)
+				break;
+			in.append(buffer, received);
+			continue;
+		}
+
+		// Skip over the request body, if any
+		size_t length = 0;
+		size_t header = in.find("Content-Length: ");
+		if (header != std::string::npos && header < end)
+			length = strtoul(in.c_str() + header + 16, nullptr, 10);
+
+		while (in.size() < end + 4 + length) {
+			ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+			if (received <= 0)
+				break;
+			in.append(buffer, received);
+		}
+		in.erase(0, end + 4 + length);
+
+		if (send(fd, response.data(), response.size(), MSG_NOSIGNAL) < 0 || close)
+			break;
+	}
+
+	::close(fd);
+}
+
+// Starts a server on an ephemeral local port and returns the port
+static int startServer(bool close) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in addr = {};
+	socklen_t len = sizeof(addr);
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+
+	bind(fd, (sockaddr *)&addr, sizeof(addr));
+	listen(fd, 128);
+	getsockname(fd, (sockaddr *)&addr, &len);
+
+	std::thread([=]() {
+		int client;
+		while ((client = accept(fd, nullptr, nullptr)) >= 0)
+			std::thread(serveConnection, client, close).detach();
+	}).detach();
+
+	return ntohs(addr.sin_port);
+}
+
+static void addRoundtripBenchmark(std::string name, bool close) {
+	int port = startServer(close);
+	std::string url = "http://127.0.0.1:" + std::to_string(port) + "/api";
+	FakeLua *LUA = &lua;
+
+	addBenchmark(name, [=](size_t n) {
+		backend = native;
+
+		for (size_t i = 0; i < n; i++) {
+			completed = false;
+
+			LUA->PushCFunction(STEAMHTTP);
+			LUA->CreateTable();
+			LUA->PushString(url.c_str());
+			LUA->SetField(-2, "url");
+			LUA->pushFunction([](FakeLua *) {
+				completed = true;
+				return 0;
+			});
+			LUA->SetField(-2, "success");
+			LUA->Call(1, 1);
+			LUA->Pop();
+
+			// Tick as fast as possible until the response is in
+			while (!completed) {
+				LUA->PushCFunction(callbackHook);
+				LUA->Call(0, 0);
+			}
+		}
+	});
+}
+
+void registerNativeBenchmarks() {
+	native = new NativeBackend();
+
+	addRoundtripBenchmark("native/roundtrip-keepalive", false);
+	addRoundtripBenchmark("native/roundtrip-new-connection", true);
+}
+
+#else
+
+void registerNativeBenchmarks() {
+}
+
+#endif
@@ -0,0 +1,56 @@
+#include <atomic>
+#include <thread>
+#include "bench.h"
+#include "lockqueue.h"
+#include "steamhttp.h"
+
+static LockableQueue<QueuedRequestData> queue;
+
+void registerQueueBenchmarks() {
+	addBenchmark("queue/push+pop", [](size_t n) {
+		QueuedRequestData data = QueuedRequestData();
+		data.request.url = "http://127.0.0.1/api/v1/stats";
+		data.request.headers = sampleHeaders();
+
+		for (size_t i = 0; i < n; i++) {
+			queue.push(data);
+			data = queue.pop();
+		}
+	});
+
+	// The Think hook rotates in-flight requests through the queue,
+	// so it usually holds more than a single element.
+	addBenchmark("queue/rotate-100", [](size_t n) {
+		QueuedRequestData data = QueuedRequestData();
+		data.request.url = "http://127.0.0.1/api/v1/stats";
+
+		for (int i = 0; i < 100; i++)
+			queue.push(data);
+
+		for (size_t i = 0; i < n; i++)
+			queue.push(queue.pop());
+
+		while (!queue.empty())
+			queue.pop();
+	});
+
+	// Another thread pushing at the same time, like a backend thread would
+	addBenchmark("queue/push+pop-contended", [](size_t n) {
+		LockableQueue<int> ints;
+		std::atomic<bool> stop(false);
+		std::thread other([&]() {
+			while (!stop) {
+				ints.push(0);
+				ints.pop();
+			}
+		});
+
+		for (size_t i = 0; i < n; i++) {
+			ints.push(1);
+			ints.pop();
+		}
+
+		stop = true;
+		other.join();
+	});
+}
@@ -0,0 +1,38 @@
+#include <string>
+#include "bench.h"
+#include "mockbackend.h"
+#include "steamhttp.h"
+
+static MockBackend mock;
+
+static void addResponseBenchmark(std::string name, size_t bodysize) {
+	addBenchmark(name, [=](size_t n) {
+		MockResponse scripted;
+		scripted.body = std::string(bodysize, 'x');
+		scripted.headers["Content-Type"] = "application/json";
+		scripted.headers["Date"] = "Sun, 18 Oct 2026 12:00:00 GMT";
+		scripted.headers["ETag"] = "\"0123456789abcdef\"";
+		scripted.headers["Cache-Control"] = "no-cache";
+		mock.setDefault(scripted);
+
+		HTTPRequestHandle handle = mock.createRequest(k_EHTTPMethodGET, "http://127.0.0.1/");
+		SteamAPICall_t apicall;
+		mock.sendRequest(handle, &apicall);
+
+		backend = &mock;
+
+		for (size_t i = 0; i < n; i++) {
+			HTTPResponse response = HTTPResponse();
+			std::string failreason;
+			createHTTPResponse(handle, apicall, &response, &failreason);
+		}
+
+		mock.releaseRequest(handle);
+	});
+}
+
+void registerResponseBenchmarks() {
+	addResponseBenchmark("response/createHTTPResponse-1k", 1024);
+	addResponseBenchmark("response/createHTTPResponse-64k", 64 * 1024);
+	addResponseBenchmark("response/createHTTPResponse-2m", 2 * 1024 * 1024);
+}
@@ -73,6 +73,63 @@ solution "steamhttp"
 			filter "platforms:x86"
 				links {"steam_api"}
 		else
-			links {"steam_api"}
+			links {"steam_api", "pthread"}
 		end
 
+
+	filter {}
+
+	--
+	-- Standalone benchmarks for the Lua glue and the backends. These run
+	-- against a fake ILuaBase and the mock backend, so they need neither
+	-- Steam nor srcds. TOOLS_BUILD enables the hooks that let them wait
+	-- for the module's threads, which the module itself doesn't need.
+	--
+	project "steamhttp_bench"
+		kind	"ConsoleApp"
+		defines { "TOOLS_BUILD" }
+		includedirs { "steamworks/include/", "gmod-module-base/include/", "src/" }
+		files { "src/*.cpp", "src/*.h", "bench/*.cpp", "bench/*.h" }
+		removefiles { "src/module.cpp", "src/steambackend.cpp", "src/steambackend.h" }
+
+		if os.target() == "windows" then
+			defines { "WINDOWS_BUILD" }
+		else
+			links {"pthread"}
+		end
+
+	--
+	-- Replays a request trace or a recording through the module at a
+	-- simulated tick rate and reports the per-tick cost. See
+	-- tools/replay.cpp for the formats.
+	--
+	project "steamhttp_replay"
+		kind	"ConsoleApp"
+		defines { "TOOLS_BUILD" }
+		includedirs { "steamworks/include/", "gmod-module-base/include/", "src/", "bench/", "tools/" }
+		files { "src/*.cpp", "src/*.h", "bench/fakelua.*", "bench/mockbackend.*", "tools/*.cpp", "tools/*.h" }
+		removefiles { "src/module.cpp", "src/steambackend.cpp", "src/steambackend.h" }
+
+		if os.target() == "windows" then
+			defines { "WINDOWS_BUILD" }
+		else
+			links {"pthread"}
+		end
+
+	--
+	-- Behavior tests for the Lua glue and the request lifecycle, run
+	-- against the fake ILuaBase and the mock backend like the benchmarks.
+	-- Exits non-zero if any check failed.
+	--
+	project "steamhttp_test"
+		kind	"ConsoleApp"
+		defines { "TOOLS_BUILD" }
+		includedirs { "steamworks/include/", "gmod-module-base/include/", "src/", "bench/" }
+		files { "src/*.cpp", "src/*.h", "bench/fakelua.*", "bench/mockbackend.*", "tests/*.cpp", "tests/*.h" }
+		removefiles { "src/module.cpp", "src/steambackend.cpp", "src/steambackend.h" }
+
+		if os.target() == "windows" then
+			defines { "WINDOWS_BUILD" }
+		else
+			links {"pthread", "z"}
+		end
@@ -0,0 +1,68 @@
+#ifndef _BACKEND_H
+#define _BACKEND_H
+
+#include <functional>
+#include <string>
+#include "isteamhttp.h"
+
+// Abstract interface for everything we need from an HTTP implementation.
+// It mirrors the subset of ISteamHTTP/ISteamUtils that the request
+// lifecycle uses, so that the Steam backend is a thin wrapper and other
+// backends (mock, native) can be swapped in without touching the Lua glue.
+class HTTPBackend {
+public:
+	virtual ~HTTPBackend() {}
+
+	// Request creation and setup
+	virtual HTTPRequestHandle createRequest(EHTTPMethod method, const char *url) = 0;
+	virtual bool setHeader(HTTPRequestHandle request, const char *name, const char *value) = 0;
+	virtual bool setUserAgent(HTTPRequestHandle request, const char *useragent) = 0;
+	virtual bool setParameter(HTTPRequestHandle request, const char *name, const char *value) = 0;
+	virtual bool setBody(HTTPRequestHandle request, const char *type, uint8 *body, uint32 size) = 0;
+	virtual bool sendRequest(HTTPRequestHandle request, SteamAPICall_t *apicall) = 0;
+
+	// Fails the request if it hasn't completed `ms` milliseconds after sending
+	virtual bool setTimeout(HTTPRequestHandle /* request */, uint32 /* ms */) { return false; }
+
+	// Cookie jars that requests can share, like ISteamHTTP's cookie
+	// containers. Backends without cookie support return
+	// INVALID_HTTPCOOKIE_HANDLE and ignore it on requests.
+	virtual HTTPCookieContainerHandle createCookieContainer(bool /* allowresponses */) { return INVALID_HTTPCOOKIE_HANDLE; }
+	virtual bool releaseCookieContainer(HTTPCookieContainerHandle /* container */) { return false; }
+	virtual bool setCookieContainer(HTTPRequestHandle /* request */, HTTPCookieContainerHandle /* container */) { return false; }
+
+	// Completion polling
+	virtual bool isCompleted(SteamAPICall_t apicall, bool *failed) = 0;
+	virtual std::string getFailureReason(SteamAPICall_t apicall) = 0;
+	virtual bool getResult(SteamAPICall_t apicall, HTTPRequestCompleted_t *result, bool *failed) = 0;
+
+	// When the request finished (see nowMicros), or 0 if the backend can't tell
+	virtual uint64 completionTime(SteamAPICall_t /* apicall */) { return 0; }
+
+	// Registers a function that the backend calls, from any thread, when
+	// requests have completed, so pollers don't have to wait for their
+	// next round. Backends that can't tell never call it.
+	virtual void setCompletionListener(std::function<void()> /* listener */) {}
+
+	// How far the response has been downloaded, for status displays.
+	// `percent` is -1 and `received` is 0 when unknown.
+	virtual bool getDownloadProgress(HTTPRequestHandle /* request */, float * /* percent */, uint64 * /* received */) { return false; }
+
+	// Calls made on the calling thread that cross a process boundary (one
+	// per ISteamHTTP/ISteamUtils call for Steam). Backends running in
+	// process return 0.
+	virtual uint64 ipcCalls() { return 0; }
+
+	// IPC calls the backend itself counted since the last call to this,
+	// to cross-check ipcCalls(). 0 if it can't tell.
+	virtual uint64 reportedIPCCalls() { return 0; }
+
+	// Response reading
+	virtual bool getBodyData(HTTPRequestHandle request, uint8 *buffer, uint32 size) = 0;
+	virtual bool getHeaderSize(HTTPRequestHandle request, const char *name, uint32 *size) = 0;
+	virtual bool getHeaderValue(HTTPRequestHandle request, const char *name, uint8 *buffer, uint32 size) = 0;
+
+	virtual bool releaseRequest(HTTPRequestHandle request) = 0;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include <vector>
+#include "batch.h"
+#include "steamhttp.h"
+#include "util.h"
+#include "lua.h"
+
+static void runDoneHandler(Lua::ILuaBase *LUA, RequestBatch *batch) {
+	if (!batch->done)
+		return;
+
+	LUA->ReferencePush(batch->done);
+	LUA->ReferenceFree(batch->done);
+	LUA->ReferencePush(batch->results);
+	LUA->ReferenceFree(batch->results);
+	batch->done = batch->results = 0;
+
+	callHandler(LUA, 1, "");
+}
+
+/*
+ * STEAMHTTP.Batch(requests[, options])
+ * Sends a list of request tables, read like STEAMHTTP's, in one call. The
+ * requests' own handlers run as usual. If options.done is a function, it
+ * gets the list of all results, in the order of `requests`, once the last
+ * one has finished: {code, body, headers} for responses, {error} for
+ * failures (with the code if there was a response). Returns the number of
+ * requests that were sent.
+ */
+LUA_FUNCTION(Batch) {
+	LUA->CheckType(1, Lua::Type::TABLE);
+
+	std::shared_ptr<RequestBatch> batch = std::make_shared<RequestBatch>();
+	std::vector<HTTPRequest> requests;
+	std::string addon = callerAddon(LUA, 2);
+	uint64 parsed = nowMicros();
+
+	if (LUA->IsType(2, Lua::Type::TABLE)) {
+		LUA->GetField(2, "done");
+		if (LUA->IsType(-1, Lua::Type::FUNCTION)) {
+			batch->done = LUA->ReferenceCreate();
+			LUA->CreateTable();
+			batch->results = LUA->ReferenceCreate();
+		} else {
+			LUA->Pop();
+		}
+	}
+
+	for (size_t i = 1; ; i++) {
+		LUA->PushNumber(i);
+		LUA->GetTable(1);
+
+		if (LUA->IsType(-1, Lua::Type::NIL)) {
+			LUA->Pop();
+			break;
+		}
+
+		HTTPRequest request = defaultRequest();
+		std::string error;
+		int index = LUA->Top();
+
+		request.timing.parsed = parsed;
+		request.addon = addon;
+		request.batch = batch;
+		request.batchindex = i;
+
+		if (!LUA->IsType(index, Lua::Type::TABLE)) {
+			error = "invalid request";
+		} else {
+			readRequestHandlers(LUA, index, request);
+
+			if (readRequestOptions(LUA, index, request, &error) && readRequestBody(LUA, index, request, &error) && request.url.empty())
+				error = "invalid url";
+		}
+
+		LUA->Pop();
+
+		if (!error.empty()) {
+			recordBatchResult(LUA, request, nullptr, error);
+			failRequest(LUA, request, error);
+			continue;
+		}
+
+		requests.push_back(std::move(request));
+	}
+
+	size_t sent = requests.size();
+	batch->remaining = sent;
+
+	if (sent)
+		submitRequests(requests);
+	else
+		runDoneHandler(LUA, batch.get());
+
+	LUA->PushNumber(sent);
+	return 1;
+}
+
+void recordBatchResult(Lua::ILuaBase *LUA, const HTTPRequest& request, const HTTPResponse *response, const std::string& failure) {
+	RequestBatch *batch = request.batch.get();
+
+	// Nobody is going to look at the results
+	if (!batch->done)
+		return;
+
+	LUA->ReferencePush(batch->results);
+	LUA->PushNumber(request.batchindex);
+	pushRequestResult(LUA, response, failure, true);
+	LUA->SetTable(-3);
+	LUA->Pop();
+}
+
+void pushRequestResult(Lua::ILuaBase *LUA, const HTTPResponse *response, const std::string& failure, bool withheaders) {
+	LUA->CreateTable();
+
+	if (response) {
+		LUA->PushNumber(response->code);
+		LUA->SetField(-2, "code");
+	}
+
+	if (!failure.empty()) {
+		LUA->PushString(failure.c_str());
+		LUA->SetField(-2, "error");
+		return;
+	}
+
+	if (response->decoded)
+		pushJSON(LUA, response->json);
+	else
+		LUA->PushString(response->body.c_str(), response->body.size());
+	LUA->SetField(-2, "body");
+
+	if (withheaders) {
+		mapToLuaTable(LUA, response->headers);
+		LUA->SetField(-2, "headers");
+	}
+}
+
+void finishBatchRequest(Lua::ILuaBase *LUA, RequestBatch *batch) {
+	if (--batch->remaining == 0)
+		runDoneHandler(LUA, batch);
+}
@@ -0,0 +1,33 @@
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include <GarrysMod/Lua/Interface.h>
+#include "http.h"
+
+// Requests sent together by STEAMHTTP.Batch. Their results are collected
+// in a Lua table, which goes to the `done` handler once all have finished.
+struct RequestBatch {
+	// References to the done handler (0 if there is none) and the results
+	int done = 0;
+	int results = 0;
+
+	size_t remaining = 0;
+};
+
+// STEAMHTTP.Batch(requests[, options]), see batch.cpp
+int Batch(lua_State *L);
+
+// Puts the outcome of a finished batch request into the results. Called
+// by finishRequest before the request's own handlers run, `response` is
+// null if there was none.
+void recordBatchResult(GarrysMod::Lua::ILuaBase *LUA, const HTTPRequest& request, const HTTPResponse *response, const std::string& failure);
+
+// Pushes the table that batch results use for a request: {code, body,
+// headers} for responses, {error} (and the code, if there was a
+// response) for failures
+void pushRequestResult(GarrysMod::Lua::ILuaBase *LUA, const HTTPResponse *response, const std::string& failure, bool withheaders);
+
+// Counts the request as done, and runs the done handler after the last one
+void finishBatchRequest(GarrysMod::Lua::ILuaBase *LUA, RequestBatch *batch);
+
+#endif
@@ -0,0 +1,322 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include "client.h"
+#include "steamhttp.h"
+#include "batch.h"
+#include "util.h"
+#include "lua.h"
+
+// Type id of the metatable, from CreateMetaTable
+static int clienttype = -1;
+
+// Clients with held back requests, for pumpClients
+static std::vector<std::shared_ptr<HTTPClient>> throttled;
+
+// Clients with results for `ondone_batch` in this tick
+static std::vector<std::shared_ptr<HTTPClient>> delivering;
+
+HTTPClient::~HTTPClient() {
+	// The backend is gone if the module unloads before Lua collects us
+	if (backend && defaults.cookies != INVALID_HTTPCOOKIE_HANDLE)
+		backend->releaseCookieContainer(defaults.cookies);
+}
+
+// Takes a slot (and a token) for one more request, if the limits allow it
+static bool admit(HTTPClient *client) {
+	if (client->maxconcurrent && client->inflight >= client->maxconcurrent)
+		return false;
+
+	if (client->ratelimit > 0) {
+		uint64 now = nowMicros();
+
+		// Bursts of up to a second's worth of requests
+		client->tokens = std::min(std::max(1.0, client->ratelimit), client->tokens + (now - client->refilled) / 1e6 * client->ratelimit);
+		client->refilled = now;
+
+		if (client->tokens < 1)
+			return false;
+
+		client->tokens--;
+	}
+
+	client->inflight++;
+	return true;
+}
+
+static void sendWaiting(HTTPClient *client) {
+	while (!client->waiting.empty() && admit(client)) {
+		submitRequest(std::move(client->waiting.front()));
+		client->waiting.pop_front();
+	}
+}
+
+static void clientSubmit(const std::shared_ptr<HTTPClient>& client, HTTPRequest&& request) {
+	request.client = client;
+
+	// Held back requests go first
+	if (client->waiting.empty()) {
+		if (admit(client.get())) {
+			submitRequest(std::move(request));
+			return;
+		}
+
+		throttled.push_back(client);
+	}
+
+	client->waiting.push_back(std::move(request));
+}
+
+void clientFinished(HTTPClient *client) {
+	client->inflight--;
+	sendWaiting(client);
+}
+
+void pumpClients() {
+	for (size_t i = 0; i < throttled.size();) {
+		sendWaiting(throttled[i].get());
+
+		if (throttled[i]->waiting.empty()) {
+			throttled[i] = throttled.back();
+			throttled.pop_back();
+		} else {
+			i++;
+		}
+	}
+}
+
+void recordClientResult(Lua::ILuaBase *LUA, const HTTPRequest& request, const HTTPResponse *response, const std::string& failure) {
+	HTTPClient *client = request.client.get();
+
+	if (!client->ondonebatch)
+		return;
+
+	if (!client->tickresults) {
+		LUA->CreateTable();
+		client->tickresults = LUA->ReferenceCreate();
+		client->tickcount = 0;
+		delivering.push_back(request.client);
+	}
+
+	LUA->ReferencePush(client->tickresults);
+	LUA->PushNumber(++client->tickcount);
+	pushRequestResult(LUA, response, failure, false);
+	LUA->PushNumber(request.clientid);
+	LUA->SetField(-2, "id");
+	LUA->SetTable(-3);
+	LUA->Pop();
+}
+
+void deliverClientResults(Lua::ILuaBase *LUA) {
+	std::vector<std::shared_ptr<HTTPClient>> clients;
+	clients.swap(delivering);
+
+	for (auto& client : clients) {
+		int results = client->tickresults;
+		client->tickresults = 0;
+
+		// Collected during the tick
+		if (!client->ondonebatch || !results)
+			continue;
+
+		LUA->ReferencePush(client->ondonebatch);
+		LUA->ReferencePush(results);
+		LUA->ReferenceFree(results);
+		callHandler(LUA, 1, client->base);
+	}
+}
+
+void stopClients(Lua::ILuaBase *LUA) {
+	for (auto& client : throttled) {
+		// Never sent, so neither of the handlers will run
+		for (HTTPRequest& request : client->waiting) {
+			if (request.success)
+				LUA->ReferenceFree(request.success);
+			if (request.failed)
+				LUA->ReferenceFree(request.failed);
+		}
+
+		client->waiting.clear();
+	}
+
+	for (auto& client : delivering) {
+		if (client->tickresults)
+			LUA->ReferenceFree(client->tickresults);
+
+		client->tickresults = 0;
+	}
+
+	throttled.clear();
+	delivering.clear();
+}
+
+// The url for `path` below `base`, paths that are full urls stay as they are
+static std::string joinURL(const std::string& base, const std::string& path) {
+	if (base.empty() || path.find("://") != std::string::npos)
+		return path;
+	if (path.empty())
+		return base;
+
+	bool trailing = base.back() == '/', leading = path[0] == '/';
+
+	if (trailing && leading)
+		return base + path.substr(1);
+	if (!trailing && !leading && path[0] != '?')
+		return base + "/" + path;
+
+	return base + path;
+}
+
+/*
+ * STEAMHTTP.Client(options)
+ * Takes the same fields as a request table (headers, useragent, timeout,
+ * decode, ...) as defaults for all of the client's requests, plus:
+ *   base: url that request paths are relative to
+ *   cookies: false to not keep cookies between requests
+ *   maxconcurrent: how many requests may be in flight at once
+ *   ratelimit: how many requests may be sent per second
+ *   ondone_batch: function that gets the results of all of the client's
+ *     requests that finished in a tick at once, as a list of {id, code,
+ *     body} or {id, error} (see pushRequestResult)
+ * Requests over the limits wait and are sent in order. Returns the client,
+ * or nil and the reason if the options are invalid.
+ */
+LUA_FUNCTION(Client) {
+	LUA->CheckType(1, Lua::Type::TABLE);
+
+	std::shared_ptr<HTTPClient> client = std::make_shared<HTTPClient>();
+	std::string error;
+	bool cookies = true;
+
+	// The limits are checked first, nothing holds a reference yet
+	double maxconcurrent = 0, ratelimit = 0;
+
+	LUA->GetField(1, "maxconcurrent");
+	if (LUA->IsType(-1, Lua::Type::NUMBER))
+		maxconcurrent = LUA->GetNumber(-1);
+	LUA->GetField(1, "ratelimit");
+	if (LUA->IsType(-1, Lua::Type::NUMBER))
+		ratelimit = LUA->GetNumber(-1);
+	LUA->Pop(2);
+
+	if (std::isnan(maxconcurrent) || std::isnan(ratelimit)) {
+		LUA->PushNil();
+		LUA->PushString(std::isnan(maxconcurrent) ? "Invalid maxconcurrent: nan" : "Invalid ratelimit: nan");
+		return 2;
+	}
+
+	client->maxconcurrent = (int)clampNumber(maxconcurrent, 0, INT_MAX);
+	client->ratelimit = clampNumber(ratelimit, 0, 1e9);
+
+	client->defaults = defaultRequest();
+	client->defaults.addon = callerAddon(LUA, 2);
+
+	if (!readRequestOptions(LUA, 1, client->defaults, &error)) {
+		LUA->PushNil();
+		LUA->PushString(error.c_str());
+		return 2;
+	}
+
+	LUA->GetField(1, "base");
+	if (LUA->IsType(-1, Lua::Type::STRING))
+		client->base = LUA->GetString(-1);
+	LUA->Pop();
+
+	LUA->GetField(1, "cookies");
+	if (LUA->IsType(-1, Lua::Type::BOOL))
+		cookies = LUA->GetBool(-1);
+	LUA->Pop();
+
+
+	LUA->GetField(1, "ondone_batch");
+	if (LUA->IsType(-1, Lua::Type::FUNCTION))
+		client->ondonebatch = LUA->ReferenceCreate();
+	else
+		LUA->Pop();
+
+	// Cookies that responses set are kept for the following requests
+	if (cookies)
+		client->defaults.cookies = backend->createCookieContainer(true);
+
+	client->tokens = std::max(1.0, client->ratelimit);
+	client->refilled = nowMicros();
+
+	LUA->PushUserType(new std::shared_ptr<HTTPClient>(client), clienttype);
+	return 1;
+}
+
+/*
+ * client:Request(path[, request])
+ * Sends a request to `path` below the client's base. The request table is
+ * read like STEAMHTTP's, on top of the client's defaults, and headers and
+ * parameters are added to the client's. Returns the request's id (see
+ * ondone_batch), or false if it failed right away. Held back requests
+ * count as accepted.
+ */
+LUA_FUNCTION(clientRequest) {
+	std::shared_ptr<HTTPClient> *client = LUA->GetUserType<std::shared_ptr<HTTPClient>>(1, clienttype);
+
+	if (!client)
+		LUA->ArgError(1, "STEAMHTTP client expected");
+
+	const char *path = LUA->CheckString(2);
+	HTTPRequest request = (*client)->defaults;
+	std::string error;
+
+	request.timing.parsed = nowMicros();
+	request.url = joinURL((*client)->base, path);
+
+	if (LUA->IsType(3, Lua::Type::TABLE)) {
+		readRequestHandlers(LUA, 3, request);
+
+		if (!readRequestOptions(LUA, 3, request, &error) || !readRequestBody(LUA, 3, request, &error)) {
+			failRequest(LUA, request, error);
+			LUA->PushBool(false);
+			return 1;
+		}
+	}
+
+	// Only accepted requests get a number, so ids have no gaps
+	uint64 id = request.clientid = ++(*client)->lastid;
+
+	clientSubmit(*client, std::move(request));
+	LUA->PushNumber(id);
+	return 1;
+}
+
+LUA_FUNCTION(clientGC) {
+	std::shared_ptr<HTTPClient> *client = LUA->GetUserType<std::shared_ptr<HTTPClient>>(1, clienttype);
+
+	if (!client)
+		return 0;
+
+	// Requests still in flight outlive the object, but nobody is left to
+	// hear about them in bulk
+	if ((*client)->ondonebatch)
+		LUA->ReferenceFree((*client)->ondonebatch);
+	if ((*client)->tickresults)
+		LUA->ReferenceFree((*client)->tickresults);
+
+	(*client)->ondonebatch = (*client)->tickresults = 0;
+
+	delete client;
+	LUA->SetUserType(1, nullptr);
+	return 0;
+}
+
+void registerClient(Lua::ILuaBase *LUA) {
+	clienttype = LUA->CreateMetaTable("STEAMHTTPClient");
+
+	// Methods live on the metatable itself
+	LUA->Push(-1);
+	LUA->SetField(-2, "__index");
+
+	LUA->PushCFunction(clientRequest);
+	LUA->SetField(-2, "Request");
+	LUA->PushCFunction(clientGC);
+	LUA->SetField(-2, "__gc");
+
+	LUA->Pop();
+}
@@ -0,0 +1,65 @@
+#ifndef _CLIENT_H
+#define _CLIENT_H
+
+#include <deque>
+#include <GarrysMod/Lua/Interface.h>
+#include "http.h"
+
+// A session made by STEAMHTTP.Client: the defaults its requests start
+// from, the cookie container they share, and limits on how many of them
+// are in flight at once and sent per second. Used on the Lua thread.
+struct HTTPClient {
+	HTTPRequest defaults;
+
+	// Prepended to the paths given to client:Request
+	std::string base;
+
+	// 0 for no limit
+	int maxconcurrent = 0;
+	double ratelimit = 0;
+
+	int inflight = 0;
+
+	// Token bucket for `ratelimit`, refilled on use
+	double tokens = 0;
+	uint64 refilled = 0;
+
+	// Requests held back by the limits, oldest first
+	std::deque<HTTPRequest> waiting;
+
+	// Last id given to a request
+	uint64 lastid = 0;
+
+	// Reference to `ondone_batch` (0 if there is none), and to the table
+	// that collects the results of the current tick for it
+	int ondonebatch = 0;
+	int tickresults = 0;
+	size_t tickcount = 0;
+
+	~HTTPClient();
+};
+
+// Creates the metatable of clients, on module load
+void registerClient(GarrysMod::Lua::ILuaBase *LUA);
+
+// STEAMHTTP.Client{...}, see client.cpp
+int Client(lua_State *L);
+
+// Frees the slot of a finished request of the client, called by finishRequest
+void clientFinished(HTTPClient *client);
+
+// Adds a finished request to its client's results for this tick, if the
+// client has `ondone_batch`. Called by finishRequest before the request's
+// own handlers run, `response` is null if there was none.
+void recordClientResult(GarrysMod::Lua::ILuaBase *LUA, const HTTPRequest& request, const HTTPResponse *response, const std::string& failure);
+
+// Calls `ondone_batch` of every client that got results this tick
+void deliverClientResults(GarrysMod::Lua::ILuaBase *LUA);
+
+// Sends held back requests that the limits allow by now, once per tick
+void pumpClients();
+
+// Drops all held back requests and their handlers, on module unload
+void stopClients(GarrysMod::Lua::ILuaBase *LUA);
+
+#endif
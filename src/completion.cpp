@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <chrono>
+#include "completion.h"
+#include "metrics.h"
+#include "inflight.h"
+#include "msgpack.h"
+#include "recording.h"
+#include "util.h"
+
+CompletionPool completions;
+
+CompletionPool::~CompletionPool() {
+	stop();
+}
+
+void CompletionPool::start() {
+	running = true;
+	poller = std::thread(&CompletionPool::pollLoop, this);
+
+	for (int i = 0; i < WORKERS; i++)
+		workers.push_back(std::thread(&CompletionPool::workLoop, this));
+}
+
+void CompletionPool::kick() {
+	std::lock_guard<std::mutex> lock(mutex);
+	kicked = true;
+	notifying = true;
+	polling.notify_all();
+}
+
+void CompletionPool::add(QueuedRequestData queued) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (!running)
+		start();
+
+	// Benchmarks and tools switch backends on the fly. The old one
+	// may be gone already, so it keeps its (harmless) listener.
+	if (listening != backend) {
+		listening = backend;
+		listening->setCompletionListener([this]() { kick(); });
+	}
+
+	if (!queued.failure.empty()) {
+		ready.push(std::move(queued));
+		return;
+	}
+
+	incoming.push(std::move(queued));
+
+	// With a backend that tells us about completions, this one may have
+	// been reported before we had it, so poll it right away
+	if (notifying)
+		polling.notify_all();
+}
+
+bool CompletionPool::takeReady(QueuedRequestData *queued) {
+	if (ready.empty())
+		return false;
+
+	// Only the game thread takes from the ready queue, so it can't run
+	// empty in between
+	*queued = ready.pop();
+	return true;
+}
+
+size_t CompletionPool::readyCount() {
+	return ready.size();
+}
+
+#ifdef TOOLS_BUILD
+void CompletionPool::settle() {
+	std::unique_lock<std::mutex> lock(mutex);
+
+	if (!running)
+		return;
+
+	// The pass running now may have started before the caller's requests
+	// completed, so wait for one that starts after this call
+	uint64 target = started + 1;
+	settletarget = std::max(settletarget, target);
+
+	polling.notify_all();
+	idle.wait(lock, [&]() { return !running || (passes >= target && finished.empty() && busy == 0); });
+}
+#endif
+
+void CompletionPool::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (!running)
+			return;
+
+		running = false;
+		polling.notify_all();
+		working.notify_all();
+		listening = nullptr;
+	}
+
+	poller.join();
+	for (std::thread& worker : workers)
+		worker.join();
+
+	workers.clear();
+	finished.clear();
+	while (!incoming.empty())
+		incoming.pop();
+	while (!ready.empty())
+		ready.pop();
+}
+
+// Slow requests are polled less often, so that a lot of long-running
+// requests don't cost an IPC call each every few milliseconds
+uint64 CompletionPool::pollDelay(uint64 age) {
+	uint64 delay = age / 8;
+	delay = std::max<uint64>(delay, POLL_INTERVAL * 1000);
+	return std::min<uint64>(delay, MAX_POLL_INTERVAL * 1000);
+}
+
+void CompletionPool::pollLoop() {
+	std::vector<QueuedRequestData> inflight, waiting;
+	std::vector<uint64> nextpoll, waitingpoll;
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (running) {
+		// Settling and kicked passes poll everything, no matter the backoff
+		bool everything = kicked || started < settletarget;
+		kicked = false;
+		started++;
+		lock.unlock();
+
+		while (!incoming.empty()) {
+			inflight.push_back(incoming.pop());
+			nextpoll.push_back(0);
+		}
+
+		uint64 now = nowMicros();
+
+		for (size_t i = 0; i < inflight.size(); i++) {
+			QueuedRequestData& queued = inflight[i];
+
+			if (!everything && nextpoll[i] > now) {
+				waiting.push_back(std::move(queued));
+				waitingpoll.push_back(nextpoll[i]);
+				continue;
+			}
+
+			uint64 ipcmark = backend->ipcCalls();
+			bool done = backend->isCompleted(queued.apicall, &queued.apifailed);
+			uint64 ipccalls = backend->ipcCalls() - ipcmark;
+			queued.ipccalls += ipccalls;
+			metrics.ipccalls += ipccalls;
+
+			if (!done) {
+				waitingpoll.push_back(now + pollDelay(now - queued.request.timing.sent));
+				waiting.push_back(std::move(queued));
+				continue;
+			}
+
+			RequestTiming& timing = queued.request.timing;
+			timing.noticed = nowMicros();
+			timing.completed = backend->completionTime(queued.apicall);
+			if (!timing.completed || timing.completed > timing.noticed)
+				timing.completed = timing.noticed;
+
+			std::lock_guard<std::mutex> worklock(mutex);
+			finished.push_back(std::move(queued));
+			working.notify_one();
+		}
+
+		inflight.swap(waiting);
+		nextpoll.swap(waitingpoll);
+		waiting.clear();
+		waitingpoll.clear();
+
+		lock.lock();
+		passes++;
+		idle.notify_all();
+
+		if (!kicked && started >= settletarget)
+			polling.wait_for(lock, std::chrono::milliseconds(POLL_INTERVAL));
+	}
+
+	idle.notify_all();
+}
+
+void CompletionPool::workLoop() {
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (running) {
+		if (finished.empty()) {
+			working.wait(lock);
+			continue;
+		}
+
+		QueuedRequestData queued = std::move(finished.front());
+		finished.pop_front();
+		busy++;
+
+		lock.unlock();
+		materialize(queued);
+		ready.push(std::move(queued));
+		lock.lock();
+
+		busy--;
+		idle.notify_all();
+	}
+}
+
+// Only 2xx responses with a body are decoded. A 204 or an HTML error page
+// reaches the success handler as the plain body, with its status code,
+// instead of becoming a decoding failure.
+static bool shouldDecode(const HTTPResponse& response) {
+	return response.code >= 200 && response.code < 300 && !response.body.empty();
+}
+
+// Writes a finished request to the recording log. `response` is null for
+// failures. Copying and hashing the bodies happens here on the worker, the
+// recorder's thread only writes the encoded exchange.
+static void recordExchange(const QueuedRequestData& queued, const HTTPResponse *response, const std::string& failreason) {
+	RecordedExchange exchange;
+	const HTTPRequest& request = queued.request;
+
+	exchange.offset = recorder.offset(request.timing.sent);
+	exchange.duration = request.timing.completed - request.timing.sent;
+	exchange.method = request.method;
+	exchange.url = request.url;
+	exchange.headers = request.headers;
+
+	if (exchange.headers.count("Content-Type") == 0)
+		exchange.headers["Content-Type"] = request.type;
+	if (request.useragent.size() != 0)
+		exchange.headers["User-Agent"] = request.useragent;
+
+	if (recorder.fullBodies()) {
+		exchange.hasbody = true;
+		exchange.body = request.body;
+	}
+	exchange.bodysize = request.body.size();
+	exchange.bodyhash = hashBody(request.body);
+
+	if (response) {
+		exchange.successful = true;
+		exchange.code = response->code;
+		exchange.responseheaders = response->headers;
+		exchange.responsebody = response->body;
+	} else {
+		exchange.failreason = failreason;
+	}
+
+	recorder.record(exchange);
+}
+
+void CompletionPool::materialize(QueuedRequestData& queued) {
+	uint64 ipcmark = backend->ipcCalls();
+	std::string failreason;
+
+	if (queued.apifailed) {
+		queued.failurekind = FAILURE_API;
+		queued.failure = "API Error: " + backend->getFailureReason(queued.apicall);
+	} else if (!createHTTPResponse(queued.reqhandle, queued.apicall, &queued.response, &failreason)) {
+		queued.failurekind = FAILURE_RESPONSE;
+		queued.failure = "HTTP Error: " + failreason;
+	} else if (queued.request.decode == DECODE_JSON && shouldDecode(queued.response)) {
+		const std::string& body = queued.response.body;
+
+		if (parseJSON(body.data(), body.size(), &queued.response.json, &failreason)) {
+			queued.response.decoded = true;
+		} else {
+			queued.failurekind = FAILURE_DECODE;
+			queued.failure = "JSON Error: " + failreason;
+		}
+	} else if (queued.request.decode == DECODE_MSGPACK && shouldDecode(queued.response)) {
+		const std::string& body = queued.response.body;
+
+		if (parseMsgPack(body.data(), body.size(), &queued.response.json, &failreason)) {
+			queued.response.decoded = true;
+		} else {
+			queued.failurekind = FAILURE_DECODE;
+			queued.failure = "MessagePack Error: " + failreason;
+		}
+	}
+
+	if (queued.response.decoded && !queued.request.extract.empty())
+		extractPaths(&queued.response.json, queued.request.extract);
+
+	untrackRequest(queued.apicall);
+	backend->releaseRequest(queued.reqhandle);
+
+	// Undecodable bodies fail the request, but there still was a response
+	if (recorder.active()) {
+		bool responded = queued.failure.empty() || queued.failurekind == FAILURE_DECODE;
+		recordExchange(queued, responded ? &queued.response : nullptr, queued.failure);
+	}
+
+	queued.request.timing.materialized = nowMicros();
+
+	uint64 ipccalls = backend->ipcCalls() - ipcmark;
+	queued.ipccalls += ipccalls;
+	metrics.ipccalls += ipccalls;
+}
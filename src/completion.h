@@ -0,0 +1,87 @@
+#ifndef _COMPLETION_H
+#define _COMPLETION_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "lockqueue.h"
+#include "steamhttp.h"
+
+// Takes sent requests off the game thread's hands until they are ready
+// for Lua. A poller thread checks the in-flight requests for completion
+// every POLL_INTERVAL ms (less often for slow requests, right away when
+// the backend tells us something completed), and a few workers read
+// finished responses (result, body, headers) and release them on the
+// backend. callbackHook then only has to take ready requests and push
+// them into Lua.
+class CompletionPool {
+	static constexpr int WORKERS = 2;
+	static constexpr int POLL_INTERVAL = 10;
+	static constexpr int MAX_POLL_INTERVAL = 50;
+
+	std::mutex mutex;
+	std::condition_variable polling;
+	std::condition_variable working;
+	std::condition_variable idle;
+	bool running = false;
+
+	// Set by the backend's completion listener, polls everything right away
+	bool kicked = false;
+
+	// Whether the backend has a completion listener that ever fired
+	bool notifying = false;
+
+	// The backend our listener is registered with
+	HTTPBackend *listening = nullptr;
+
+	// For settle(): started and finished poll passes, busy workers and
+	// the pass that settle() callers wait for
+	uint64 started = 0;
+	uint64 passes = 0;
+	int busy = 0;
+	uint64 settletarget = 0;
+
+	// Sent requests, waiting for the poller to pick them up
+	LockableQueue<QueuedRequestData> incoming;
+
+	// Finished on the backend, waiting for a worker
+	std::deque<QueuedRequestData> finished;
+
+	// Ready for callbackHook
+	LockableQueue<QueuedRequestData> ready;
+
+	std::thread poller;
+	std::vector<std::thread> workers;
+
+	void start();
+	void kick();
+	static uint64 pollDelay(uint64 age);
+	void pollLoop();
+	void workLoop();
+	void materialize(QueuedRequestData& queued);
+
+public:
+	~CompletionPool();
+
+	// Hands over a request that was sent (or failed to send, in which
+	// case it goes straight to the ready queue)
+	void add(QueuedRequestData queued);
+
+	// Takes the next ready request, false if there is none
+	bool takeReady(QueuedRequestData *queued);
+	size_t readyCount();
+
+#ifdef TOOLS_BUILD
+	// Polls right away and blocks until everything that finished on the
+	// backend is ready. For benchmarks and tools driving a mock clock.
+	void settle();
+#endif
+
+	void stop();
+};
+
+extern CompletionPool completions;
+
+#endif
@@ -0,0 +1,726 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "deflate.h"
+
+static const int WINDOW_SIZE = 32768;
+static const int WINDOW_MASK = WINDOW_SIZE - 1;
+static const int HASH_BITS = 15;
+static const int HASH_SIZE = 1 << HASH_BITS;
+static const int MIN_MATCH = 3;
+static const int MAX_MATCH = 258;
+
+// Symbols per block before it is written out
+static const size_t BLOCK_SYMBOLS = 32768;
+
+// Literal/length codes that can occur, and the 288 that the fixed code
+// of block type 1 is defined over (286 and 287 are never used)
+static const int LITLEN_CODES = 286;
+static const int FIXED_LITLEN_CODES = 288;
+static const int DIST_CODES = 30;
+static const int CODELEN_CODES = 19;
+static const int END_OF_BLOCK = 256;
+
+static const int LENGTH_BASE[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const int LENGTH_EXTRA[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+static const int DIST_BASE[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+};
+static const int DIST_EXTRA[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+// Order in which the code length code lengths are sent
+static const int CODELEN_ORDER[CODELEN_CODES] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+};
+
+// How hard each level looks for matches: longest hash chain to follow,
+// match length that is good enough to stop, and whether to check if the
+// next position has a longer match before taking one
+struct LevelConfig {
+	int maxchain;
+	int nicelength;
+	bool lazy;
+};
+
+static const LevelConfig LEVELS[10] = {
+	{0, 0, false},
+	{4, 8, false},
+	{8, 16, false},
+	{16, 32, false},
+	{16, 16, true},
+	{32, 32, true},
+	{128, 128, true},
+	{256, 258, true},
+	{1024, 258, true},
+	{4096, 258, true},
+};
+
+// Lookup tables from match length and distance to their codes
+struct CodeTables {
+	uint8 lengthcode[MAX_MATCH + 1];
+	uint8 distcode[512];
+
+	CodeTables() {
+		for (int code = 0; code < 29; code++) {
+			for (int length = LENGTH_BASE[code]; length < LENGTH_BASE[code] + (1 << LENGTH_EXTRA[code]) && length <= MAX_MATCH; length++)
+				lengthcode[length] = code;
+		}
+
+		// 258 has a code of its own, even though 227 + 31 would cover it
+		lengthcode[MAX_MATCH] = 28;
+
+		// Distances up to 256 directly, longer ones by (distance - 1) >> 7
+		for (int code = 0; code < DIST_CODES; code++) {
+			for (int dist = DIST_BASE[code]; dist < DIST_BASE[code] + (1 << DIST_EXTRA[code]); dist++) {
+				if (dist <= 256)
+					distcode[dist - 1] = code;
+				else
+					distcode[256 + ((dist - 1) >> 7)] = code;
+			}
+		}
+	}
+
+	int distCode(int dist) const {
+		return dist <= 256 ? distcode[dist - 1] : distcode[256 + ((dist - 1) >> 7)];
+	}
+};
+
+static const CodeTables& codeTables() {
+	static const CodeTables tables;
+	return tables;
+}
+
+class BitWriter {
+	std::string *out;
+	uint64 bits = 0;
+	int count = 0;
+
+public:
+	explicit BitWriter(std::string *out) : out(out) {
+	}
+
+	void put(uint32 value, int length) {
+		bits |= (uint64)value << count;
+		count += length;
+
+		while (count >= 8) {
+			*out += (char)bits;
+			bits >>= 8;
+			count -= 8;
+		}
+	}
+
+	// Pads to the next byte boundary
+	void align() {
+		if (count > 0)
+			put(0, 8 - count);
+	}
+};
+
+// Deflate sends Huffman codes starting at their most significant bit
+static uint32 reverseBits(uint32 code, int length) {
+	uint32 reversed = 0;
+
+	for (int i = 0; i < length; i++, code >>= 1)
+		reversed = (reversed << 1) | (code & 1);
+
+	return reversed;
+}
+
+// Code and its length in bits (0 for unused symbols) of each symbol, side
+// by side since writing a symbol always needs both
+struct HuffmanSymbol {
+	uint32 code;
+	uint8 length;
+};
+
+struct HuffmanCode {
+	HuffmanSymbol symbols[FIXED_LITLEN_CODES];
+};
+
+// Assigns canonical codes to the lengths (RFC 1951, 3.2.2)
+static void assignCodes(HuffmanCode *huffman, int symbols) {
+	int counts[16] = {0};
+	uint32 next[16] = {0};
+	uint32 code = 0;
+
+	for (int i = 0; i < symbols; i++)
+		counts[huffman->symbols[i].length]++;
+
+	counts[0] = 0;
+	for (int bits = 1; bits < 16; bits++) {
+		code = (code + counts[bits - 1]) << 1;
+		next[bits] = code;
+	}
+
+	for (int i = 0; i < symbols; i++) {
+		HuffmanSymbol& symbol = huffman->symbols[i];
+		symbol.code = symbol.length ? reverseBits(next[symbol.length]++, symbol.length) : 0;
+	}
+}
+
+// Computes code lengths of at most `maxbits` for the given frequencies
+static void buildLengths(const uint32 *freqs, int symbols, int maxbits, HuffmanCode *huffman) {
+	std::vector<std::pair<uint32, int>> used;
+
+	for (HuffmanSymbol& symbol : huffman->symbols)
+		symbol = HuffmanSymbol();
+
+	for (int i = 0; i < symbols; i++) {
+		if (freqs[i])
+			used.push_back({freqs[i], i});
+	}
+
+	// A code needs two symbols to be complete, so make one up if needed
+	for (int i = 0; used.size() < 2; i++) {
+		if (!freqs[i])
+			used.push_back({0, i});
+	}
+
+	std::sort(used.begin(), used.end());
+
+	// Huffman's algorithm on the sorted leaves: merged nodes are created
+	// in order of weight, so two queues are enough instead of a heap
+	size_t leaves = used.size();
+	std::vector<uint64> weights(2 * leaves - 1);
+	std::vector<int> parents(2 * leaves - 1);
+	size_t leaf = 0, merged = leaves, next = leaves;
+
+	for (size_t i = 0; i < leaves; i++)
+		weights[i] = used[i].first;
+
+	auto smallest = [&]() {
+		if (leaf < leaves && (merged >= next || weights[leaf] <= weights[merged]))
+			return leaf++;
+		return merged++;
+	};
+
+	for (; next < 2 * leaves - 1; next++) {
+		size_t a = smallest();
+		size_t b = smallest();
+		weights[next] = weights[a] + weights[b];
+		parents[a] = parents[b] = next;
+	}
+
+	// Depths from the root down, then the number of codes per length
+	std::vector<int> depths(2 * leaves - 1);
+	int counts[64] = {0};
+
+	depths[2 * leaves - 2] = 0;
+	for (size_t i = 2 * leaves - 2; i-- > 0;)
+		depths[i] = depths[parents[i]] + 1;
+
+	for (size_t i = 0; i < leaves; i++)
+		counts[std::min(depths[i], 63)]++;
+
+	// Too long codes get the maximum length, then shorter codes are
+	// lengthened until the code is complete again (as zlib and miniz do)
+	for (int bits = maxbits + 1; bits < 64; bits++) {
+		counts[maxbits] += counts[bits];
+		counts[bits] = 0;
+	}
+
+	uint32 total = 0;
+	for (int bits = 1; bits <= maxbits; bits++)
+		total += (uint32)counts[bits] << (maxbits - bits);
+
+	while (total > (1u << maxbits)) {
+		counts[maxbits]--;
+
+		for (int bits = maxbits - 1; bits > 0; bits--) {
+			if (counts[bits]) {
+				counts[bits]--;
+				counts[bits + 1] += 2;
+				break;
+			}
+		}
+
+		total--;
+	}
+
+	// The least frequent symbols get the longest codes
+	size_t i = 0;
+	for (int bits = maxbits; bits > 0; bits--) {
+		for (int n = 0; n < counts[bits]; n++)
+			huffman->symbols[used[i++].second].length = bits;
+	}
+
+	assignCodes(huffman, symbols);
+}
+
+// A literal (dist 0) or a match
+struct LZSymbol {
+	uint16 value;
+	uint16 dist;
+};
+
+class Deflater {
+	const uint8 *data;
+	size_t length;
+	LevelConfig config;
+	BitWriter writer;
+	const CodeTables& tables;
+
+	std::vector<int32> head;
+	std::vector<int32> prev;
+
+	std::vector<LZSymbol> symbols;
+	size_t blockstart = 0;
+	size_t emitted = 0;
+
+	uint32 hashAt(size_t pos) {
+		return ((data[pos] << 10) ^ (data[pos + 1] << 5) ^ data[pos + 2]) & (HASH_SIZE - 1);
+	}
+
+	void insert(size_t pos) {
+		if (pos + MIN_MATCH > length)
+			return;
+
+		uint32 hash = hashAt(pos);
+		prev[pos & WINDOW_MASK] = head[hash];
+		head[hash] = pos;
+	}
+
+	// Number of equal bytes at `a` and `b`, skipping eight at a time
+	// until the block with the difference
+	static int matchLength(const uint8 *a, const uint8 *b, int maxlength) {
+		int matched = 0;
+
+		while (matched + 8 <= maxlength) {
+			uint64 x, y;
+			memcpy(&x, a + matched, 8);
+			memcpy(&y, b + matched, 8);
+
+			if (x != y)
+				break;
+
+			matched += 8;
+		}
+
+		while (matched < maxlength && a[matched] == b[matched])
+			matched++;
+
+		return matched;
+	}
+
+	// Longest earlier match for the data at `pos`, better than `bestlength`
+	int longestMatch(size_t pos, int bestlength, int *bestdist) {
+		int chain = config.maxchain;
+		int maxlength = (int)std::min<size_t>(MAX_MATCH, length - pos);
+
+		// Also keeps the quick check below inside the data
+		if (maxlength < MIN_MATCH || bestlength >= maxlength)
+			return 0;
+
+		int32 candidate = head[hashAt(pos)];
+
+		while (candidate >= 0 && chain-- > 0) {
+			size_t dist = pos - candidate;
+
+			if (dist > WINDOW_SIZE || dist == 0)
+				break;
+
+			const uint8 *a = data + pos, *b = data + candidate;
+
+			if (b[bestlength] == a[bestlength] && b[0] == a[0]) {
+				int matched = matchLength(a, b, maxlength);
+
+				if (matched > bestlength) {
+					bestlength = matched;
+					*bestdist = dist;
+
+					if (matched >= config.nicelength || matched == maxlength)
+						break;
+				}
+			}
+
+			int32 older = prev[candidate & WINDOW_MASK];
+			if (older >= candidate)
+				break;
+			candidate = older;
+		}
+
+		return bestlength >= MIN_MATCH ? bestlength : 0;
+	}
+
+	void literal(size_t pos) {
+		symbols.push_back({data[pos], 0});
+		emitted = pos + 1;
+		maybeFlush(false);
+	}
+
+	void match(size_t pos, int matchlength, int dist) {
+		symbols.push_back({(uint16)matchlength, (uint16)dist});
+		emitted = pos + matchlength;
+		maybeFlush(false);
+	}
+
+	void maybeFlush(bool final) {
+		if (final || symbols.size() >= BLOCK_SYMBOLS)
+			writeBlock(final);
+	}
+
+	void writeStored(bool final) {
+		size_t pos = blockstart;
+
+		do {
+			size_t chunk = std::min<size_t>(emitted - pos, 65535);
+			bool last = final && pos + chunk == emitted;
+
+			writer.put(last ? 1 : 0, 1);
+			writer.put(0, 2);
+			writer.align();
+			writer.put(chunk, 16);
+			writer.put(~chunk & 0xffff, 16);
+
+			for (size_t i = 0; i < chunk; i++)
+				writer.put(data[pos + i], 8);
+
+			pos += chunk;
+		} while (pos < emitted);
+	}
+
+	void putSymbol(const HuffmanCode& huffman, int symbol) {
+		writer.put(huffman.symbols[symbol].code, huffman.symbols[symbol].length);
+	}
+
+	void writeSymbols(const HuffmanCode& litlen, const HuffmanCode& dist) {
+		for (const LZSymbol& symbol : symbols) {
+			if (!symbol.dist) {
+				putSymbol(litlen, symbol.value);
+				continue;
+			}
+
+			int lcode = tables.lengthcode[symbol.value];
+			putSymbol(litlen, 257 + lcode);
+			writer.put(symbol.value - LENGTH_BASE[lcode], LENGTH_EXTRA[lcode]);
+
+			int dcode = tables.distCode(symbol.dist);
+			putSymbol(dist, dcode);
+			writer.put(symbol.dist - DIST_BASE[dcode], DIST_EXTRA[dcode]);
+		}
+
+		putSymbol(litlen, END_OF_BLOCK);
+	}
+
+	// Run-length encodes the code lengths of both trees (RFC 1951, 3.2.7).
+	// Entries are the code length code, with the repeat count above bit 8.
+	static void encodeLengths(const uint8 *lengths, int count, std::vector<int> *encoded) {
+		for (int i = 0; i < count;) {
+			int value = lengths[i], run = 1;
+
+			while (i + run < count && lengths[i + run] == value)
+				run++;
+
+			i += run;
+
+			if (value == 0) {
+				while (run >= 11) {
+					int n = std::min(run, 138);
+					encoded->push_back(18 | ((n - 11) << 8));
+					run -= n;
+				}
+				if (run >= 3) {
+					encoded->push_back(17 | ((run - 3) << 8));
+					run = 0;
+				}
+			} else {
+				encoded->push_back(value);
+				run--;
+
+				while (run >= 3) {
+					int n = std::min(run, 6);
+					encoded->push_back(16 | ((n - 3) << 8));
+					run -= n;
+				}
+			}
+
+			for (; run > 0; run--)
+				encoded->push_back(value);
+		}
+	}
+
+	void writeBlock(bool final) {
+		uint32 litfreqs[LITLEN_CODES] = {0}, distfreqs[DIST_CODES] = {0};
+		uint64 extrabits = 0;
+
+		for (const LZSymbol& symbol : symbols) {
+			if (!symbol.dist) {
+				litfreqs[symbol.value]++;
+				continue;
+			}
+
+			int lcode = tables.lengthcode[symbol.value];
+			int dcode = tables.distCode(symbol.dist);
+			litfreqs[257 + lcode]++;
+			distfreqs[dcode]++;
+			extrabits += LENGTH_EXTRA[lcode] + DIST_EXTRA[dcode];
+		}
+		litfreqs[END_OF_BLOCK]++;
+
+		HuffmanCode litlen, dist, codelen;
+		buildLengths(litfreqs, LITLEN_CODES, 15, &litlen);
+		buildLengths(distfreqs, DIST_CODES, 15, &dist);
+
+		int hlit = LITLEN_CODES, hdist = DIST_CODES;
+		while (hlit > 257 && !litlen.symbols[hlit - 1].length)
+			hlit--;
+		while (hdist > 1 && !dist.symbols[hdist - 1].length)
+			hdist--;
+
+		uint8 lengths[LITLEN_CODES + DIST_CODES];
+		std::vector<int> encoded;
+		uint32 codelenfreqs[CODELEN_CODES] = {0};
+
+		for (int i = 0; i < hlit; i++)
+			lengths[i] = litlen.symbols[i].length;
+		for (int i = 0; i < hdist; i++)
+			lengths[hlit + i] = dist.symbols[i].length;
+		encodeLengths(lengths, hlit + hdist, &encoded);
+
+		for (int entry : encoded)
+			codelenfreqs[entry & 0xff]++;
+
+		buildLengths(codelenfreqs, CODELEN_CODES, 7, &codelen);
+
+		int hclen = CODELEN_CODES;
+		while (hclen > 4 && !codelen.symbols[CODELEN_ORDER[hclen - 1]].length)
+			hclen--;
+
+		// Sizes of the block in bits for all three block types
+		uint64 dynamicbits = 3 + 5 + 5 + 4 + 3 * hclen + extrabits;
+		for (int entry : encoded) {
+			int code = entry & 0xff;
+			dynamicbits += codelen.symbols[code].length + (code == 16 ? 2 : code == 17 ? 3 : code == 18 ? 7 : 0);
+		}
+
+		uint64 fixedbits = 3 + extrabits;
+		for (int i = 0; i < LITLEN_CODES; i++) {
+			dynamicbits += (uint64)litfreqs[i] * litlen.symbols[i].length;
+			fixedbits += (uint64)litfreqs[i] * (i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8);
+		}
+		for (int i = 0; i < DIST_CODES; i++) {
+			dynamicbits += (uint64)distfreqs[i] * dist.symbols[i].length;
+			fixedbits += (uint64)distfreqs[i] * 5;
+		}
+
+		uint64 storedbits = (emitted - blockstart + 5 * ((emitted - blockstart) / 65535 + 1)) * 8 + 7;
+
+		if (storedbits <= dynamicbits && storedbits <= fixedbits) {
+			writeStored(final);
+		} else if (fixedbits <= dynamicbits) {
+			writer.put(final ? 1 : 0, 1);
+			writer.put(1, 2);
+			writeSymbols(fixedCode(true), fixedCode(false));
+		} else {
+			writer.put(final ? 1 : 0, 1);
+			writer.put(2, 2);
+			writer.put(hlit - 257, 5);
+			writer.put(hdist - 1, 5);
+			writer.put(hclen - 4, 4);
+
+			for (int i = 0; i < hclen; i++)
+				writer.put(codelen.symbols[CODELEN_ORDER[i]].length, 3);
+
+			for (int entry : encoded) {
+				int code = entry & 0xff;
+				putSymbol(codelen, code);
+
+				if (code == 16)
+					writer.put(entry >> 8, 2);
+				else if (code == 17)
+					writer.put(entry >> 8, 3);
+				else if (code == 18)
+					writer.put(entry >> 8, 7);
+			}
+
+			writeSymbols(litlen, dist);
+		}
+
+		symbols.clear();
+		blockstart = emitted;
+	}
+
+	// The predefined codes of block type 1
+	static const HuffmanCode& fixedCode(bool literals) {
+		static const HuffmanCode litlen = []() {
+			HuffmanCode code = HuffmanCode();
+			for (int i = 0; i < FIXED_LITLEN_CODES; i++)
+				code.symbols[i].length = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+			assignCodes(&code, FIXED_LITLEN_CODES);
+			return code;
+		}();
+		static const HuffmanCode dist = []() {
+			HuffmanCode code = HuffmanCode();
+			for (int i = 0; i < DIST_CODES; i++)
+				code.symbols[i].length = 5;
+			assignCodes(&code, DIST_CODES);
+			return code;
+		}();
+
+		return literals ? litlen : dist;
+	}
+
+public:
+	Deflater(const char *data, size_t length, int level, std::string *out)
+		: data((const uint8 *)data), length(length), config(LEVELS[level]), writer(out), tables(codeTables()) {
+	}
+
+	void run() {
+		if (config.maxchain == 0) {
+			emitted = length;
+			writeStored(true);
+			return;
+		}
+
+		head.assign(HASH_SIZE, -1);
+		prev.assign(WINDOW_SIZE, -1);
+		symbols.reserve(BLOCK_SYMBOLS);
+
+		size_t pos = 0;
+
+		if (!config.lazy) {
+			while (pos < length) {
+				int dist = 0;
+				int matched = longestMatch(pos, MIN_MATCH - 1, &dist);
+
+				if (matched) {
+					match(pos, matched, dist);
+					for (int i = 0; i < matched; i++)
+						insert(pos + i);
+					pos += matched;
+				} else {
+					literal(pos);
+					insert(pos);
+					pos++;
+				}
+			}
+		} else {
+			// Like zlib's deflate_slow: a match is only taken if the next
+			// position doesn't have a longer one
+			int prevlength = 0, prevdist = 0;
+			bool pending = false;
+
+			while (pos < length) {
+				int dist = 0;
+				int matched = 0;
+
+				if (prevlength < config.nicelength)
+					matched = longestMatch(pos, std::max(prevlength, MIN_MATCH - 1), &dist);
+
+				if (prevlength >= MIN_MATCH && matched <= prevlength) {
+					match(pos - 1, prevlength, prevdist);
+
+					for (size_t i = pos; i < pos - 1 + prevlength; i++)
+						insert(i);
+
+					pos = pos - 1 + prevlength;
+					prevlength = 0;
+					pending = false;
+					continue;
+				}
+
+				if (pending)
+					literal(pos - 1);
+
+				insert(pos);
+				prevlength = matched;
+				prevdist = dist;
+				pending = true;
+				pos++;
+			}
+
+			if (pending && prevlength >= MIN_MATCH)
+				match(pos - 1, prevlength, prevdist);
+			else if (pending)
+				literal(pos - 1);
+		}
+
+		maybeFlush(true);
+		writer.align();
+	}
+};
+
+void deflateCompress(const char *data, size_t length, int level, std::string *out) {
+	level = std::max(0, std::min(level, 9));
+
+	Deflater deflater(data, length, level, out);
+	deflater.run();
+}
+
+void gzipCompress(const char *data, size_t length, int level, std::string *out) {
+	// Magic, deflate, no flags, no time, no extra flags, unknown OS
+	static const char HEADER[10] = {'\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, '\xff'};
+	uint32 crc = crc32(data, length);
+
+	out->append(HEADER, sizeof(HEADER));
+	deflateCompress(data, length, level, out);
+
+	for (int i = 0; i < 4; i++)
+		*out += (char)(crc >> (i * 8));
+	for (int i = 0; i < 4; i++)
+		*out += (char)((uint32)length >> (i * 8));
+}
+
+void zlibCompress(const char *data, size_t length, int level, std::string *out) {
+	uint32 adler = adler32(data, length);
+
+	// Deflate with a 32K window, no dictionary, default level hint
+	*out += '\x78';
+	*out += '\x9c';
+	deflateCompress(data, length, level, out);
+
+	for (int i = 3; i >= 0; i--)
+		*out += (char)(adler >> (i * 8));
+}
+
+uint32 crc32(const char *data, size_t length, uint32 crc) {
+	static const std::vector<uint32> table = []() {
+		std::vector<uint32> table(256);
+
+		for (uint32 i = 0; i < 256; i++) {
+			uint32 c = i;
+			for (int k = 0; k < 8; k++)
+				c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			table[i] = c;
+		}
+
+		return table;
+	}();
+
+	crc = ~crc;
+	for (size_t i = 0; i < length; i++)
+		crc = table[(crc ^ (uint8)data[i]) & 0xff] ^ (crc >> 8);
+
+	return ~crc;
+}
+
+uint32 adler32(const char *data, size_t length, uint32 adler) {
+	uint32 a = adler & 0xffff, b = adler >> 16;
+
+	while (length > 0) {
+		// Largest run that can't overflow before the modulo
+		size_t run = std::min<size_t>(length, 5552);
+		length -= run;
+
+		for (; run > 0; run--) {
+			a += (uint8)*data++;
+			b += a;
+		}
+
+		a %= 65521;
+		b %= 65521;
+	}
+
+	return (b << 16) | a;
+}
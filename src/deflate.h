@@ -0,0 +1,19 @@
+#ifndef _DEFLATE_H
+#define _DEFLATE_H
+
+#include <string>
+#include "steamtypes.h"
+
+// A small deflate (RFC 1951) compressor for request bodies. Level 0
+// only stores, 1 is the fastest and 9 the best compression, as in zlib.
+void deflateCompress(const char *data, size_t length, int level, std::string *out);
+
+// The same, wrapped as gzip (RFC 1952) or zlib (RFC 1950) stream, which
+// is what Content-Encoding gzip and deflate mean
+void gzipCompress(const char *data, size_t length, int level, std::string *out);
+void zlibCompress(const char *data, size_t length, int level, std::string *out);
+
+uint32 crc32(const char *data, size_t length, uint32 crc = 0);
+uint32 adler32(const char *data, size_t length, uint32 adler = 1);
+
+#endif
@@ -0,0 +1,179 @@
+#include <cstdlib>
+#include <cstring>
+#include "extract.h"
+
+bool parseExtractPath(const std::string& text, ExtractPath *path, std::string *error) {
+	size_t pos = 0;
+
+	path->text = text;
+	path->steps.clear();
+	path->multiple = false;
+
+	while (pos < text.size()) {
+		ExtractStep step = ExtractStep();
+
+		if (text[pos] == '[') {
+			size_t close = text.find(']', pos);
+
+			if (close == std::string::npos) {
+				error->assign("missing ']' in \"" + text + "\"");
+				return false;
+			}
+
+			std::string inside = text.substr(pos + 1, close - pos - 1);
+
+			if (inside == "*") {
+				step.kind = EXTRACT_ALL;
+				path->multiple = true;
+			} else if (!inside.empty() && inside.size() <= 9 && inside.find_first_not_of("0123456789") == std::string::npos) {
+				step.kind = EXTRACT_INDEX;
+				step.index = strtoul(inside.c_str(), nullptr, 10);
+			} else {
+				error->assign("invalid index [" + inside + "] in \"" + text + "\"");
+				return false;
+			}
+
+			pos = close + 1;
+		} else {
+			// Keys start the path or follow a dot
+			if (!path->steps.empty()) {
+				if (text[pos] != '.') {
+					error->assign("expected '.' or '[' at offset " + std::to_string(pos) + " in \"" + text + "\"");
+					return false;
+				}
+
+				pos++;
+			}
+
+			size_t end = text.find_first_of(".[", pos);
+			if (end == std::string::npos)
+				end = text.size();
+
+			if (end == pos) {
+				error->assign("empty key in \"" + text + "\"");
+				return false;
+			}
+
+			step.kind = EXTRACT_KEY;
+			step.key = text.substr(pos, end - pos);
+			pos = end;
+		}
+
+		path->steps.push_back(step);
+	}
+
+	if (path->steps.empty()) {
+		error->assign("empty path");
+		return false;
+	}
+
+	return true;
+}
+
+// Index of the node after the one at `index` and all of its children
+static size_t skipNode(const JSONTape& tape, size_t index) {
+	size_t remaining = 1;
+
+	while (remaining) {
+		const JSONNode& node = tape.nodes[index++];
+		remaining--;
+
+		if (node.type == JSON_ARRAY)
+			remaining += node.length;
+		else if (node.type == JSON_OBJECT)
+			remaining += 2 * (size_t)node.length;
+	}
+
+	return index;
+}
+
+// Collects the nodes that `steps` (from `step` on) select below `index`
+static void matchPath(const JSONTape& tape, size_t index, const std::vector<ExtractStep>& steps, size_t step, std::vector<size_t> *matches) {
+	if (step == steps.size()) {
+		matches->push_back(index);
+		return;
+	}
+
+	const JSONNode& node = tape.nodes[index];
+	const ExtractStep& current = steps[step];
+	size_t child = index + 1;
+
+	if (node.type == JSON_ARRAY) {
+		if (current.kind == EXTRACT_KEY)
+			return;
+
+		for (uint32 i = 0; i < node.length; i++) {
+			if (current.kind == EXTRACT_ALL || i == current.index) {
+				matchPath(tape, child, steps, step + 1, matches);
+
+				if (current.kind == EXTRACT_INDEX)
+					return;
+			}
+
+			child = skipNode(tape, child);
+		}
+	} else if (node.type == JSON_OBJECT) {
+		if (current.kind == EXTRACT_INDEX)
+			return;
+
+		for (uint32 i = 0; i < node.length; i++) {
+			const JSONNode& key = tape.nodes[child];
+			size_t value = child + 1;
+
+			if (current.kind == EXTRACT_ALL) {
+				matchPath(tape, value, steps, step + 1, matches);
+			} else if (key.type == JSON_STRING && key.length == current.key.size()
+			           && memcmp(&tape.strings[key.offset], current.key.data(), key.length) == 0) {
+				// Of duplicate keys, the first one counts
+				matchPath(tape, value, steps, step + 1, matches);
+				return;
+			}
+
+			child = skipNode(tape, value);
+		}
+	}
+}
+
+void extractPaths(JSONTape *tape, const std::vector<ExtractPath>& paths) {
+	JSONTape extracted;
+	std::vector<size_t> matches;
+
+	JSONNode root = JSONNode();
+	root.type = JSON_OBJECT;
+	root.length = paths.size();
+	extracted.nodes.push_back(root);
+
+	for (const ExtractPath& path : paths) {
+		JSONNode key = JSONNode();
+		key.type = JSON_STRING;
+		key.offset = tape->strings.size();
+		key.length = path.text.size();
+		tape->strings.append(path.text);
+		tape->strings += '\0';
+		extracted.nodes.push_back(key);
+
+		matches.clear();
+		if (!tape->nodes.empty())
+			matchPath(*tape, 0, path.steps, 0, &matches);
+
+		if (path.multiple) {
+			JSONNode list = JSONNode();
+			list.type = JSON_ARRAY;
+			list.length = matches.size();
+			extracted.nodes.push_back(list);
+		} else if (matches.empty()) {
+			extracted.nodes.push_back(JSONNode());
+			continue;
+		}
+
+		for (size_t match : matches) {
+			size_t end = skipNode(*tape, match);
+			extracted.nodes.insert(extracted.nodes.end(), tape->nodes.begin() + match, tape->nodes.begin() + end);
+		}
+	}
+
+	// Copied subtrees keep their string offsets, so the strings (with the
+	// path names added at the end) are taken over as they are
+	extracted.strings = std::move(tape->strings);
+	*tape = std::move(extracted);
+}
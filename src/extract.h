@@ -0,0 +1,36 @@
+#ifndef _EXTRACT_H
+#define _EXTRACT_H
+
+#include <string>
+#include <vector>
+#include "json.h"
+
+enum {
+	EXTRACT_KEY,   // .name, a member of an object
+	EXTRACT_INDEX, // [n], an element of an array, counting from 0
+	EXTRACT_ALL,   // [*], every element of an array or member of an object
+};
+
+struct ExtractStep {
+	int kind;
+	std::string key;
+	uint32 index;
+};
+
+// A path like "response.players[*].steamid", as given to `extract`
+struct ExtractPath {
+	std::string text;
+	std::vector<ExtractStep> steps;
+
+	// Whether the path has a [*] and so selects a list of values
+	bool multiple;
+};
+
+bool parseExtractPath(const std::string& text, ExtractPath *path, std::string *error);
+
+// Replaces a decoded document with an object that maps each path to what
+// it selects: the value (left out if there is none), or an array of all
+// matches for paths with [*]. Nothing else of the document is copied.
+void extractPaths(JSONTape *tape, const std::vector<ExtractPath>& paths);
+
+#endif
@@ -0,0 +1,223 @@
+#include <map>
+#include <memory>
+#include <mutex>
+#include "histogram.h"
+#include "util.h"
+
+// Position of the highest set bit, value must not be 0
+static int highestBit(uint64 value) {
+	int bit = 0;
+
+	for (int step = 32; step; step >>= 1) {
+		if (value >> step) {
+			value >>= step;
+			bit += step;
+		}
+	}
+
+	return bit;
+}
+
+LatencyHistogram::LatencyHistogram() {
+	reset();
+}
+
+/*
+ * Values below SUB_BUCKETS get a bucket each. Above that, every power of
+ * two [2^m, 2^(m+1)) is split into SUB_BUCKETS buckets of width
+ * 2^(m - SUB_BUCKET_BITS).
+ */
+int LatencyHistogram::bucketIndex(uint64 value) {
+	if (value >> MAX_VALUE_BITS)
+		value = (1ULL << MAX_VALUE_BITS) - 1;
+
+	if (value < SUB_BUCKETS)
+		return (int)value;
+
+	int shift = highestBit(value) - SUB_BUCKET_BITS;
+	return (shift + 1) * SUB_BUCKETS + (int)(value >> shift) - SUB_BUCKETS;
+}
+
+uint64 LatencyHistogram::bucketLowest(int bucket) {
+	if (bucket < SUB_BUCKETS)
+		return bucket;
+
+	int shift = bucket / SUB_BUCKETS - 1;
+	return (uint64)(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+}
+
+uint64 LatencyHistogram::bucketHighest(int bucket) {
+	if (bucket < SUB_BUCKETS)
+		return bucket;
+
+	int shift = bucket / SUB_BUCKETS - 1;
+	return bucketLowest(bucket) + (1ULL << shift) - 1;
+}
+
+// There is a single writer, so plain relaxed loads and stores do instead
+// of locked read-modify-writes; readers just never see torn values.
+static inline void bump(std::atomic<uint64>& counter, uint64 amount) {
+	counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::record(uint64 value) {
+	bump(counts[bucketIndex(value)], 1);
+	bump(total, 1);
+	bump(sum, value);
+}
+
+void LatencyHistogram::reset() {
+	for (int i = 0; i < BUCKETS; i++)
+		counts[i].store(0, std::memory_order_relaxed);
+
+	total.store(0, std::memory_order_relaxed);
+	sum.store(0, std::memory_order_relaxed);
+}
+
+uint64 LatencyHistogram::count() const {
+	return total.load(std::memory_order_relaxed);
+}
+
+uint64 LatencyHistogram::valueSum() const {
+	return sum.load(std::memory_order_relaxed);
+}
+
+uint64 LatencyHistogram::bucketCount(int bucket) const {
+	return counts[bucket].load(std::memory_order_relaxed);
+}
+
+uint64 LatencyHistogram::percentile(double q) const {
+	uint64 snapshot[BUCKETS];
+	uint64 recorded = 0;
+
+	// Sum the buckets rather than trusting `total`, which may be off
+	// by a few while another thread is recording
+	for (int i = 0; i < BUCKETS; i++) {
+		snapshot[i] = counts[i].load(std::memory_order_relaxed);
+		recorded += snapshot[i];
+	}
+
+	if (!recorded)
+		return 0;
+
+	if (q < 0)
+		q = 0;
+	if (q > 1)
+		q = 1;
+
+	uint64 rank = (uint64)(q * recorded + 0.5);
+	if (rank < 1)
+		rank = 1;
+
+	uint64 seen = 0;
+	for (int i = 0; i < BUCKETS; i++) {
+		seen += snapshot[i];
+
+		// Report the middle of the bucket
+		if (seen >= rank)
+			return (bucketLowest(i) + bucketHighest(i)) / 2;
+	}
+
+	return bucketHighest(BUCKETS - 1);
+}
+
+static const char *STATUS_CLASS_NAMES[STATUS_CLASSES] = {
+	"failed",
+	"1xx",
+	"2xx",
+	"3xx",
+	"4xx",
+	"5xx",
+};
+
+const char *statusClassName(int statusclass) {
+	return STATUS_CLASS_NAMES[statusclass];
+}
+
+int statusClassFromName(const std::string& name) {
+	for (int i = 0; i < STATUS_CLASSES; i++) {
+		if (name == STATUS_CLASS_NAMES[i])
+			return i;
+	}
+
+	return -1;
+}
+
+void HostLatency::reset() {
+	all.reset();
+
+	for (int i = 0; i < STATUS_CLASSES; i++)
+		classes[i].reset();
+}
+
+// Entries are never removed, so pointers handed out stay valid
+static std::mutex hostsmutex;
+static std::map<std::string, std::unique_ptr<HostLatency>> hosts;
+static HostLatency allhosts;
+
+static std::atomic<uint64> window(0);
+static std::atomic<uint64> windowstart(0);
+
+HostLatency *hostLatency(const std::string& host) {
+	std::lock_guard<std::mutex> lock(hostsmutex);
+	std::unique_ptr<HostLatency>& entry = hosts[host];
+
+	if (!entry)
+		entry.reset(new HostLatency());
+
+	return entry.get();
+}
+
+HostLatency *findHostLatency(const std::string& host) {
+	if (host == "*")
+		return &allhosts;
+
+	std::lock_guard<std::mutex> lock(hostsmutex);
+	auto it = hosts.find(host);
+	return it == hosts.end() ? nullptr : it->second.get();
+}
+
+void forEachHostLatency(std::function<void(const std::string&, HostLatency *)> fn) {
+	std::lock_guard<std::mutex> lock(hostsmutex);
+
+	for (auto& entry : hosts)
+		fn(entry.first, entry.second.get());
+}
+
+void resetLatencies(const std::string& host) {
+	if (!host.empty()) {
+		HostLatency *latency = findHostLatency(host);
+		if (latency)
+			latency->reset();
+		return;
+	}
+
+	forEachHostLatency([](const std::string&, HostLatency *latency) {
+		latency->reset();
+	});
+	allhosts.reset();
+}
+
+void setLatencyWindow(double seconds) {
+	window = (uint64)(clampNumber(seconds, 0, 365 * 86400) * 1000000);
+	windowstart = nowMicros();
+}
+
+void recordLatency(HostLatency *host, uint64 micros, long code) {
+	uint64 length = window.load(std::memory_order_relaxed);
+
+	if (length) {
+		uint64 now = nowMicros();
+		if (now - windowstart.load(std::memory_order_relaxed) >= length) {
+			windowstart = now;
+			resetLatencies();
+		}
+	}
+
+	int statusclass = code >= 100 && code < 600 ? code / 100 : (int)STATUS_FAILED;
+
+	host->all.record(micros);
+	host->classes[statusclass].record(micros);
+	allhosts.all.record(micros);
+	allhosts.classes[statusclass].record(micros);
+}
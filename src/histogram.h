@@ -0,0 +1,92 @@
+#ifndef _HISTOGRAM_H
+#define _HISTOGRAM_H
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include "steamtypes.h"
+
+// Log-linear latency histogram in the spirit of HdrHistogram. Values are
+// microseconds, bucketed per power of two with SUB_BUCKETS linear buckets
+// each, so a bucket is never wider than ~3% of the values it holds.
+// Recording only touches three counters and must happen on one thread
+// (the game thread); readers on other threads need no locking.
+class LatencyHistogram {
+public:
+	static const int SUB_BUCKET_BITS = 5;
+	static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+	// Values up to 2^32 us (~71 minutes), larger ones are clamped
+	static const int MAX_VALUE_BITS = 32;
+	static const int BUCKETS = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+private:
+	std::atomic<uint64> counts[BUCKETS];
+	std::atomic<uint64> total;
+	std::atomic<uint64> sum;
+
+public:
+	LatencyHistogram();
+
+	void record(uint64 value);
+	void reset();
+
+	uint64 count() const;
+	uint64 valueSum() const;
+
+	// Value at quantile q (0..1), or 0 if nothing was recorded
+	uint64 percentile(double q) const;
+
+	// Raw bucket access, for exporting
+	static int bucketIndex(uint64 value);
+	static uint64 bucketLowest(int bucket);
+	static uint64 bucketHighest(int bucket);
+	uint64 bucketCount(int bucket) const;
+};
+
+// Status classes that latencies are split by
+enum {
+	STATUS_FAILED, // API or HTTP errors without a usable status code
+	STATUS_1XX,
+	STATUS_2XX,
+	STATUS_3XX,
+	STATUS_4XX,
+	STATUS_5XX,
+	STATUS_CLASSES,
+};
+
+const char *statusClassName(int statusclass);
+
+// Returns the class for a name like "2xx" or "failed", or -1
+int statusClassFromName(const std::string& name);
+
+struct HostLatency {
+	LatencyHistogram all;
+	LatencyHistogram classes[STATUS_CLASSES];
+
+	void reset();
+};
+
+// Returns the histograms for a host, creating them on first use. The
+// pointer stays valid for the lifetime of the module, so it can be looked
+// up once when a request is sent and used from the completion path.
+HostLatency *hostLatency(const std::string& host);
+
+// Returns the histograms for a host, or "*" for all hosts combined.
+// nullptr if no request to that host was ever sent.
+HostLatency *findHostLatency(const std::string& host);
+
+// Records a finished request; `code` is the HTTP status or 0 on failure.
+void recordLatency(HostLatency *host, uint64 micros, long code);
+
+// Calls `fn` for every known host, not including "*"
+void forEachHostLatency(std::function<void(const std::string&, HostLatency *)> fn);
+
+// Resets one host, or all of them when `host` is empty
+void resetLatencies(const std::string& host = "");
+
+// Resets all histograms every `seconds` (0 to never), so percentiles
+// reflect the current window instead of the whole uptime.
+void setLatencyWindow(double seconds);
+
+#endif
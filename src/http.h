@@ -3,9 +3,31 @@
 
 #include <string>
 #include <map>
+#include <memory>
 #include "isteamhttp.h"
+#include "timing.h"
+#include "json.h"
+#include "extract.h"
 #include <GarrysMod/Lua/LuaBase.h>
 
+// How response bodies are handed to the success handler. Responses that
+// aren't 2xx, or have an empty body, always come as a string.
+enum BodyDecoding {
+	DECODE_NONE,    // as a string
+	DECODE_JSON,    // as the Lua value of the JSON document
+	DECODE_MSGPACK, // as the Lua value of the MessagePack document
+};
+
+// How request bodies are compressed before sending
+enum BodyCompression {
+	COMPRESS_NONE,
+	COMPRESS_GZIP,    // Content-Encoding: gzip
+	COMPRESS_DEFLATE, // Content-Encoding: deflate, which is a zlib stream
+};
+
+struct HTTPClient;
+struct RequestBatch;
+
 // Modeled after GMod's HTTPRequest structure
 // https://wiki.garrysmod.com/page/Structures/HTTPRequest
 struct HTTPRequest {
@@ -14,6 +36,8 @@ struct HTTPRequest {
 	int failed;
 
 	// Handler for successful requests. args: (number) code, (string) body, (table) headers
+	// or, with `lazy`, a single response object
+	// Both handlers get the timing breakdown as an additional argument if requested.
 	// This is a reference to the function on the stack
 	int success;
 
@@ -35,8 +59,52 @@ struct HTTPRequest {
 	// Content-Type string for the request body.
 	std::string type;
 
+	// Content-Type that `json` or `msgpack` imply, used if `type` is not set
+	const char *bodytype;
+
 	// Append value for the User-Agent
 	std::string useragent;
+
+	// Addon (or file) that issued the request, see callerAddon
+	std::string addon;
+
+	// Whether the handlers get the lifecycle timing breakdown as an extra argument
+	bool wanttiming;
+
+	// Whether the success handler gets a response object instead of the
+	// body as a Lua string, see pushResponseObject
+	bool lazy;
+
+	// BodyDecoding, decoding happens on the completion workers
+	int decode;
+
+	// Paths to pick out of the decoded body, see extractPaths
+	std::vector<ExtractPath> extract;
+
+	// BodyCompression and its level (0-9), compression happens on the
+	// submission thread
+	int compress;
+	int compresslevel;
+
+	// Milliseconds until the request fails, 0 for the backend's default
+	uint32 timeout;
+
+	// Cookie container of the client the request came from, if any
+	HTTPCookieContainerHandle cookies;
+
+	// The client (STEAMHTTP.Client) that sent the request, which counts
+	// it against its limits until it finishes
+	std::shared_ptr<HTTPClient> client;
+
+	// Number of the request among the client's, returned by client:Request
+	uint64 clientid;
+
+	// The STEAMHTTP.Batch call that sent the request, and its position there
+	std::shared_ptr<RequestBatch> batch;
+	size_t batchindex;
+
+	// Lifecycle timestamps, filled in as the request progresses
+	RequestTiming timing;
 };
 
 // Not really modeled after anything specific
@@ -45,6 +113,11 @@ struct HTTPResponse {
 	long code;
 	std::string body;
 	std::map<std::string, std::string> headers;
+
+	// The parsed body for DECODE_JSON and DECODE_MSGPACK, pushed instead
+	// of the body string
+	bool decoded;
+	JSONTape json;
 };
 
 #endif
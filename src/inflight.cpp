@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include "inflight.h"
+
+// A tracked request, plus how many inFlightRequests calls are reading its
+// handle right now. Untracking waits for them, so the handle outlives them.
+struct TrackedRequest {
+	InFlightRequest request;
+	int readers;
+};
+
+static std::mutex inflightmutex;
+static std::condition_variable unread;
+static std::map<SteamAPICall_t, TrackedRequest> inflight;
+
+void trackRequest(const InFlightRequest& request) {
+	std::lock_guard<std::mutex> lock(inflightmutex);
+	inflight[request.apicall] = {request, 0};
+}
+
+void untrackRequest(SteamAPICall_t apicall) {
+	std::unique_lock<std::mutex> lock(inflightmutex);
+	auto it = inflight.find(apicall);
+
+	if (it == inflight.end())
+		return;
+
+	unread.wait(lock, [&it]() { return it->second.readers == 0; });
+	inflight.erase(it);
+}
+
+std::vector<InFlightRequest> inFlightRequests(HTTPBackend *backend) {
+	std::vector<InFlightRequest> requests;
+
+	{
+		std::lock_guard<std::mutex> lock(inflightmutex);
+		requests.reserve(inflight.size());
+
+		for (auto& e : inflight) {
+			requests.push_back(e.second.request);
+			e.second.readers++;
+		}
+	}
+
+	// The progress may be an IPC call per request, so it is read without
+	// the lock. A worker finishing one of these waits in untrackRequest
+	// until its handle was read, the others carry on.
+	for (InFlightRequest& request : requests) {
+		request.progress = -1;
+		request.received = 0;
+		request.progressknown = backend->getDownloadProgress(request.handle, &request.progress, &request.received);
+
+		std::lock_guard<std::mutex> lock(inflightmutex);
+		if (--inflight[request.apicall].readers == 0)
+			unread.notify_all();
+	}
+
+	std::sort(requests.begin(), requests.end(), [](const InFlightRequest& a, const InFlightRequest& b) {
+		return a.sent < b.sent;
+	});
+
+	return requests;
+}
@@ -0,0 +1,36 @@
+#ifndef _INFLIGHT_H
+#define _INFLIGHT_H
+
+#include <string>
+#include <vector>
+#include "backend.h"
+#include "isteamhttp.h"
+
+// What the status display knows about a request that was sent but not
+// picked up by callbackHook yet.
+struct InFlightRequest {
+	SteamAPICall_t apicall;
+	HTTPRequestHandle handle;
+	uint64 sent;
+	std::string method;
+	std::string url;
+	std::string host;
+	std::string addon;
+
+	// From getDownloadProgress, `progressknown` if it answered
+	bool progressknown;
+	float progress;
+	uint64 received;
+};
+
+// The table is separate from the request queue, so listing it never
+// holds up callbackHook.
+void trackRequest(const InFlightRequest& request);
+void untrackRequest(SteamAPICall_t apicall);
+
+// Copy of all tracked requests, oldest first, with their download
+// progress from `backend`. Completion workers untrack a request before
+// they release its handle, and untracking waits until the handle was read.
+std::vector<InFlightRequest> inFlightRequests(HTTPBackend *backend);
+
+#endif
@@ -0,0 +1,425 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "json.h"
+
+// Deeper documents are rejected, so neither the parser nor the Lua side
+// can run out of stack on hostile input
+static const int MAX_DEPTH = 256;
+
+static const double POWERS_OF_TEN[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static const uint64 ONES = 0x0101010101010101ULL;
+static const uint64 HIGHS = 0x8080808080808080ULL;
+
+// Whether any byte of `v` is zero
+static inline uint64 hasZero(uint64 v) {
+	return (v - ONES) & ~v & HIGHS;
+}
+
+// Skips to the next byte in a string that needs a closer look: a quote,
+// a backslash or a control character. Long runs of plain text are
+// checked eight bytes at a time.
+static const char *scanString(const char *p, const char *end) {
+	while (end - p >= 8) {
+		uint64 v;
+		memcpy(&v, p, 8);
+
+		if (hasZero(v ^ (ONES * '"')) | hasZero(v ^ (ONES * '\\')) | hasZero(v & (ONES * 0xE0)))
+			break;
+
+		p += 8;
+	}
+
+	while (p < end && *p != '"' && *p != '\\' && (unsigned char)*p >= 0x20)
+		p++;
+
+	return p;
+}
+
+static void appendUTF8(std::string *out, uint32 codepoint) {
+	if (codepoint < 0x80) {
+		*out += (char)codepoint;
+	} else if (codepoint < 0x800) {
+		*out += (char)(0xC0 | (codepoint >> 6));
+		*out += (char)(0x80 | (codepoint & 0x3F));
+	} else if (codepoint < 0x10000) {
+		*out += (char)(0xE0 | (codepoint >> 12));
+		*out += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+		*out += (char)(0x80 | (codepoint & 0x3F));
+	} else {
+		*out += (char)(0xF0 | (codepoint >> 18));
+		*out += (char)(0x80 | ((codepoint >> 12) & 0x3F));
+		*out += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+		*out += (char)(0x80 | (codepoint & 0x3F));
+	}
+}
+
+void appendJSONString(std::string *out, const char *str, size_t length) {
+	static const char HEX[] = "0123456789abcdef";
+	const char *p = str, *end = str + length;
+
+	*out += '"';
+
+	while (p < end) {
+		const char *run = p;
+		p = scanString(p, end);
+		out->append(run, p - run);
+
+		if (p >= end)
+			break;
+
+		unsigned char c = *p++;
+
+		switch (c) {
+		case '"': *out += "\\\""; break;
+		case '\\': *out += "\\\\"; break;
+		case '\b': *out += "\\b"; break;
+		case '\f': *out += "\\f"; break;
+		case '\n': *out += "\\n"; break;
+		case '\r': *out += "\\r"; break;
+		case '\t': *out += "\\t"; break;
+		default:
+			*out += "\\u00";
+			*out += HEX[c >> 4];
+			*out += HEX[c & 0xF];
+		}
+	}
+
+	*out += '"';
+}
+
+void appendJSONNumber(std::string *out, double number) {
+	char buffer[32];
+	int length;
+
+	// Integers (most of what we send) without the exponent notation
+	if (number >= -9007199254740992.0 && number <= 9007199254740992.0 && number == (double)(long long)number)
+		length = snprintf(buffer, sizeof(buffer), "%lld", (long long)number);
+	else
+		length = snprintf(buffer, sizeof(buffer), "%.15g", number);
+
+	// 15 digits read nicer (0.1 instead of 0.10000000000000001), but only
+	// 17 are always enough to read the same number back
+	if (strtod(buffer, nullptr) != number)
+		length = snprintf(buffer, sizeof(buffer), "%.17g", number);
+
+	out->append(buffer, length);
+}
+
+class JSONParser {
+	const char *begin;
+	const char *p;
+	const char *end;
+	JSONTape *tape;
+
+	bool fail(const char *what) {
+		error = std::string(what) + " at offset " + std::to_string(p - begin);
+		return false;
+	}
+
+	void skipWhitespace() {
+		while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+			p++;
+	}
+
+	bool parseHex(uint32 *value) {
+		*value = 0;
+
+		if (end - p < 4)
+			return fail("Truncated unicode escape");
+
+		for (int i = 0; i < 4; i++, p++) {
+			char c = *p;
+			*value <<= 4;
+
+			if (c >= '0' && c <= '9')
+				*value |= c - '0';
+			else if (c >= 'a' && c <= 'f')
+				*value |= c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F')
+				*value |= c - 'A' + 10;
+			else
+				return fail("Invalid unicode escape");
+		}
+
+		return true;
+	}
+
+	// Parses the string at p (past the opening quote) into `strings`
+	bool parseString(JSONNode *node) {
+		std::string& out = tape->strings;
+
+		node->type = JSON_STRING;
+		node->offset = out.size();
+
+		while (true) {
+			const char *run = p;
+			p = scanString(p, end);
+			out.append(run, p - run);
+
+			if (p >= end)
+				return fail("Unterminated string");
+
+			if (*p == '"') {
+				p++;
+				break;
+			}
+
+			if (*p != '\\')
+				return fail("Control character in string");
+
+			if (++p >= end)
+				return fail("Unterminated string");
+
+			switch (*p++) {
+			case '"': out += '"'; break;
+			case '\\': out += '\\'; break;
+			case '/': out += '/'; break;
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u': {
+				uint32 codepoint;
+
+				if (!parseHex(&codepoint))
+					return false;
+
+				// Characters outside the BMP come as surrogate pairs
+				if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+					uint32 low;
+
+					if (end - p < 2 || p[0] != '\\' || p[1] != 'u')
+						return fail("Unpaired surrogate");
+
+					p += 2;
+					if (!parseHex(&low))
+						return false;
+
+					if (low < 0xDC00 || low > 0xDFFF)
+						return fail("Unpaired surrogate");
+
+					codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+				} else if (codepoint >= 0xDC00 && codepoint <= 0xDFFF) {
+					return fail("Unpaired surrogate");
+				}
+
+				appendUTF8(&out, codepoint);
+				break;
+			}
+			default:
+				p--;
+				return fail("Invalid escape");
+			}
+		}
+
+		node->length = out.size() - node->offset;
+		out += '\0';
+		return true;
+	}
+
+	bool parseNumber(JSONNode *node) {
+		const char *start = p;
+		bool negative = false;
+		int digits = 0, exponent = 0;
+		uint64 mantissa = 0;
+
+		node->type = JSON_NUMBER;
+
+		if (p < end && *p == '-') {
+			negative = true;
+			p++;
+		}
+
+		if (p < end && *p == '0') {
+			p++;
+		} else if (p < end && *p >= '1' && *p <= '9') {
+			for (; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+				mantissa = mantissa * 10 + (*p - '0');
+		} else {
+			return fail("Invalid number");
+		}
+
+		if (p < end && *p == '.') {
+			p++;
+
+			if (p >= end || *p < '0' || *p > '9')
+				return fail("Invalid number");
+
+			for (; p < end && *p >= '0' && *p <= '9'; p++, digits++, exponent--)
+				mantissa = mantissa * 10 + (*p - '0');
+		}
+
+		if (p < end && (*p == 'e' || *p == 'E')) {
+			bool negexp = false;
+			int value = 0;
+			p++;
+
+			if (p < end && (*p == '+' || *p == '-'))
+				negexp = *p++ == '-';
+
+			if (p >= end || *p < '0' || *p > '9')
+				return fail("Invalid number");
+
+			for (; p < end && *p >= '0' && *p <= '9'; p++) {
+				if (value < 100000)
+					value = value * 10 + (*p - '0');
+			}
+
+			exponent += negexp ? -value : value;
+		}
+
+		// Up to 15 digits and a small exponent are exact as doubles, so one
+		// multiplication or division rounds correctly. Everything else goes
+		// through strtod.
+		if (digits <= 15 && exponent >= -22 && exponent <= 22) {
+			double value = (double)mantissa;
+
+			if (exponent < 0)
+				value /= POWERS_OF_TEN[-exponent];
+			else
+				value *= POWERS_OF_TEN[exponent];
+
+			node->number = negative ? -value : value;
+			return true;
+		}
+
+		std::string text(start, p - start);
+		node->number = strtod(text.c_str(), nullptr);
+		return true;
+	}
+
+	bool parseLiteral(const char *word, size_t length, JSONType type, JSONNode *node) {
+		if ((size_t)(end - p) < length || memcmp(p, word, length) != 0)
+			return fail("Unexpected character");
+
+		p += length;
+		node->type = type;
+		return true;
+	}
+
+	bool parseValue(int depth) {
+		size_t index = tape->nodes.size();
+		tape->nodes.push_back(JSONNode());
+
+		skipWhitespace();
+
+		if (p >= end)
+			return fail("Unexpected end of input");
+
+		switch (*p) {
+		case '{':
+			return parseContainer(index, JSON_OBJECT, '}', depth);
+		case '[':
+			return parseContainer(index, JSON_ARRAY, ']', depth);
+		case '"':
+			p++;
+			return parseString(&tape->nodes[index]);
+		case 't':
+			return parseLiteral("true", 4, JSON_TRUE, &tape->nodes[index]);
+		case 'f':
+			return parseLiteral("false", 5, JSON_FALSE, &tape->nodes[index]);
+		case 'n':
+			return parseLiteral("null", 4, JSON_NULL, &tape->nodes[index]);
+		default:
+			return parseNumber(&tape->nodes[index]);
+		}
+	}
+
+	// Parses the array or object at p. `index` is its node, which gets
+	// the number of elements once they are all on the tape.
+	bool parseContainer(size_t index, JSONType type, char close, int depth) {
+		uint32 length = 0;
+
+		if (depth >= MAX_DEPTH)
+			return fail("Nesting too deep");
+
+		p++;
+		skipWhitespace();
+
+		if (p < end && *p == close) {
+			p++;
+		} else {
+			while (true) {
+				if (type == JSON_OBJECT) {
+					skipWhitespace();
+
+					if (p >= end || *p != '"')
+						return fail("Expected member name");
+
+					p++;
+					tape->nodes.push_back(JSONNode());
+					if (!parseString(&tape->nodes.back()))
+						return false;
+
+					skipWhitespace();
+
+					if (p >= end || *p != ':')
+						return fail("Expected ':'");
+
+					p++;
+				}
+
+				if (!parseValue(depth + 1))
+					return false;
+
+				length++;
+				skipWhitespace();
+
+				if (p < end && *p == ',') {
+					p++;
+				} else if (p < end && *p == close) {
+					p++;
+					break;
+				} else {
+					return fail(type == JSON_OBJECT ? "Expected ',' or '}'" : "Expected ',' or ']'");
+				}
+			}
+		}
+
+		tape->nodes[index].type = type;
+		tape->nodes[index].length = length;
+		return true;
+	}
+
+public:
+	std::string error;
+
+	JSONParser(const char *json, size_t length, JSONTape *tape) : begin(json), p(json), end(json + length), tape(tape) {
+	}
+
+	bool parse() {
+		if (!parseValue(0))
+			return false;
+
+		skipWhitespace();
+
+		if (p != end)
+			return fail("Unexpected data after the document");
+
+		return true;
+	}
+};
+
+bool parseJSON(const char *json, size_t length, JSONTape *tape, std::string *error) {
+	JSONParser parser(json, length, tape);
+
+	tape->nodes.clear();
+	tape->strings.clear();
+
+	// Rough guesses that save most of the regrowing on big documents
+	tape->nodes.reserve(length / 16);
+	tape->strings.reserve(length / 2);
+
+	if (!parser.parse()) {
+		error->assign(parser.error);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,51 @@
+#ifndef _JSON_H
+#define _JSON_H
+
+#include <string>
+#include <vector>
+#include "steamtypes.h"
+
+enum JSONType {
+	JSON_NULL,
+	JSON_FALSE,
+	JSON_TRUE,
+	JSON_NUMBER,
+	JSON_STRING,
+	JSON_ARRAY,
+	JSON_OBJECT,
+};
+
+struct JSONNode {
+	uint32 type;
+
+	// String length, or the number of elements (arrays) or members
+	// (objects) that follow
+	uint32 length;
+
+	union {
+		double number;
+
+		// Where the (unescaped, NUL-terminated) string starts in `strings`
+		uint32 offset;
+	};
+};
+
+// A parsed JSON document, flattened into its nodes in document order.
+// Arrays are followed by their elements, objects by a key (string) node
+// and a value for each member, so the document can be walked front to
+// back without any pointers.
+struct JSONTape {
+	std::vector<JSONNode> nodes;
+	std::string strings;
+};
+
+// Append a string (quoted and escaped) or a number to a JSON document.
+// Numbers must be finite, JSON has no way to write the others.
+void appendJSONString(std::string *out, const char *str, size_t length);
+void appendJSONNumber(std::string *out, double number);
+
+// Parses `length` bytes of JSON (RFC 8259) into `tape`. On failure,
+// `error` says what went wrong and where.
+bool parseJSON(const char *json, size_t length, JSONTape *tape, std::string *error);
+
+#endif
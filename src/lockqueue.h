@@ -1,3 +1,6 @@
+#ifndef _LOCKQUEUE_H
+#define _LOCKQUEUE_H
+
 #include <deque>
 #include <mutex>
 
@@ -16,7 +19,7 @@ public:
 template <class T>
 void LockableQueue<T>::push(T element) {
 	std::lock_guard<std::mutex> lock(mutex);
-	queue.push_back(element);
+	queue.push_back(std::move(element));
 }
 
 template <class T>
@@ -24,7 +27,7 @@ T LockableQueue<T>::pop() {
 	T element;
 	std::lock_guard<std::mutex> lock(mutex);
 
-	element = queue.front();
+	element = std::move(queue.front());
 	queue.pop_front();
 
 	return element;
@@ -40,3 +43,5 @@ template <class T>
 bool LockableQueue<T>::empty() {
 	return this->size() == 0;
 }
+
+#endif
@@ -1,3 +1,4 @@
+#include <cstring>
 #include "lua.h"
 
 // Builds a LUA table from a map and leaves it on the stack
@@ -40,6 +41,294 @@ std::map<std::string, std::string> mapFromLuaTable(Lua::ILuaBase *LUA, int index
 	return map;
 }
 
+// Pushes the node at `index` and moves `index` past it and its children
+static void pushJSONNode(Lua::ILuaBase *LUA, const JSONTape& tape, size_t& index) {
+	const JSONNode& node = tape.nodes[index++];
+
+	switch (node.type) {
+	case JSON_NULL:
+		LUA->PushNil();
+		break;
+	case JSON_FALSE:
+		LUA->PushBool(false);
+		break;
+	case JSON_TRUE:
+		LUA->PushBool(true);
+		break;
+	case JSON_NUMBER:
+		LUA->PushNumber(node.number);
+		break;
+	case JSON_STRING:
+		LUA->PushString(&tape.strings[node.offset], node.length);
+		break;
+	case JSON_ARRAY:
+		LUA->CreateTable();
+
+		for (uint32 i = 1; i <= node.length; i++) {
+			if (tape.nodes[index].type == JSON_NULL) {
+				index++;
+				continue;
+			}
+
+			LUA->PushNumber(i);
+			pushJSONNode(LUA, tape, index);
+			LUA->SetTable(-3);
+		}
+		break;
+	case JSON_OBJECT:
+		LUA->CreateTable();
+
+		for (uint32 i = 0; i < node.length; i++) {
+			const JSONNode& key = tape.nodes[index];
+
+			if (tape.nodes[index + 1].type == JSON_NULL) {
+				index += 2;
+				continue;
+			}
+
+			// Keys are strings, but MessagePack ones can be other scalars
+			if (key.type == JSON_STRING) {
+				LUA->PushString(&tape.strings[key.offset], key.length);
+				index++;
+			} else {
+				pushJSONNode(LUA, tape, index);
+			}
+
+			pushJSONNode(LUA, tape, index);
+			LUA->SetTable(-3);
+		}
+		break;
+	}
+}
+
+void pushJSON(Lua::ILuaBase *LUA, const JSONTape& tape) {
+	size_t index = 0;
+
+	if (tape.nodes.empty())
+		LUA->PushNil();
+	else
+		pushJSONNode(LUA, tape, index);
+}
+
+// Deeper tables are most likely cycles
+static const int MAX_ENCODE_DEPTH = 256;
+
+// Number of entries of the table at `index` if it is a sequence 1..n,
+// -1 if it has other keys
+static int sequenceLength(Lua::ILuaBase *LUA, int index) {
+	int count = 0;
+	double highest = 0;
+
+	LUA->PushNil();
+	while (LUA->Next(index) != 0) {
+		LUA->Pop();
+
+		if (!LUA->IsType(-1, Lua::Type::NUMBER)) {
+			LUA->Pop();
+			return -1;
+		}
+
+		double key = LUA->GetNumber(-1);
+		if (key < 1 || key > 0x7fffffff || key != (double)(int)key) {
+			LUA->Pop();
+			return -1;
+		}
+
+		if (key > highest)
+			highest = key;
+		count++;
+	}
+
+	return highest == count ? count : -1;
+}
+
+static bool encodeJSONValue(Lua::ILuaBase *LUA, int index, std::string *out, std::string *error, int depth) {
+	switch (LUA->GetType(index)) {
+	case Lua::Type::NIL:
+		*out += "null";
+		return true;
+	case Lua::Type::BOOL:
+		*out += LUA->GetBool(index) ? "true" : "false";
+		return true;
+	case Lua::Type::NUMBER: {
+		double number = LUA->GetNumber(index);
+
+		if (number != number || number - number != 0) {
+			error->assign("cannot encode " + std::to_string(number));
+			return false;
+		}
+
+		appendJSONNumber(out, number);
+		return true;
+	}
+	case Lua::Type::STRING: {
+		unsigned int length;
+		const char *str = LUA->GetString(index, &length);
+		appendJSONString(out, str, length);
+		return true;
+	}
+	case Lua::Type::TABLE:
+		break;
+	default:
+		error->assign("cannot encode a " + std::string(LUA->GetTypeName(LUA->GetType(index))));
+		return false;
+	}
+
+	if (depth >= MAX_ENCODE_DEPTH) {
+		error->assign("table nested too deep (or a cycle)");
+		return false;
+	}
+
+	int length = sequenceLength(LUA, index);
+
+	if (length >= 0) {
+		*out += '[';
+
+		for (int i = 1; i <= length; i++) {
+			if (i > 1)
+				*out += ',';
+
+			LUA->PushNumber(i);
+			LUA->GetTable(index);
+			bool encoded = encodeJSONValue(LUA, LUA->Top(), out, error, depth + 1);
+			LUA->Pop();
+
+			if (!encoded)
+				return false;
+		}
+
+		*out += ']';
+		return true;
+	}
+
+	bool first = true;
+	*out += '{';
+
+	LUA->PushNil();
+	while (LUA->Next(index) != 0) {
+		int key = LUA->Top() - 1;
+
+		if (!first)
+			*out += ',';
+		first = false;
+
+		// Don't GetString number keys, that would turn them into strings
+		// in place and confuse Next
+		if (LUA->IsType(key, Lua::Type::STRING)) {
+			unsigned int keylength;
+			const char *str = LUA->GetString(key, &keylength);
+			appendJSONString(out, str, keylength);
+		} else if (LUA->IsType(key, Lua::Type::NUMBER)) {
+			std::string number;
+			appendJSONNumber(&number, LUA->GetNumber(key));
+			appendJSONString(out, number.c_str(), number.size());
+		} else {
+			error->assign("cannot encode a " + std::string(LUA->GetTypeName(LUA->GetType(key))) + " key");
+			LUA->Pop(2);
+			return false;
+		}
+
+		*out += ':';
+
+		if (!encodeJSONValue(LUA, LUA->Top(), out, error, depth + 1)) {
+			LUA->Pop(2);
+			return false;
+		}
+
+		LUA->Pop();
+	}
+
+	*out += '}';
+	return true;
+}
+
+bool encodeJSON(Lua::ILuaBase *LUA, int index, std::string *out, std::string *error) {
+	// Nested values are pushed on top, so work with an absolute index
+	if (index < 0)
+		index = LUA->Top() + index + 1;
+
+	return encodeJSONValue(LUA, index, out, error, 0);
+}
+
+static bool encodeMsgPackValue(Lua::ILuaBase *LUA, int index, std::string *out, std::string *error, int depth) {
+	switch (LUA->GetType(index)) {
+	case Lua::Type::NIL:
+		appendMsgPackNil(out);
+		return true;
+	case Lua::Type::BOOL:
+		appendMsgPackBool(out, LUA->GetBool(index));
+		return true;
+	case Lua::Type::NUMBER:
+		appendMsgPackNumber(out, LUA->GetNumber(index));
+		return true;
+	case Lua::Type::STRING: {
+		unsigned int length;
+		const char *str = LUA->GetString(index, &length);
+		appendMsgPackString(out, str, length);
+		return true;
+	}
+	case Lua::Type::TABLE:
+		break;
+	default:
+		error->assign("cannot encode a " + std::string(LUA->GetTypeName(LUA->GetType(index))));
+		return false;
+	}
+
+	if (depth >= MAX_ENCODE_DEPTH) {
+		error->assign("table nested too deep (or a cycle)");
+		return false;
+	}
+
+	int length = sequenceLength(LUA, index);
+
+	if (length >= 0) {
+		appendMsgPackArray(out, length);
+
+		for (int i = 1; i <= length; i++) {
+			LUA->PushNumber(i);
+			LUA->GetTable(index);
+			bool encoded = encodeMsgPackValue(LUA, LUA->Top(), out, error, depth + 1);
+			LUA->Pop();
+
+			if (!encoded)
+				return false;
+		}
+
+		return true;
+	}
+
+	uint32 entries = 0;
+
+	LUA->PushNil();
+	while (LUA->Next(index) != 0) {
+		LUA->Pop();
+		entries++;
+	}
+
+	appendMsgPackMap(out, entries);
+
+	LUA->PushNil();
+	while (LUA->Next(index) != 0) {
+		// Keys are encoded without any conversion, so Next stays happy
+		if (!encodeMsgPackValue(LUA, LUA->Top() - 1, out, error, depth + 1)
+		    || !encodeMsgPackValue(LUA, LUA->Top(), out, error, depth + 1)) {
+			LUA->Pop(2);
+			return false;
+		}
+
+		LUA->Pop();
+	}
+
+	return true;
+}
+
+bool encodeMsgPack(Lua::ILuaBase *LUA, int index, std::string *out, std::string *error) {
+	if (index < 0)
+		index = LUA->Top() + index + 1;
+
+	return encodeMsgPackValue(LUA, index, out, error, 0);
+}
+
 void printMessage(Lua::ILuaBase *LUA, std::string message) {
 	// Push global table to the stack to work on it
 	LUA->PushSpecial(Lua::SPECIAL_GLOB);
@@ -58,3 +347,119 @@ void printMessage(Lua::ILuaBase *LUA, std::string message) {
 	// Pops the last value from the stack (the global table?)
 	LUA->Pop();
 }
+
+// Replaces the value at the top of the stack with debug.getinfo(value, "S"),
+// or nil if that is not available
+static void debugInfo(Lua::ILuaBase *LUA) {
+	LUA->PushSpecial(Lua::SPECIAL_GLOB);
+	LUA->GetField(-1, "debug");
+
+	if (LUA->IsType(-1, Lua::Type::TABLE))
+		LUA->GetField(-1, "getinfo");
+	else
+		LUA->PushNil();
+
+	if (LUA->IsType(-1, Lua::Type::FUNCTION)) {
+		LUA->Push(-4);
+		LUA->PushString("S");
+		LUA->Call(2, 1);
+	}
+
+	// Drop debug, the global table and the argument below the result
+	LUA->Remove(-2);
+	LUA->Remove(-2);
+	LUA->Remove(-2);
+}
+
+// Pushes the registry table that functionSource keeps its results in. It
+// has weak keys, so it doesn't keep handlers alive.
+static void pushSourceCache(Lua::ILuaBase *LUA) {
+	LUA->PushSpecial(Lua::SPECIAL_REG);
+	LUA->GetField(-1, "STEAMHTTPHandlerSources");
+
+	if (!LUA->IsType(-1, Lua::Type::TABLE)) {
+		LUA->Pop();
+		LUA->CreateTable();
+		LUA->CreateTable();
+		LUA->PushString("k");
+		LUA->SetField(-2, "__mode");
+		LUA->SetMetaTable(-2);
+		LUA->Push(-1);
+		LUA->SetField(-3, "STEAMHTTPHandlerSources");
+	}
+
+	LUA->Remove(-2);
+}
+
+std::string functionSource(Lua::ILuaBase *LUA) {
+	std::string source = "?";
+
+	// debug.getinfo is too slow to run for every handler call, so each
+	// function is only looked up once
+	pushSourceCache(LUA);
+	LUA->Push(-2);
+	LUA->GetTable(-2);
+
+	if (LUA->IsType(-1, Lua::Type::STRING)) {
+		source = LUA->GetString(-1);
+		LUA->Pop(3);
+		return source;
+	}
+
+	LUA->Pop();
+	LUA->Push(-2);
+	debugInfo(LUA);
+
+	if (LUA->IsType(-1, Lua::Type::TABLE)) {
+		LUA->GetField(-1, "short_src");
+		LUA->GetField(-2, "linedefined");
+
+		if (LUA->IsType(-2, Lua::Type::STRING))
+			source = LUA->GetString(-2);
+		if (LUA->IsType(-1, Lua::Type::NUMBER) && LUA->GetNumber(-1) > 0)
+			source += ":" + std::to_string((int)LUA->GetNumber(-1));
+
+		LUA->Pop(2);
+	}
+
+	LUA->Pop();
+
+	// Stack is now function, cache
+	LUA->Push(-2);
+	LUA->PushString(source.c_str());
+	LUA->SetTable(-3);
+	LUA->Pop(2);
+
+	return source;
+}
+
+std::string callerAddon(Lua::ILuaBase *LUA, int level) {
+	std::string source;
+
+	LUA->PushNumber(level);
+	debugInfo(LUA);
+
+	if (LUA->IsType(-1, Lua::Type::TABLE)) {
+		LUA->GetField(-1, "short_src");
+		if (LUA->IsType(-1, Lua::Type::STRING))
+			source = LUA->GetString(-1);
+		LUA->Pop();
+	}
+
+	LUA->Pop();
+
+	// short_src may be shortened at the front, so search anywhere
+	for (const char *prefix : {"addons/", "gamemodes/"}) {
+		size_t start = source.find(prefix);
+		if (start == std::string::npos)
+			continue;
+
+		start += strlen(prefix);
+		size_t end = source.find('/', start);
+		std::string name = source.substr(start, end == std::string::npos ? std::string::npos : end - start);
+
+		return prefix[0] == 'g' ? "gamemode " + name : name;
+	}
+
+	return source.empty() ? "?" : source;
+}
@@ -1,6 +1,8 @@
 #include <string>
 #include <map>
 #include <GarrysMod/Lua/Interface.h>
+#include "json.h"
+#include "msgpack.h"
 
 using namespace GarrysMod;
 
@@ -9,3 +11,26 @@ using namespace GarrysMod;
 void mapToLuaTable(Lua::ILuaBase *LUA, std::map<std::string, std::string> map);
 std::map<std::string, std::string> mapFromLuaTable(Lua::ILuaBase *LUA, int index);
 void printMessage(Lua::ILuaBase *LUA, std::string message);
+
+// Builds the Lua value of a parsed JSON (or MessagePack) document and
+// leaves it on the stack. Arrays become sequences starting at 1, nulls
+// are left out.
+void pushJSON(Lua::ILuaBase *LUA, const JSONTape& tape);
+
+// Appends the value at `index` as JSON to `out`. Tables with the keys 1
+// to n become arrays, all others objects, with number keys written as
+// strings. Fails on values that JSON can't represent and on cycles.
+bool encodeJSON(Lua::ILuaBase *LUA, int index, std::string *out, std::string *error);
+
+// Same for MessagePack, where tables that aren't sequences become maps
+// with their keys as they are
+bool encodeMsgPack(Lua::ILuaBase *LUA, int index, std::string *out, std::string *error);
+
+// Pops the function at the top of the stack and returns where it was
+// defined as "file:line", using debug.getinfo the first time it sees the
+// function
+std::string functionSource(Lua::ILuaBase *LUA);
+
+// Name of the addon (or gamemode) that the function `level` levels up the
+// call stack belongs to, going by its file. Falls back to the file name.
+std::string callerAddon(Lua::ILuaBase *LUA, int level);
@@ -0,0 +1,265 @@
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include "metrics.h"
+
+#ifndef WINDOWS_BUILD
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+MetricCounters metrics;
+MetricsExporter exporter;
+
+static const char *FAILURE_NAMES[FAILURE_REASONS] = {
+	"send",
+	"api",
+	"response",
+	"decode",
+};
+
+// Bucket bounds of the exported histograms, in seconds
+static const double LATENCY_BOUNDS[] = {
+	0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60,
+};
+
+static const double DISPATCH_BOUNDS[] = {
+	0.00001, 0.000025, 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+};
+
+static std::string escapeLabel(const std::string& value) {
+	std::string escaped;
+
+	for (char c : value) {
+		if (c == '\\' || c == '"')
+			escaped += '\\';
+
+		if (c == '\n')
+			escaped += "\\n";
+		else
+			escaped += c;
+	}
+
+	return escaped;
+}
+
+static void writeHeader(std::ostringstream& out, const char *name, const char *type, const char *help) {
+	out << "# HELP " << name << " " << help << "\n";
+	out << "# TYPE " << name << " " << type << "\n";
+}
+
+// Writes one histogram, folding the fine grained buckets into `bounds`.
+// A fine bucket counts towards the first bound that its highest value fits under.
+template <size_t N>
+static void writeHistogram(std::ostringstream& out, const char *name, const std::string& labels,
+                           const LatencyHistogram& histogram, const double (&bounds)[N]) {
+	std::string prefix = labels.empty() ? "" : labels + ",";
+	uint64 cumulative = 0;
+	size_t bound = 0;
+
+	for (int i = 0; i < LatencyHistogram::BUCKETS; i++) {
+		double highest = LatencyHistogram::bucketHighest(i) / 1000000.0;
+
+		while (bound < N && highest > bounds[bound]) {
+			out << name << "_bucket{" << prefix << "le=\"" << bounds[bound] << "\"} " << cumulative << "\n";
+			bound++;
+		}
+
+		cumulative += histogram.bucketCount(i);
+	}
+
+	for (; bound < N; bound++)
+		out << name << "_bucket{" << prefix << "le=\"" << bounds[bound] << "\"} " << cumulative << "\n";
+
+	out << name << "_bucket{" << prefix << "le=\"+Inf\"} " << cumulative << "\n";
+	out << name << "_sum" << (labels.empty() ? "" : "{" + labels + "}") << " " << histogram.valueSum() / 1000000.0 << "\n";
+	out << name << "_count" << (labels.empty() ? "" : "{" + labels + "}") << " " << cumulative << "\n";
+}
+
+std::string renderMetrics() {
+	std::ostringstream out;
+
+	writeHeader(out, "steamhttp_requests_started_total", "counter", "Requests handed to the backend.");
+	out << "steamhttp_requests_started_total " << metrics.started << "\n";
+
+	writeHeader(out, "steamhttp_requests_completed_total", "counter", "Requests that got a response, by status class.");
+	for (int i = STATUS_1XX; i < STATUS_CLASSES; i++) {
+		out << "steamhttp_requests_completed_total{class=\"" << statusClassName(i) << "\"} " << metrics.completed[i] << "\n";
+	}
+
+	writeHeader(out, "steamhttp_requests_failed_total", "counter", "Requests that failed, by reason.");
+	for (int i = 0; i < FAILURE_REASONS; i++) {
+		out << "steamhttp_requests_failed_total{reason=\"" << FAILURE_NAMES[i] << "\"} " << metrics.failed[i] << "\n";
+	}
+
+	// Read finished first, so a request finishing in between can't make
+	// it look larger than started
+	uint64 finished = metrics.finished;
+	uint64 started = metrics.started;
+	writeHeader(out, "steamhttp_requests_in_flight", "gauge", "Requests started but not finished yet.");
+	out << "steamhttp_requests_in_flight " << (started > finished ? started - finished : 0) << "\n";
+
+	writeHeader(out, "steamhttp_request_bytes_total", "counter", "Bytes of request bodies sent.");
+	out << "steamhttp_request_bytes_total " << metrics.bytesout << "\n";
+
+	writeHeader(out, "steamhttp_response_bytes_total", "counter", "Bytes of response bodies received.");
+	out << "steamhttp_response_bytes_total " << metrics.bytesin << "\n";
+
+	writeHeader(out, "steamhttp_queue_depth", "gauge", "Requests waiting to be picked up by the Think hook.");
+	out << "steamhttp_queue_depth " << metrics.queuedepth << "\n";
+
+	writeHeader(out, "steamhttp_backend_ipc_calls_total", "counter", "Backend IPC calls spent on sending and dispatching requests.");
+	out << "steamhttp_backend_ipc_calls_total " << metrics.ipccalls << "\n";
+
+	writeHeader(out, "steamhttp_dispatch_seconds", "histogram", "Time spent in the Think hook per tick.");
+	writeHistogram(out, "steamhttp_dispatch_seconds", "", metrics.dispatch, DISPATCH_BOUNDS);
+
+	// These restart from zero whenever the latency window (see
+	// setLatencyWindow) resets them, which Prometheus treats as a counter reset.
+	writeHeader(out, "steamhttp_request_duration_seconds", "histogram", "Upstream latency by host and status class.");
+	forEachHostLatency([&out](const std::string& host, HostLatency *latency) {
+		for (int i = 0; i < STATUS_CLASSES; i++) {
+			if (!latency->classes[i].count())
+				continue;
+
+			std::string labels = "host=\"" + escapeLabel(host) + "\",class=\"" + statusClassName(i) + "\"";
+			writeHistogram(out, "steamhttp_request_duration_seconds", labels, latency->classes[i], LATENCY_BOUNDS);
+		}
+	});
+
+	return out.str();
+}
+
+MetricsExporter::~MetricsExporter() {
+	stop();
+}
+
+bool MetricsExporter::startFile(const std::string& file, double seconds) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (running || seconds <= 0)
+		return false;
+
+	path = file;
+	interval = seconds;
+	running = true;
+	thread = std::thread(&MetricsExporter::fileLoop, this);
+
+	return true;
+}
+
+bool MetricsExporter::startSocket(const std::string& file) {
+#ifndef WINDOWS_BUILD
+	std::lock_guard<std::mutex> lock(mutex);
+	sockaddr_un address = sockaddr_un();
+
+	if (running || file.size() >= sizeof(address.sun_path))
+		return false;
+
+	address.sun_family = AF_UNIX;
+	file.copy(address.sun_path, file.size());
+
+	listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0)
+		return false;
+
+	// A stale socket from an earlier run would make bind() fail
+	unlink(file.c_str());
+
+	if (bind(listener, (sockaddr *)&address, sizeof(address)) < 0 || listen(listener, 8) < 0) {
+		close(listener);
+		listener = -1;
+		return false;
+	}
+
+	path = file;
+	running = true;
+	thread = std::thread(&MetricsExporter::socketLoop, this);
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+void MetricsExporter::stop() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (!running)
+		return;
+
+	running = false;
+	thread.join();
+
+#ifndef WINDOWS_BUILD
+	if (listener >= 0) {
+		close(listener);
+		unlink(path.c_str());
+		listener = -1;
+	}
+#endif
+}
+
+bool MetricsExporter::active() {
+	return running;
+}
+
+void MetricsExporter::fileLoop() {
+	std::string temporary = path + ".tmp";
+	auto next = std::chrono::steady_clock::now();
+
+	while (running) {
+		if (std::chrono::steady_clock::now() < next) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			continue;
+		}
+
+		next += std::chrono::milliseconds((long long)(interval * 1000));
+
+		// Write and rename, so the collector never reads a partial file
+		std::string text = renderMetrics();
+		FILE *file = fopen(temporary.c_str(), "wb");
+		if (!file)
+			continue;
+
+		fwrite(text.data(), 1, text.size(), file);
+		fclose(file);
+
+#ifdef WINDOWS_BUILD
+		remove(path.c_str());
+#endif
+		rename(temporary.c_str(), path.c_str());
+	}
+}
+
+void MetricsExporter::socketLoop() {
+#ifndef WINDOWS_BUILD
+	pollfd fd = {listener, POLLIN, 0};
+
+	while (running) {
+		if (poll(&fd, 1, 100) <= 0)
+			continue;
+
+		int client = accept(listener, nullptr, nullptr);
+		if (client < 0)
+			continue;
+
+		std::string text = renderMetrics();
+		const char *data = text.data();
+		size_t left = text.size();
+
+		while (left) {
+			ssize_t written = send(client, data, left, MSG_NOSIGNAL);
+			if (written <= 0)
+				break;
+
+			data += written;
+			left -= written;
+		}
+
+		close(client);
+	}
+#endif
+}
@@ -0,0 +1,81 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "steamtypes.h"
+#include "histogram.h"
+
+// Why a request failed, as far as the metrics care
+enum {
+	FAILURE_SEND,     // the backend refused to send it
+	FAILURE_API,      // the backend reported an error instead of a response
+	FAILURE_RESPONSE, // the response could not be read
+	FAILURE_DECODE,   // the body could not be decoded as asked for
+	FAILURE_REASONS,
+};
+
+// Module-wide counters. Everything is atomic so the exporter thread can
+// read while the game thread updates.
+struct MetricCounters {
+	std::atomic<uint64> started{0};
+
+	// Requests that reached callbackHook, counted once whatever the
+	// outcome. A decode failure counts as completed and as failed, and
+	// status codes outside 100-599 as neither.
+	std::atomic<uint64> finished{0};
+	std::atomic<uint64> completed[STATUS_CLASSES] = {};
+	std::atomic<uint64> failed[FAILURE_REASONS] = {};
+	std::atomic<uint64> bytesout{0};
+	std::atomic<uint64> bytesin{0};
+
+	// Requests waiting for callbackHook, as of the last tick
+	std::atomic<uint64> queuedepth{0};
+
+	// Time spent in callbackHook per tick, in microseconds
+	LatencyHistogram dispatch;
+
+	// Backend IPC calls (see HTTPBackend::ipcCalls) spent on sending and
+	// dispatching requests, and distributions of them per finished
+	// request and per callbackHook tick (calls on any thread in between)
+	std::atomic<uint64> ipccalls{0};
+	LatencyHistogram requestipc;
+	LatencyHistogram tickipc;
+};
+
+extern MetricCounters metrics;
+
+// Renders all metrics, including the latency histograms, in the
+// Prometheus text exposition format.
+std::string renderMetrics();
+
+// Publishes renderMetrics() from a background thread, either by
+// rewriting a file every `interval` seconds (for the node exporter's
+// textfile collector) or by serving it to every client connecting to a
+// Unix socket.
+class MetricsExporter {
+	std::mutex mutex;
+	std::string path;
+	double interval = 0;
+	int listener = -1;
+
+	std::thread thread;
+	std::atomic<bool> running{false};
+
+	void fileLoop();
+	void socketLoop();
+
+public:
+	~MetricsExporter();
+
+	bool startFile(const std::string& path, double interval);
+	bool startSocket(const std::string& path);
+	void stop();
+	bool active();
+};
+
+extern MetricsExporter exporter;
+
+#endif
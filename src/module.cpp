@@ -0,0 +1,168 @@
+#include <string>
+#include "steam_api.h"
+#include "steamhttp.h"
+#include "steambackend.h"
+#include "nativebackend.h"
+#include "recording.h"
+#include "metrics.h"
+#include "submission.h"
+#include "completion.h"
+#include "util.h"
+#include "lua.h"
+#include "responseobject.h"
+#include "prepared.h"
+#include "client.h"
+#include "batch.h"
+
+using namespace GarrysMod;
+
+GMOD_MODULE_OPEN() {
+	std::string backendname = "steam";
+
+	// The backend can be chosen by setting STEAMHTTP_BACKEND before loading the module
+	LUA->PushSpecial(Lua::SPECIAL_GLOB);
+	LUA->GetField(-1, "STEAMHTTP_BACKEND");
+	if (LUA->IsType(-1, Lua::Type::STRING))
+		backendname = LUA->GetString(-1);
+	LUA->Pop(2);
+
+	if (backendname.compare("native") == 0) {
+#ifdef NATIVE_BACKEND_AVAILABLE
+		backend = new NativeBackend();
+#else
+		LUA->ThrowError("The native backend is not available on this platform! STEAMHTTP will not be available!");
+		return 0;
+#endif
+	} else if (backendname.compare("steam") == 0) {
+		// Initialize the SteamAPI
+		if (!SteamAPI_Init()) {
+			LUA->ThrowError("SteamAPI did not initialize correctly! STEAMHTTP will not be available!");
+			return 0;
+		}
+
+		backend = new SteamBackend();
+	} else {
+		LUA->ThrowError(("Unknown STEAMHTTP_BACKEND: " + backendname).c_str());
+		return 0;
+	}
+
+	registerResponseObject(LUA);
+	registerPreparedRequest(LUA);
+	registerClient(LUA);
+
+	// We are working on the global table today
+	LUA->PushSpecial(Lua::SPECIAL_GLOB);
+
+	// Push the function mapping (first is the key/function name,
+	// second is the value/actual function). STEAMHTTP is a table
+	// holding the helper functions, but it is callable like before.
+	// Scripts that detect the module with type(STEAMHTTP) == "function"
+	// have to check for a table now.
+	LUA->PushString("STEAMHTTP");
+	LUA->CreateTable();
+
+	LUA->PushCFunction(StartRecording);
+	LUA->SetField(-2, "StartRecording");
+	LUA->PushCFunction(StopRecording);
+	LUA->SetField(-2, "StopRecording");
+	LUA->PushCFunction(Timings);
+	LUA->SetField(-2, "Timings");
+	LUA->PushCFunction(ResetTimings);
+	LUA->SetField(-2, "ResetTimings");
+	LUA->PushCFunction(Percentile);
+	LUA->SetField(-2, "Percentile");
+	LUA->PushCFunction(ResetLatency);
+	LUA->SetField(-2, "ResetLatency");
+	LUA->PushCFunction(LatencyWindow);
+	LUA->SetField(-2, "LatencyWindow");
+	LUA->PushCFunction(ExportMetrics);
+	LUA->SetField(-2, "ExportMetrics");
+	LUA->PushCFunction(StopMetrics);
+	LUA->SetField(-2, "StopMetrics");
+	LUA->PushCFunction(Metrics);
+	LUA->SetField(-2, "Metrics");
+	LUA->PushCFunction(Trace);
+	LUA->SetField(-2, "Trace");
+	LUA->PushCFunction(FlushTrace);
+	LUA->SetField(-2, "FlushTrace");
+	LUA->PushCFunction(HandlerStats);
+	LUA->SetField(-2, "HandlerStats");
+	LUA->PushCFunction(ResetHandlerStats);
+	LUA->SetField(-2, "ResetHandlerStats");
+	LUA->PushCFunction(SlowHandlerThreshold);
+	LUA->SetField(-2, "SlowHandlerThreshold");
+	LUA->PushCFunction(IPCStats);
+	LUA->SetField(-2, "IPCStats");
+	LUA->PushCFunction(Status);
+	LUA->SetField(-2, "Status");
+	LUA->PushCFunction(DispatchBudget);
+	LUA->SetField(-2, "DispatchBudget");
+	LUA->PushCFunction(Prepare);
+	LUA->SetField(-2, "Prepare");
+	LUA->PushCFunction(Client);
+	LUA->SetField(-2, "Client");
+	LUA->PushCFunction(Batch);
+	LUA->SetField(-2, "Batch");
+
+	LUA->CreateTable();
+	LUA->PushCFunction(callSTEAMHTTP);
+	LUA->SetField(-2, "__call");
+	LUA->SetMetaTable(-2);
+
+	// SetTable takes the item at the top of the stack (value) and
+	// the second item from the top (key) and adds them to the table
+	// at the stack offset mentioned in the parameter (again, -1 is the top)
+	LUA->SetTable(-3);
+
+
+	// Get the hook.Add method
+	LUA->GetField(-1, "hook");
+	LUA->GetField(-1, "Add");
+
+	// Push the new hook data
+	LUA->PushString("Think");
+	LUA->PushString("__steamhttpCallback");
+	LUA->PushCFunction(callbackHook);
+
+	// Add the hook
+	LUA->Call(3, 0);
+
+	// Pop the "hook" table
+	LUA->Pop();
+
+	// Console commands, see traceCommand, traceFlushCommand and statusCommand
+	LUA->GetField(-1, "concommand");
+	LUA->GetField(-1, "Add");
+	LUA->PushString("steamhttp_trace");
+	LUA->PushCFunction(traceCommand);
+	LUA->Call(2, 0);
+
+	LUA->GetField(-1, "Add");
+	LUA->PushString("steamhttp_trace_flush");
+	LUA->PushCFunction(traceFlushCommand);
+	LUA->Call(2, 0);
+
+	LUA->GetField(-1, "Add");
+	LUA->PushString("steamhttp_status");
+	LUA->PushCFunction(statusCommand);
+	LUA->Call(2, 0);
+	LUA->Pop();
+
+	// Pop the global table from the stack again
+	LUA->Pop();
+
+	return 0;
+}
+
+GMOD_MODULE_CLOSE() {
+	submitter.stop();
+	completions.stop();
+	stopClients(LUA);
+	recorder.stop();
+	exporter.stop();
+
+	delete backend;
+	backend = nullptr;
+
+	return 0;
+}
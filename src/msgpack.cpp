@@ -0,0 +1,360 @@
+#include <cmath>
+#include <cstring>
+#include "msgpack.h"
+
+// Deeper documents are rejected, like in the JSON parser
+static const int MAX_DEPTH = 256;
+
+// Extension type of timestamps
+static const int8 EXT_TIMESTAMP = -1;
+
+static void appendBig(std::string *out, uint64 value, int bytes) {
+	for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8)
+		*out += (char)(value >> shift);
+}
+
+void appendMsgPackNil(std::string *out) {
+	*out += (char)0xc0;
+}
+
+void appendMsgPackBool(std::string *out, bool value) {
+	*out += (char)(value ? 0xc3 : 0xc2);
+}
+
+void appendMsgPackNumber(std::string *out, double number) {
+	// Integers go into the smallest int format that holds them
+	if (number >= 0 && number < 18446744073709551616.0 && number == (double)(uint64)number) {
+		uint64 value = (uint64)number;
+
+		if (value < 0x80) {
+			*out += (char)value;
+		} else if (value <= 0xff) {
+			*out += (char)0xcc;
+			appendBig(out, value, 1);
+		} else if (value <= 0xffff) {
+			*out += (char)0xcd;
+			appendBig(out, value, 2);
+		} else if (value <= 0xffffffff) {
+			*out += (char)0xce;
+			appendBig(out, value, 4);
+		} else {
+			*out += (char)0xcf;
+			appendBig(out, value, 8);
+		}
+		return;
+	}
+
+	if (number < 0 && number >= -9223372036854775808.0 && number == (double)(int64)number) {
+		int64 value = (int64)number;
+
+		if (value >= -32) {
+			*out += (char)value;
+		} else if (value >= -0x80) {
+			*out += (char)0xd0;
+			appendBig(out, (uint64)value, 1);
+		} else if (value >= -0x8000) {
+			*out += (char)0xd1;
+			appendBig(out, (uint64)value, 2);
+		} else if (value >= -0x80000000LL) {
+			*out += (char)0xd2;
+			appendBig(out, (uint64)value, 4);
+		} else {
+			*out += (char)0xd3;
+			appendBig(out, (uint64)value, 8);
+		}
+		return;
+	}
+
+	uint64 bits;
+	memcpy(&bits, &number, sizeof(bits));
+	*out += (char)0xcb;
+	appendBig(out, bits, 8);
+}
+
+void appendMsgPackString(std::string *out, const char *str, size_t length) {
+	if (length < 32) {
+		*out += (char)(0xa0 | length);
+	} else if (length <= 0xff) {
+		*out += (char)0xd9;
+		appendBig(out, length, 1);
+	} else if (length <= 0xffff) {
+		*out += (char)0xda;
+		appendBig(out, length, 2);
+	} else {
+		*out += (char)0xdb;
+		appendBig(out, length, 4);
+	}
+
+	out->append(str, length);
+}
+
+void appendMsgPackArray(std::string *out, uint32 count) {
+	if (count < 16) {
+		*out += (char)(0x90 | count);
+	} else if (count <= 0xffff) {
+		*out += (char)0xdc;
+		appendBig(out, count, 2);
+	} else {
+		*out += (char)0xdd;
+		appendBig(out, count, 4);
+	}
+}
+
+void appendMsgPackMap(std::string *out, uint32 count) {
+	if (count < 16) {
+		*out += (char)(0x80 | count);
+	} else if (count <= 0xffff) {
+		*out += (char)0xde;
+		appendBig(out, count, 2);
+	} else {
+		*out += (char)0xdf;
+		appendBig(out, count, 4);
+	}
+}
+
+class MsgPackParser {
+	const uint8 *begin;
+	const uint8 *p;
+	const uint8 *end;
+	JSONTape *tape;
+
+	bool fail(const char *what) {
+		error = std::string(what) + " at offset " + std::to_string(p - begin);
+		return false;
+	}
+
+	bool need(size_t bytes) {
+		if ((size_t)(end - p) < bytes)
+			return fail("Unexpected end of input");
+
+		return true;
+	}
+
+	uint64 readBig(int bytes) {
+		uint64 value = 0;
+
+		for (int i = 0; i < bytes; i++)
+			value = (value << 8) | *p++;
+
+		return value;
+	}
+
+	bool parseString(JSONNode *node, size_t length) {
+		if (!need(length))
+			return false;
+
+		node->type = JSON_STRING;
+		node->offset = tape->strings.size();
+		node->length = length;
+
+		tape->strings.append((const char *)p, length);
+		tape->strings += '\0';
+		p += length;
+		return true;
+	}
+
+	bool parseExtension(JSONNode *node, size_t length) {
+		if (!need(1 + length))
+			return false;
+
+		int8 type = (int8)*p++;
+
+		if (type != EXT_TIMESTAMP)
+			return fail("Unsupported extension type");
+
+		node->type = JSON_NUMBER;
+
+		if (length == 4) {
+			node->number = (double)readBig(4);
+		} else if (length == 8) {
+			uint64 value = readBig(8);
+			node->number = (double)(value & 0x3ffffffffULL) + (double)(value >> 34) / 1e9;
+		} else if (length == 12) {
+			uint64 nanoseconds = readBig(4);
+			node->number = (double)(int64)readBig(8) + (double)nanoseconds / 1e9;
+		} else {
+			return fail("Invalid timestamp");
+		}
+
+		return true;
+	}
+
+	// `index` is the container's node, which gets its final type and
+	// length once all children are on the tape
+	bool parseContainer(size_t index, JSONType type, uint64 count, int depth) {
+		if (depth >= MAX_DEPTH)
+			return fail("Nesting too deep");
+
+		// Every element takes at least a byte, so don't trust counts
+		// that the rest of the input can't hold
+		if (count * (type == JSON_OBJECT ? 2 : 1) > (uint64)(end - p))
+			return fail("Unexpected end of input");
+
+		for (uint64 i = 0; i < count; i++) {
+			if (type == JSON_OBJECT) {
+				size_t key = tape->nodes.size();
+
+				if (!parseValue(depth + 1))
+					return false;
+
+				// Lua tables can't have nil or NaN keys
+				const JSONNode& keynode = tape->nodes[key];
+				if (keynode.type == JSON_NULL || keynode.type == JSON_ARRAY || keynode.type == JSON_OBJECT)
+					return fail("Unsupported map key");
+				if (keynode.type == JSON_NUMBER && std::isnan(keynode.number))
+					return fail("NaN map key");
+			}
+
+			if (!parseValue(depth + 1))
+				return false;
+		}
+
+		tape->nodes[index].type = type;
+		tape->nodes[index].length = count;
+		return true;
+	}
+
+	bool parseValue(int depth) {
+		size_t index = tape->nodes.size();
+		tape->nodes.push_back(JSONNode());
+
+		if (!need(1))
+			return false;
+
+		JSONNode *node = &tape->nodes[index];
+		uint8 byte = *p++;
+
+		if (byte < 0x80) {
+			node->type = JSON_NUMBER;
+			node->number = byte;
+			return true;
+		}
+
+		if (byte >= 0xe0) {
+			node->type = JSON_NUMBER;
+			node->number = (int8)byte;
+			return true;
+		}
+
+		if ((byte & 0xf0) == 0x80)
+			return parseContainer(index, JSON_OBJECT, byte & 0x0f, depth);
+		if ((byte & 0xf0) == 0x90)
+			return parseContainer(index, JSON_ARRAY, byte & 0x0f, depth);
+		if ((byte & 0xe0) == 0xa0)
+			return parseString(node, byte & 0x1f);
+
+		// Sizes of the length fields of str/bin/ext 8, 16 and 32
+		static const int SIZES[] = {1, 2, 4};
+
+		switch (byte) {
+		case 0xc0:
+			node->type = JSON_NULL;
+			return true;
+		case 0xc2:
+			node->type = JSON_FALSE;
+			return true;
+		case 0xc3:
+			node->type = JSON_TRUE;
+			return true;
+		case 0xc4: case 0xc5: case 0xc6:
+			if (!need(SIZES[byte - 0xc4]))
+				return false;
+			return parseString(node, readBig(SIZES[byte - 0xc4]));
+		case 0xc7: case 0xc8: case 0xc9:
+			if (!need(SIZES[byte - 0xc7]))
+				return false;
+			return parseExtension(node, readBig(SIZES[byte - 0xc7]));
+		case 0xca: {
+			if (!need(4))
+				return false;
+
+			uint32 bits = readBig(4);
+			float value;
+			memcpy(&value, &bits, sizeof(value));
+			node->type = JSON_NUMBER;
+			node->number = value;
+			return true;
+		}
+		case 0xcb: {
+			if (!need(8))
+				return false;
+
+			uint64 bits = readBig(8);
+			memcpy(&node->number, &bits, sizeof(bits));
+			node->type = JSON_NUMBER;
+			return true;
+		}
+		case 0xcc: case 0xcd: case 0xce: case 0xcf: {
+			int bytes = 1 << (byte - 0xcc);
+
+			if (!need(bytes))
+				return false;
+
+			node->type = JSON_NUMBER;
+			node->number = (double)readBig(bytes);
+			return true;
+		}
+		case 0xd0: case 0xd1: case 0xd2: case 0xd3: {
+			int bytes = 1 << (byte - 0xd0);
+
+			if (!need(bytes))
+				return false;
+
+			// Sign-extend from the top bit of the value
+			int shift = 64 - bytes * 8;
+			node->type = JSON_NUMBER;
+			node->number = (double)((int64)(readBig(bytes) << shift) >> shift);
+			return true;
+		}
+		case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8:
+			return parseExtension(node, 1 << (byte - 0xd4));
+		case 0xd9: case 0xda: case 0xdb:
+			if (!need(SIZES[byte - 0xd9]))
+				return false;
+			return parseString(node, readBig(SIZES[byte - 0xd9]));
+		case 0xdc: case 0xdd:
+			if (!need(byte == 0xdc ? 2 : 4))
+				return false;
+			return parseContainer(index, JSON_ARRAY, readBig(byte == 0xdc ? 2 : 4), depth);
+		case 0xde: case 0xdf:
+			if (!need(byte == 0xde ? 2 : 4))
+				return false;
+			return parseContainer(index, JSON_OBJECT, readBig(byte == 0xde ? 2 : 4), depth);
+		default:
+			p--;
+			return fail("Invalid type byte");
+		}
+	}
+
+public:
+	std::string error;
+
+	MsgPackParser(const char *data, size_t length, JSONTape *tape) : begin((const uint8 *)data), p(begin), end(begin + length), tape(tape) {
+	}
+
+	bool parse() {
+		if (!parseValue(0))
+			return false;
+
+		if (p != end)
+			return fail("Unexpected data after the document");
+
+		return true;
+	}
+};
+
+bool parseMsgPack(const char *data, size_t length, JSONTape *tape, std::string *error) {
+	MsgPackParser parser(data, length, tape);
+
+	tape->nodes.clear();
+	tape->strings.clear();
+	tape->nodes.reserve(length / 8);
+	tape->strings.reserve(length / 2);
+
+	if (!parser.parse()) {
+		error->assign(parser.error);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,25 @@
+#ifndef _MSGPACK_H
+#define _MSGPACK_H
+
+#include <string>
+#include "json.h"
+
+// MessagePack (https://msgpack.org) shares the JSON document model closely
+// enough to be parsed into a JSONTape, with two differences: map keys may
+// be numbers or booleans, and bin values become strings. Integers become
+// doubles, like every Lua number. Timestamps become seconds, other
+// extension types are rejected.
+bool parseMsgPack(const char *data, size_t length, JSONTape *tape, std::string *error);
+
+// Append a value to a MessagePack document, in the smallest encoding
+void appendMsgPackNil(std::string *out);
+void appendMsgPackBool(std::string *out, bool value);
+void appendMsgPackNumber(std::string *out, double number);
+void appendMsgPackString(std::string *out, const char *str, size_t length);
+
+// Append the header of an array of `count` elements or a map of `count`
+// key/value pairs, which have to follow
+void appendMsgPackArray(std::string *out, uint32 count);
+void appendMsgPackMap(std::string *out, uint32 count);
+
+#endif
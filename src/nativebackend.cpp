@@ -0,0 +1,1258 @@
+#include "nativebackend.h"
+
+#ifdef NATIVE_BACKEND_AVAILABLE
+
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include "lockqueue.h"
+#include "util.h"
+
+// Connections per host that may be open at the same time
+#define MAX_HOST_CONNECTIONS 8
+
+// Milliseconds of inactivity before an in-flight request is aborted
+#define REQUEST_TIMEOUT 60000
+
+// Milliseconds before an unused pooled connection is closed
+#define IDLE_TIMEOUT 30000
+
+// Threads looking up host names. One lookup per host runs at a time, so
+// this is how many slow hosts it takes to delay the others.
+#define RESOLVER_THREADS 4
+
+// Milliseconds that the addresses of a host are used before it is looked
+// up again, for new connections. getaddrinfo doesn't tell the record's TTL.
+#define DNS_CACHE_TIME 60000
+
+struct NativeRequest {
+	HTTPRequestHandle handle;
+	EHTTPMethod method;
+
+	std::string host;
+	std::string port;
+	std::string path;
+
+	std::string useragent;
+	std::map<std::string, std::string> headers;
+	std::map<std::string, std::string> parameters;
+	std::string type;
+	std::string body;
+	bool hasbody = false;
+
+	// Absolute timeout from setTimeout, and the time it runs out at
+	uint32 timeout = 0;
+	uint64 expires = 0;
+
+	// The serialized request, built once on send
+	std::string wire;
+	bool sent = false;
+	bool retried = false;
+
+	// Written by the I/O thread before `done` is set, read-only afterwards
+	bool successful = false;
+	long code = 0;
+	std::map<std::string, std::string> responseheaders;
+	std::string responsebody;
+	uint64 completedtime = 0;
+	std::atomic<bool> done{false};
+
+	// Download progress, for status displays. `expected` is 0 if unknown.
+	std::atomic<uint64> received{0};
+	std::atomic<uint64> expected{0};
+};
+
+enum ParseState {
+	PARSE_HEAD,
+	PARSE_LENGTH,
+	PARSE_CHUNK_SIZE,
+	PARSE_CHUNK_DATA,
+	PARSE_CHUNK_END,
+	PARSE_TRAILER,
+	PARSE_UNTIL_CLOSE,
+	PARSE_DONE,
+};
+
+struct NativeConnection {
+	int fd = -1;
+	std::string key;
+	bool connected = false;
+	bool reused = false;
+	uint64 deadline = 0;
+
+	// Which of the host's addresses it connects to
+	size_t address = 0;
+
+	std::shared_ptr<NativeRequest> request;
+	std::string out;
+	size_t outpos = 0;
+
+	// Response parser state
+	std::string in;
+	size_t inpos = 0;
+	ParseState state = PARSE_HEAD;
+	uint64 remaining = 0;
+	bool keepalive = false;
+	bool gotbytes = false;
+	long code = 0;
+	std::map<std::string, std::string> headers;
+	std::string body;
+};
+
+// One result of getaddrinfo, kept to open connections with
+struct NativeAddress {
+	int family;
+	int socktype;
+	int protocol;
+	sockaddr_storage addr;
+	socklen_t addrlen;
+};
+
+struct NativeHost {
+	std::string host;
+	std::string port;
+	std::vector<NativeConnection *> idle;
+	std::deque<std::shared_ptr<NativeRequest>> pending;
+	int connections = 0;
+
+	// Addresses from the last lookup, which happens on a resolver thread.
+	// Pending requests wait for the first one.
+	std::vector<NativeAddress> addresses;
+	uint64 resolvedat = 0;
+	bool resolving = false;
+};
+
+// A host name for a resolver thread to look up, and what it found
+struct HostLookup {
+	std::string key;
+	std::string host;
+	std::string port;
+	std::vector<NativeAddress> addresses;
+};
+
+static uint64 nowMillis() {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::string toLower(std::string str) {
+	for (char& c : str)
+		c = tolower((unsigned char)c);
+
+	return str;
+}
+
+static std::string trim(const std::string& str) {
+	size_t start = str.find_first_not_of(" \t");
+	size_t end = str.find_last_not_of(" \t\r");
+
+	if (start == std::string::npos)
+		return "";
+
+	return str.substr(start, end - start + 1);
+}
+
+static std::string urlEncode(const std::string& str) {
+	static const char hex[] = "0123456789ABCDEF";
+	std::string out;
+
+	for (unsigned char c : str) {
+		if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+			out += c;
+		} else {
+			out += '%';
+			out += hex[c >> 4];
+			out += hex[c & 15];
+		}
+	}
+
+	return out;
+}
+
+// Header names are tokens (RFC 7230, 3.2.6)
+static bool validHeaderName(const char *name) {
+	if (!*name)
+		return false;
+
+	for (const char *c = name; *c; c++) {
+		if (!isalnum((unsigned char)*c) && !strchr("!#$%&'*+-.^_`|~", *c))
+			return false;
+	}
+
+	return true;
+}
+
+// Line breaks in header values would end the header early and let the
+// rest of the value add headers (or a whole request) of its own
+static bool validHeaderValue(const char *value) {
+	return !strpbrk(value, "\r\n");
+}
+
+static const char *methodName(EHTTPMethod method) {
+	switch (method) {
+	case k_EHTTPMethodGET:
+		return "GET";
+	case k_EHTTPMethodHEAD:
+		return "HEAD";
+	case k_EHTTPMethodPOST:
+		return "POST";
+	case k_EHTTPMethodPUT:
+		return "PUT";
+	case k_EHTTPMethodDELETE:
+		return "DELETE";
+	case k_EHTTPMethodOPTIONS:
+		return "OPTIONS";
+	case k_EHTTPMethodPATCH:
+		return "PATCH";
+	default:
+		return nullptr;
+	}
+}
+
+// Splits an absolute http:// URL into host, port and path
+static bool parseURL(const std::string& url, NativeRequest *req) {
+	if (url.compare(0, 7, "http://") != 0)
+		return false;
+
+	// The path goes into the request line as it is, so it can't contain
+	// spaces or control characters
+	for (unsigned char c : url) {
+		if (c <= ' ' || c == 0x7f)
+			return false;
+	}
+
+	size_t hoststart = 7;
+	size_t pathstart = url.find_first_of("/?#", hoststart);
+	std::string authority = url.substr(hoststart, pathstart - hoststart);
+
+	if (pathstart == std::string::npos)
+		req->path = "/";
+	else if (url[pathstart] == '/')
+		req->path = url.substr(pathstart);
+	else
+		req->path = "/" + url.substr(pathstart);
+
+	// Fragments never go over the wire
+	size_t fragment = req->path.find('#');
+	if (fragment != std::string::npos)
+		req->path.erase(fragment);
+
+	// Userinfo is not supported
+	if (authority.find('@') != std::string::npos)
+		return false;
+
+	size_t colon = authority.rfind(':');
+	if (authority[0] == '[') {
+		size_t bracket = authority.find(']');
+		if (bracket == std::string::npos)
+			return false;
+		req->host = authority.substr(1, bracket - 1);
+		colon = authority.find(':', bracket);
+	} else {
+		req->host = authority.substr(0, colon);
+	}
+
+	req->port = colon == std::string::npos ? "80" : authority.substr(colon + 1);
+
+	return !req->host.empty() && !req->port.empty();
+}
+
+// Builds the request line, headers and body exactly as they go on the wire
+static void serializeRequest(NativeRequest *req) {
+	std::string path = req->path;
+	std::string body = req->body;
+	std::string type = req->type;
+	bool hasbody = req->hasbody;
+	std::string params;
+
+	for (auto const& e : req->parameters) {
+		if (!params.empty())
+			params += '&';
+		params += urlEncode(e.first) + "=" + urlEncode(e.second);
+	}
+
+	// Like Steam, parameters go into the query string for bodyless methods
+	// and into a form body otherwise (unless a raw body has been set).
+	if (!params.empty()) {
+		if (req->method == k_EHTTPMethodGET || req->method == k_EHTTPMethodHEAD || req->method == k_EHTTPMethodDELETE) {
+			path += (path.find('?') == std::string::npos ? "?" : "&") + params;
+		} else if (!hasbody) {
+			body = params;
+			type = "application/x-www-form-urlencoded";
+			hasbody = true;
+		}
+	}
+
+	std::string& wire = req->wire;
+	wire.reserve(256 + body.size());
+	wire = std::string(methodName(req->method)) + " " + path + " HTTP/1.1\r\n";
+
+	wire += "Host: " + (req->host.find(':') != std::string::npos ? "[" + req->host + "]" : req->host);
+	if (req->port != "80")
+		wire += ":" + req->port;
+	wire += "\r\n";
+
+	bool useragent = false, contenttype = false;
+	for (auto const& e : req->headers) {
+		std::string name = toLower(e.first);
+
+		// These are managed by us
+		if (name == "host" || name == "content-length" || name == "connection" || name == "transfer-encoding")
+			continue;
+		if (name == "user-agent")
+			useragent = true;
+		if (name == "content-type") {
+			// A form body needs its own content type
+			if (hasbody && !req->hasbody)
+				continue;
+			contenttype = true;
+		}
+
+		wire += e.first + ": " + e.second + "\r\n";
+	}
+
+	if (!useragent)
+		wire += "User-Agent: gmod-steamhttp" + (req->useragent.empty() ? "" : " " + req->useragent) + "\r\n";
+	if (hasbody && !contenttype && !type.empty())
+		wire += "Content-Type: " + type + "\r\n";
+	if (hasbody || req->method == k_EHTTPMethodPOST || req->method == k_EHTTPMethodPUT || req->method == k_EHTTPMethodPATCH)
+		wire += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+
+	wire += "Connection: keep-alive\r\n\r\n";
+	wire += body;
+}
+
+class NativeIOLoop {
+	int epollfd = -1;
+	int wakefd = -1;
+	std::atomic<bool> running{true};
+	std::thread thread;
+
+	LockableQueue<std::shared_ptr<NativeRequest>> submitted;
+
+	// Host names are looked up on threads of their own, so a slow DNS
+	// server doesn't hold up the requests in flight
+	std::mutex resolvermutex;
+	std::condition_variable resolvewakeup;
+	std::deque<HostLookup> lookups;
+	LockableQueue<HostLookup> resolved;
+	std::vector<std::thread> resolvers;
+
+	std::mutex listenermutex;
+	std::function<void()> listener;
+
+	// Everything below is only touched by the I/O thread
+	bool completedany = false;
+	std::map<std::string, NativeHost> hosts;
+	std::vector<NativeConnection *> connections;
+	std::vector<NativeConnection *> graveyard;
+
+	void run();
+	void resolveLoop();
+	void wake();
+	void drainSubmissions();
+	void drainLookups();
+	void schedule(NativeHost& host);
+	void failRequest(std::shared_ptr<NativeRequest> req);
+	bool openConnection(NativeHost& host, std::shared_ptr<NativeRequest> req, size_t first = 0);
+	void assign(NativeConnection *conn, std::shared_ptr<NativeRequest> req);
+	void watch(NativeConnection *conn, uint32_t events);
+	void handleEvent(NativeConnection *conn, uint32_t events);
+	bool flush(NativeConnection *conn);
+	bool receive(NativeConnection *conn, bool *eof);
+	bool parse(NativeConnection *conn);
+	void finish(NativeConnection *conn);
+	void fail(NativeConnection *conn);
+	void connectFailed(NativeConnection *conn);
+	void closeConnection(NativeConnection *conn);
+	void checkTimeouts();
+
+public:
+	NativeIOLoop();
+	~NativeIOLoop();
+
+	void submit(std::shared_ptr<NativeRequest> req);
+	void setListener(std::function<void()> callback);
+};
+
+NativeIOLoop::NativeIOLoop() {
+	epollfd = epoll_create1(EPOLL_CLOEXEC);
+	wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	// The wakeup descriptor is registered with a null pointer
+	epoll_event ev = {};
+	ev.events = EPOLLIN;
+	ev.data.ptr = nullptr;
+	epoll_ctl(epollfd, EPOLL_CTL_ADD, wakefd, &ev);
+
+	thread = std::thread(&NativeIOLoop::run, this);
+	for (int i = 0; i < RESOLVER_THREADS; i++)
+		resolvers.push_back(std::thread(&NativeIOLoop::resolveLoop, this));
+}
+
+NativeIOLoop::~NativeIOLoop() {
+	{
+		std::lock_guard<std::mutex> lock(resolvermutex);
+		running = false;
+		resolvewakeup.notify_all();
+	}
+
+	wake();
+	thread.join();
+
+	// Lookups in progress can't be interrupted, this waits for them
+	for (std::thread& resolver : resolvers)
+		resolver.join();
+
+	for (NativeConnection *conn : connections) {
+		close(conn->fd);
+		delete conn;
+	}
+
+	close(wakefd);
+	close(epollfd);
+}
+
+void NativeIOLoop::wake() {
+	uint64_t one = 1;
+	if (write(wakefd, &one, sizeof(one)) < 0) {
+		// The counter can only overflow if the loop is stuck, nothing to do
+	}
+}
+
+void NativeIOLoop::submit(std::shared_ptr<NativeRequest> req) {
+	submitted.push(req);
+	wake();
+}
+
+void NativeIOLoop::setListener(std::function<void()> callback) {
+	std::lock_guard<std::mutex> lock(listenermutex);
+	listener = callback;
+}
+
+void NativeIOLoop::run() {
+	epoll_event events[64];
+
+	while (running) {
+		int count = epoll_wait(epollfd, events, 64, 1000);
+
+		for (int i = 0; i < count; i++) {
+			if (events[i].data.ptr == nullptr) {
+				uint64_t value;
+				if (read(wakefd, &value, sizeof(value)) < 0) {
+					// Spurious wakeup
+				}
+				drainSubmissions();
+				drainLookups();
+				continue;
+			}
+
+			NativeConnection *conn = static_cast<NativeConnection *>(events[i].data.ptr);
+
+			// Closed earlier in this batch
+			if (conn->fd < 0)
+				continue;
+
+			handleEvent(conn, events[i].events);
+		}
+
+		checkTimeouts();
+
+		for (NativeConnection *conn : graveyard)
+			delete conn;
+		graveyard.clear();
+
+		// One notification per batch of completions
+		if (completedany) {
+			std::function<void()> callback;
+			completedany = false;
+
+			{
+				std::lock_guard<std::mutex> lock(listenermutex);
+				callback = listener;
+			}
+
+			if (callback)
+				callback();
+		}
+	}
+}
+
+void NativeIOLoop::drainSubmissions() {
+	// We are the only consumer, so the queue can't run dry in between
+	while (!submitted.empty()) {
+		std::shared_ptr<NativeRequest> req = submitted.pop();
+		std::string key = req->host + ":" + req->port;
+
+		NativeHost& host = hosts[key];
+		host.host = req->host;
+		host.port = req->port;
+		host.pending.push_back(req);
+
+		schedule(host);
+	}
+}
+
+void NativeIOLoop::resolveLoop() {
+	std::unique_lock<std::mutex> lock(resolvermutex);
+
+	while (running) {
+		if (lookups.empty()) {
+			resolvewakeup.wait(lock);
+			continue;
+		}
+
+		HostLookup lookup = std::move(lookups.front());
+		lookups.pop_front();
+		lock.unlock();
+
+		addrinfo hints = {};
+		addrinfo *result;
+
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+
+		if (getaddrinfo(lookup.host.c_str(), lookup.port.c_str(), &hints, &result) == 0) {
+			for (addrinfo *ai = result; ai; ai = ai->ai_next) {
+				NativeAddress address = {};
+				address.family = ai->ai_family;
+				address.socktype = ai->ai_socktype;
+				address.protocol = ai->ai_protocol;
+				address.addrlen = ai->ai_addrlen;
+				memcpy(&address.addr, ai->ai_addr, ai->ai_addrlen);
+				lookup.addresses.push_back(address);
+			}
+
+			freeaddrinfo(result);
+		}
+
+		resolved.push(std::move(lookup));
+		wake();
+
+		lock.lock();
+	}
+}
+
+// Takes the results of finished lookups, failing what waited for a host
+// that doesn't resolve
+void NativeIOLoop::drainLookups() {
+	while (!resolved.empty()) {
+		HostLookup lookup = resolved.pop();
+		NativeHost& host = hosts[lookup.key];
+
+		host.resolving = false;
+		host.resolvedat = nowMillis();
+
+		// A failed refresh keeps the addresses we had
+		if (!lookup.addresses.empty()) {
+			host.addresses.swap(lookup.addresses);
+		} else if (host.addresses.empty()) {
+			while (!host.pending.empty()) {
+				failRequest(host.pending.front());
+				host.pending.pop_front();
+			}
+		}
+
+		schedule(host);
+	}
+}
+
+void NativeIOLoop::failRequest(std::shared_ptr<NativeRequest> req) {
+	req->successful = false;
+	req->completedtime = nowMicros();
+	req->done = true;
+	completedany = true;
+}
+
+// Hands pending requests to idle connections, opening new ones up to the limit
+void NativeIOLoop::schedule(NativeHost& host) {
+	// New connections need the host's addresses, which are looked up (and
+	// refreshed after a while) without blocking this thread
+	bool stale = host.addresses.empty() || nowMillis() - host.resolvedat > DNS_CACHE_TIME;
+
+	if (!host.pending.empty() && stale && !host.resolving) {
+		std::lock_guard<std::mutex> lock(resolvermutex);
+
+		host.resolving = true;
+		lookups.push_back({host.host + ":" + host.port, host.host, host.port, {}});
+		resolvewakeup.notify_one();
+	}
+
+	while (!host.pending.empty()) {
+		std::shared_ptr<NativeRequest> req = host.pending.front();
+
+		if (!host.idle.empty()) {
+			NativeConnection *conn = host.idle.back();
+			host.idle.pop_back();
+			host.pending.pop_front();
+			assign(conn, req);
+			continue;
+		}
+
+		if (host.connections >= MAX_HOST_CONNECTIONS || host.addresses.empty())
+			break;
+
+		host.pending.pop_front();
+		if (!openConnection(host, req))
+			failRequest(req);
+	}
+}
+
+// Connects to the first of the host's addresses, starting at `first`,
+// that doesn't fail right away
+bool NativeIOLoop::openConnection(NativeHost& host, std::shared_ptr<NativeRequest> req, size_t first) {
+	int fd = -1;
+	size_t index;
+
+	for (index = first; index < host.addresses.size(); index++) {
+		const NativeAddress& address = host.addresses[index];
+
+		fd = socket(address.family, address.socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, address.protocol);
+		if (fd < 0)
+			continue;
+
+		if (connect(fd, (const sockaddr *)&address.addr, address.addrlen) == 0 || errno == EINPROGRESS)
+			break;
+
+		close(fd);
+		fd = -1;
+	}
+
+	if (fd < 0)
+		return false;
+
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	NativeConnection *conn = new NativeConnection();
+	conn->fd = fd;
+	conn->key = host.host + ":" + host.port;
+	conn->address = index;
+	connections.push_back(conn);
+	host.connections++;
+
+	epoll_event ev = {};
+	ev.events = EPOLLOUT | EPOLLIN | EPOLLRDHUP;
+	ev.data.ptr = conn;
+	epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev);
+
+	assign(conn, req);
+	return true;
+}
+
+void NativeIOLoop::assign(NativeConnection *conn, std::shared_ptr<NativeRequest> req) {
+	conn->request = req;
+	conn->out = req->wire;
+	conn->outpos = 0;
+	conn->in.clear();
+	conn->inpos = 0;
+	conn->state = PARSE_HEAD;
+	conn->gotbytes = false;
+	conn->headers.clear();
+	conn->body.clear();
+	conn->deadline = nowMillis() + REQUEST_TIMEOUT;
+
+	if (conn->connected) {
+		conn->reused = true;
+		if (!flush(conn)) {
+			fail(conn);
+			return;
+		}
+	}
+
+	watch(conn, (conn->outpos < conn->out.size() || !conn->connected ? (uint32_t)EPOLLOUT : 0) | EPOLLIN | EPOLLRDHUP);
+}
+
+void NativeIOLoop::watch(NativeConnection *conn, uint32_t events) {
+	epoll_event ev = {};
+	ev.events = events;
+	ev.data.ptr = conn;
+	epoll_ctl(epollfd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+void NativeIOLoop::handleEvent(NativeConnection *conn, uint32_t events) {
+	// Idle connections should be silent, anything here means the peer is gone
+	if (!conn->request) {
+		closeConnection(conn);
+		return;
+	}
+
+	if (!conn->connected && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+		int error = 0;
+		socklen_t len = sizeof(error);
+
+		if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+			connectFailed(conn);
+			return;
+		}
+
+		conn->connected = true;
+	}
+
+	if (events & EPOLLOUT) {
+		if (!flush(conn)) {
+			fail(conn);
+			return;
+		}
+
+		if (conn->outpos == conn->out.size())
+			watch(conn, EPOLLIN | EPOLLRDHUP);
+	}
+
+	if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+		bool eof = false;
+
+		if (!receive(conn, &eof)) {
+			fail(conn);
+			return;
+		}
+
+		if (!parse(conn)) {
+			fail(conn);
+			return;
+		}
+
+		if (conn->state == PARSE_DONE) {
+			finish(conn);
+			return;
+		}
+
+		if (eof) {
+			// Without a length, the body ends with the connection
+			if (conn->state == PARSE_UNTIL_CLOSE) {
+				conn->state = PARSE_DONE;
+				conn->keepalive = false;
+				finish(conn);
+			} else {
+				fail(conn);
+			}
+		}
+	}
+}
+
+bool NativeIOLoop::flush(NativeConnection *conn) {
+	while (conn->outpos < conn->out.size()) {
+		ssize_t sent = send(conn->fd, conn->out.data() + conn->outpos, conn->out.size() - conn->outpos, MSG_NOSIGNAL);
+
+		if (sent < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return true;
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		conn->outpos += sent;
+		conn->deadline = nowMillis() + REQUEST_TIMEOUT;
+	}
+
+	return true;
+}
+
+bool NativeIOLoop::receive(NativeConnection *conn, bool *eof) {
+	char buffer[16384];
+
+	while (true) {
+		ssize_t received = recv(conn->fd, buffer, sizeof(buffer), 0);
+
+		if (received < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return true;
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		if (received == 0) {
+			*eof = true;
+			return true;
+		}
+
+		conn->in.append(buffer, received);
+		conn->gotbytes = true;
+		conn->deadline = nowMillis() + REQUEST_TIMEOUT;
+	}
+}
+
+// Advances the response parser as far as the buffered data allows.
+// Returns false on malformed responses.
+bool NativeIOLoop::parse(NativeConnection *conn) {
+	std::string& in = conn->in;
+
+	while (conn->state != PARSE_DONE) {
+		size_t available = in.size() - conn->inpos;
+
+		if (conn->state == PARSE_HEAD) {
+			size_t end = in.find("\r\n\r\n", conn->inpos);
+			if (end == std::string::npos)
+				return in.size() - conn->inpos < 65536;
+
+			std::string status = in.substr(conn->inpos, in.find("\r\n", conn->inpos) - conn->inpos);
+			if (status.compare(0, 5, "HTTP/") != 0 || status.size() < 12)
+				return false;
+
+			bool http10 = status.compare(0, 8, "HTTP/1.0") == 0;
+			conn->code = strtol(status.c_str() + 9, nullptr, 10);
+			conn->headers.clear();
+
+			size_t line = in.find("\r\n", conn->inpos) + 2;
+			while (line < end) {
+				size_t lineend = in.find("\r\n", line);
+				size_t colon = in.find(':', line);
+
+				if (colon != std::string::npos && colon < lineend) {
+					std::string name = toLower(trim(in.substr(line, colon - line)));
+					std::string value = trim(in.substr(colon + 1, lineend - colon - 1));
+
+					if (conn->headers.count(name))
+						conn->headers[name] += ", " + value;
+					else
+						conn->headers[name] = value;
+				}
+
+				line = lineend + 2;
+			}
+
+			conn->inpos = end + 4;
+
+			// Interim responses (100 Continue and friends) are skipped
+			if (conn->code >= 100 && conn->code < 200)
+				continue;
+
+			std::string connection = toLower(conn->headers["connection"]);
+			conn->keepalive = http10 ? connection == "keep-alive" : connection != "close";
+
+			if (conn->request->method == k_EHTTPMethodHEAD || conn->code == 204 || conn->code == 304) {
+				conn->state = PARSE_DONE;
+			} else if (toLower(conn->headers["transfer-encoding"]).find("chunked") != std::string::npos) {
+				conn->state = PARSE_CHUNK_SIZE;
+			} else if (conn->headers.count("content-length")) {
+				conn->remaining = strtoull(conn->headers["content-length"].c_str(), nullptr, 10);
+				conn->request->expected = conn->remaining;
+				conn->state = conn->remaining ? PARSE_LENGTH : PARSE_DONE;
+			} else {
+				conn->state = PARSE_UNTIL_CLOSE;
+				conn->keepalive = false;
+			}
+		} else if (conn->state == PARSE_LENGTH || conn->state == PARSE_CHUNK_DATA) {
+			if (available == 0)
+				break;
+
+			size_t take = available < conn->remaining ? available : conn->remaining;
+			conn->body.append(in, conn->inpos, take);
+			conn->inpos += take;
+			conn->remaining -= take;
+
+			if (conn->remaining == 0)
+				conn->state = conn->state == PARSE_LENGTH ? PARSE_DONE : PARSE_CHUNK_END;
+		} else if (conn->state == PARSE_CHUNK_SIZE) {
+			size_t end = in.find("\r\n", conn->inpos);
+			if (end == std::string::npos)
+				return available < 1024;
+
+			char *parsed;
+			conn->remaining = strtoull(in.c_str() + conn->inpos, &parsed, 16);
+			if (parsed == in.c_str() + conn->inpos)
+				return false;
+
+			conn->inpos = end + 2;
+			conn->state = conn->remaining ? PARSE_CHUNK_DATA : PARSE_TRAILER;
+		} else if (conn->state == PARSE_CHUNK_END) {
+			if (available < 2)
+				break;
+			if (in.compare(conn->inpos, 2, "\r\n") != 0)
+				return false;
+
+			conn->inpos += 2;
+			conn->state = PARSE_CHUNK_SIZE;
+		} else if (conn->state == PARSE_TRAILER) {
+			size_t end = in.find("\r\n", conn->inpos);
+			if (end == std::string::npos)
+				break;
+
+			// An empty line terminates the trailer section
+			if (end == conn->inpos)
+				conn->state = PARSE_DONE;
+			conn->inpos = end + 2;
+		} else if (conn->state == PARSE_UNTIL_CLOSE) {
+			conn->body.append(in, conn->inpos, available);
+			conn->inpos += available;
+			break;
+		}
+	}
+
+	conn->request->received = conn->body.size();
+
+	// Drop consumed data so the buffer doesn't grow across the body
+	if (conn->inpos > 0 && conn->state != PARSE_HEAD) {
+		in.erase(0, conn->inpos);
+		conn->inpos = 0;
+	}
+
+	return true;
+}
+
+void NativeIOLoop::finish(NativeConnection *conn) {
+	std::shared_ptr<NativeRequest> req = conn->request;
+
+	req->code = conn->code;
+	req->responseheaders.swap(conn->headers);
+	req->responsebody.swap(conn->body);
+	req->successful = true;
+	req->completedtime = nowMicros();
+	req->done = true;
+	completedany = true;
+
+	conn->request.reset();
+
+	NativeHost& host = hosts[conn->key];
+
+	// Leftover bytes after a complete response mean we lost track of framing
+	if (conn->keepalive && conn->in.size() == conn->inpos) {
+		conn->in.clear();
+		conn->inpos = 0;
+		conn->deadline = nowMillis() + IDLE_TIMEOUT;
+		host.idle.push_back(conn);
+		watch(conn, EPOLLIN | EPOLLRDHUP);
+	} else {
+		closeConnection(conn);
+	}
+
+	schedule(host);
+}
+
+void NativeIOLoop::fail(NativeConnection *conn) {
+	std::shared_ptr<NativeRequest> req = conn->request;
+	NativeHost& host = hosts[conn->key];
+
+	conn->request.reset();
+	closeConnection(conn);
+
+	// A pooled connection may have been closed by the server just before
+	// we reused it. Give the request one more try on a fresh connection.
+	if (conn->reused && !conn->gotbytes && !req->retried) {
+		req->retried = true;
+		host.pending.push_front(req);
+	} else {
+		failRequest(req);
+	}
+
+	schedule(host);
+}
+
+// The connection was refused or unreachable: try the host's next address
+// with the same request, and fail it once none are left
+void NativeIOLoop::connectFailed(NativeConnection *conn) {
+	std::shared_ptr<NativeRequest> req = conn->request;
+	NativeHost& host = hosts[conn->key];
+	size_t next = conn->address + 1;
+
+	conn->request.reset();
+	closeConnection(conn);
+
+	if (!openConnection(host, req, next)) {
+		failRequest(req);
+		schedule(host);
+	}
+}
+
+void NativeIOLoop::closeConnection(NativeConnection *conn) {
+	// Already closed earlier in the same pass
+	if (conn->fd < 0)
+		return;
+
+	NativeHost& host = hosts[conn->key];
+
+	for (auto it = host.idle.begin(); it != host.idle.end(); ++it) {
+		if (*it == conn) {
+			host.idle.erase(it);
+			break;
+		}
+	}
+
+	for (auto it = connections.begin(); it != connections.end(); ++it) {
+		if (*it == conn) {
+			connections.erase(it);
+			break;
+		}
+	}
+
+	host.connections--;
+
+	epoll_ctl(epollfd, EPOLL_CTL_DEL, conn->fd, nullptr);
+	close(conn->fd);
+	conn->fd = -1;
+
+	// Events for this connection may still be pending in the current batch
+	graveyard.push_back(conn);
+}
+
+void NativeIOLoop::checkTimeouts() {
+	uint64 now = nowMillis();
+	std::vector<NativeConnection *> expired;
+
+	auto isExpired = [now](NativeConnection *conn) {
+		return conn->deadline <= now || (conn->request && conn->request->expires && conn->request->expires <= now);
+	};
+
+	for (NativeConnection *conn : connections) {
+		if (isExpired(conn))
+			expired.push_back(conn);
+	}
+
+	for (NativeConnection *conn : expired) {
+		// Failing an earlier one may have closed this connection, or handed
+		// it a pending request with a fresh deadline
+		if (conn->fd < 0 || !isExpired(conn))
+			continue;
+
+		if (conn->request) {
+			// Don't retry timeouts, the server might still be processing it
+			conn->reused = false;
+			fail(conn);
+		} else {
+			closeConnection(conn);
+		}
+	}
+
+	// Requests still queued for a connection, or for their host's lookup,
+	// run out just the same
+	for (auto& entry : hosts) {
+		std::deque<std::shared_ptr<NativeRequest>>& pending = entry.second.pending;
+
+		for (auto it = pending.begin(); it != pending.end();) {
+			if ((*it)->expires && (*it)->expires <= now) {
+				failRequest(*it);
+				it = pending.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+}
+
+std::shared_ptr<NativeRequest> NativeBackend::find(HTTPRequestHandle request) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = handles.find(request);
+
+	if (it == handles.end())
+		return nullptr;
+
+	return it->second;
+}
+
+NativeBackend::NativeBackend() : loop(new NativeIOLoop()) {
+}
+
+NativeBackend::~NativeBackend() {
+}
+
+HTTPRequestHandle NativeBackend::createRequest(EHTTPMethod method, const char *url) {
+	std::shared_ptr<NativeRequest> req = std::make_shared<NativeRequest>();
+
+	if (!methodName(method) || !parseURL(url, req.get()))
+		return INVALID_HTTPREQUEST_HANDLE;
+
+	req->method = method;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	req->handle = nexthandle++;
+	handles[req->handle] = req;
+
+	return req->handle;
+}
+
+bool NativeBackend::setHeader(HTTPRequestHandle request, const char *name, const char *value) {
+	std::shared_ptr<NativeRequest> req = find(request);
+
+	if (!req || req->sent || !validHeaderName(name) || !validHeaderValue(value))
+		return false;
+
+	req->headers[name] = value;
+	return true;
+}
+
+bool NativeBackend::setUserAgent(HTTPRequestHandle request, const char *useragent) {
+	std::shared_ptr<NativeRequest> req = find(request);
+
+	if (!req || req->sent || !validHeaderValue(useragent))
+		return false;
+
+	req->useragent = useragent;
+	return true;
+}
+
+bool NativeBackend::setParameter(HTTPRequestHandle request, const char *name, const char *value) {
+	std::shared_ptr<NativeRequest> req = find(request);
+
+	if (!req || req->sent)
+		return false;
+
+	req->parameters[name] = value;
+	return true;
+}
+
+bool NativeBackend::setBody(HTTPRequestHandle request, const char *type, uint8 *body, uint32 size) {
+	std::shared_ptr<NativeRequest> req = find(request);
+
+	if (!req || req->sent || !validHeaderValue(type))
+		return false;
+
+	req->type = type;
+	req->body.assign(reinterpret_cast<char *>(body), size);
+	req->hasbody = true;
+	return true;
+}
+
+bool NativeBackend::setTimeout(HTTPRequestHandle request, uint32 ms) {
+	std::shared_ptr<NativeRequest> req = find(request);
+
+	if (!req || req->sent)
+		return false;
+
+	req->timeout = ms;
+	return true;
+}
+
+bool NativeBackend::sendRequest(HTTPRequestHandle request, SteamAPICall_t *apicall) {
+	std::shared_ptr<NativeRequest> req = find(request);
+
+	if (!req || req->sent)
+		return false;
+
+	serializeRequest(req.get());
+	req->sent = true;
+
+	if (req->timeout)
+		req->expires = nowMillis() + req->timeout;
+
+	// There is exactly one call per request, so the handle doubles as call id
+	*apicall = request;
+	loop->submit(req);
+
+	return true;
+}
+
+bool NativeBackend::isCompleted(SteamAPICall_t apicall, bool *failed) {
+	std::shared_ptr<NativeRequest> req = find(apicall);
+
+	if (!req) {
+		*failed = true;
+		return true;
+	}
+
+	if (!req->done)
+		return false;
+
+	// Transport errors are reported through m_bRequestSuccessful, like Steam does
+	*failed = false;
+	return true;
+}
+
+std::string NativeBackend::getFailureReason(SteamAPICall_t /* apicall */) {
+	return "The API call handle is invalid.";
+}
+
+bool NativeBackend::getResult(SteamAPICall_t apicall, HTTPRequestCompleted_t *result, bool *failed) {
+	std::shared_ptr<NativeRequest> req = find(apicall);
+
+	if (!req || !req->done)
+		return false;
+
+	*failed = false;
+	result->m_hRequest = req->handle;
+	result->m_ulContextValue = 0;
+	result->m_bRequestSuccessful = req->successful;
+	result->m_eStatusCode = static_cast<EHTTPStatusCode>(req->code);
+	result->m_unBodySize = req->responsebody.size();
+
+	return true;
+}
+
+uint64 NativeBackend::completionTime(SteamAPICall_t apicall) {
+	std::shared_ptr<NativeRequest> req = find(apicall);
+
+	if (!req || !req->done)
+		return 0;
+
+	return req->completedtime;
+}
+
+void NativeBackend::setCompletionListener(std::function<void()> listener) {
+	loop->setListener(listener);
+}
+
+bool NativeBackend::getDownloadProgress(HTTPRequestHandle request, float *percent, uint64 *received) {
+	std::shared_ptr<NativeRequest> req = find(request);
+
+	if (!req)
+		return false;
+
+	uint64 expected = req->expected;
+	*received = req->received;
+	*percent = req->done ? 100 : expected ? 100.0f * *received / expected : -1;
+
+	return true;
+}
+
+bool NativeBackend::getBodyData(HTTPRequestHandle request, uint8 *buffer, uint32 size) {
+	std::shared_ptr<NativeRequest> req = find(request);
+
+	if (!req || !req->done || size < req->responsebody.size())
+		return false;
+
+	memcpy(buffer, req->responsebody.data(), req->responsebody.size());
+	return true;
+}
+
+bool NativeBackend::getHeaderSize(HTTPRequestHandle request, const char *name, uint32 *size) {
+	std::shared_ptr<NativeRequest> req = find(request);
+
+	if (!req || !req->done)
+		return false;
+
+	auto it = req->responseheaders.find(toLower(name));
+	if (it == req->responseheaders.end())
+		return false;
+
+	*size = it->second.size();
+	return true;
+}
+
+bool NativeBackend::getHeaderValue(HTTPRequestHandle request, const char *name, uint8 *buffer, uint32 size) {
+	std::shared_ptr<NativeRequest> req = find(request);
+
+	if (!req || !req->done)
+		return false;
+
+	auto it = req->responseheaders.find(toLower(name));
+	if (it == req->responseheaders.end() || size < it->second.size())
+		return false;
+
+	memcpy(buffer, it->second.data(), it->second.size());
+	return true;
+}
+
+bool NativeBackend::releaseRequest(HTTPRequestHandle request) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// The I/O thread holds its own reference while the request is in flight
+	return handles.erase(request) != 0;
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef _NATIVEBACKEND_H
+#define _NATIVEBACKEND_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "backend.h"
+
+// The native backend is built on epoll, so it is only available on Linux.
+#ifdef __linux__
+#define NATIVE_BACKEND_AVAILABLE
+#endif
+
+struct NativeRequest;
+class NativeIOLoop;
+
+// Backend that talks HTTP/1.1 by itself instead of going through Steam.
+// All socket work happens on a dedicated I/O thread; persistent connections
+// are pooled per host and reused for subsequent requests to the same host.
+// Only plain http:// URLs are supported.
+class NativeBackend : public HTTPBackend {
+	std::mutex mutex;
+	std::map<HTTPRequestHandle, std::shared_ptr<NativeRequest>> handles;
+	HTTPRequestHandle nexthandle = 1;
+
+	std::unique_ptr<NativeIOLoop> loop;
+
+	std::shared_ptr<NativeRequest> find(HTTPRequestHandle request);
+
+public:
+	NativeBackend();
+	~NativeBackend();
+
+	HTTPRequestHandle createRequest(EHTTPMethod method, const char *url);
+	bool setHeader(HTTPRequestHandle request, const char *name, const char *value);
+	bool setUserAgent(HTTPRequestHandle request, const char *useragent);
+	bool setParameter(HTTPRequestHandle request, const char *name, const char *value);
+	bool setBody(HTTPRequestHandle request, const char *type, uint8 *body, uint32 size);
+	bool sendRequest(HTTPRequestHandle request, SteamAPICall_t *apicall);
+	bool setTimeout(HTTPRequestHandle request, uint32 ms);
+
+	bool isCompleted(SteamAPICall_t apicall, bool *failed);
+	std::string getFailureReason(SteamAPICall_t apicall);
+	bool getResult(SteamAPICall_t apicall, HTTPRequestCompleted_t *result, bool *failed);
+	uint64 completionTime(SteamAPICall_t apicall);
+	bool getDownloadProgress(HTTPRequestHandle request, float *percent, uint64 *received);
+	void setCompletionListener(std::function<void()> listener);
+
+	bool getBodyData(HTTPRequestHandle request, uint8 *buffer, uint32 size);
+	bool getHeaderSize(HTTPRequestHandle request, const char *name, uint32 *size);
+	bool getHeaderValue(HTTPRequestHandle request, const char *name, uint8 *buffer, uint32 size);
+
+	bool releaseRequest(HTTPRequestHandle request);
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include "prepared.h"
+#include "steamhttp.h"
+#include "util.h"
+#include "lua.h"
+
+// Type id of the metatable, from CreateMetaTable
+static int preparedtype = -1;
+
+/*
+ * STEAMHTTP.Prepare(request)
+ * Reads everything of a request table except the handlers and the body
+ * once, and returns a template for sending it again and again. Returns
+ * nil and the reason if the table is invalid.
+ */
+LUA_FUNCTION(Prepare) {
+	LUA->CheckType(1, Lua::Type::TABLE);
+
+	HTTPRequest request = defaultRequest();
+	std::string error;
+
+	// Requests sent through the template count for whoever prepared it
+	request.addon = callerAddon(LUA, 2);
+
+	if (!readRequestOptions(LUA, 1, request, &error)) {
+		LUA->PushNil();
+		LUA->PushString(error.c_str());
+		return 2;
+	}
+
+	if (request.url.empty()) {
+		LUA->PushNil();
+		LUA->PushString("invalid url");
+		return 2;
+	}
+
+	LUA->PushUserType(new HTTPRequest(std::move(request)), preparedtype);
+	return 1;
+}
+
+/*
+ * template:Send([request])
+ * Sends a copy of the template. Only the handlers, parameters, body, json
+ * and msgpack are read from the table. Returns whether the request was
+ * sent, like STEAMHTTP.
+ */
+LUA_FUNCTION(preparedSend) {
+	HTTPRequest *prepared = LUA->GetUserType<HTTPRequest>(1, preparedtype);
+
+	if (!prepared)
+		LUA->ArgError(1, "STEAMHTTP template expected");
+
+	HTTPRequest request = *prepared;
+	std::string error;
+
+	request.timing.parsed = nowMicros();
+
+	if (LUA->IsType(2, Lua::Type::TABLE)) {
+		readRequestHandlers(LUA, 2, request);
+
+		if (!readRequestBody(LUA, 2, request, &error)) {
+			failRequest(LUA, request, error);
+			LUA->PushBool(false);
+			return 1;
+		}
+	}
+
+	submitRequest(std::move(request));
+	LUA->PushBool(true);
+	return 1;
+}
+
+LUA_FUNCTION(preparedGC) {
+	delete LUA->GetUserType<HTTPRequest>(1, preparedtype);
+	LUA->SetUserType(1, nullptr);
+	return 0;
+}
+
+void registerPreparedRequest(Lua::ILuaBase *LUA) {
+	preparedtype = LUA->CreateMetaTable("STEAMHTTPTemplate");
+
+	// Methods live on the metatable itself
+	LUA->Push(-1);
+	LUA->SetField(-2, "__index");
+
+	LUA->PushCFunction(preparedSend);
+	LUA->SetField(-2, "Send");
+	LUA->PushCFunction(preparedGC);
+	LUA->SetField(-2, "__gc");
+
+	LUA->Pop();
+}
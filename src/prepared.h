@@ -0,0 +1,12 @@
+#ifndef _PREPARED_H
+#define _PREPARED_H
+
+#include <GarrysMod/Lua/Interface.h>
+
+// Creates the metatable of request templates, on module load
+void registerPreparedRequest(GarrysMod::Lua::ILuaBase *LUA);
+
+// STEAMHTTP.Prepare{...}, see prepared.cpp
+int Prepare(lua_State *L);
+
+#endif
@@ -0,0 +1,56 @@
+#include <cstdio>
+#include <map>
+#include "profiler.h"
+#include "lua.h"
+
+struct HandlerStats {
+	uint64 count;
+	uint64 total;
+	uint64 max;
+};
+
+// Only ever touched from the game thread
+static std::map<std::string, HandlerStats> handlers;
+static uint64 slowthreshold = 5000;
+
+void recordHandlerTime(Lua::ILuaBase *LUA, const std::string& source, const std::string& url, uint64 micros) {
+	HandlerStats& stats = handlers[source];
+
+	stats.count++;
+	stats.total += micros;
+	if (micros > stats.max)
+		stats.max = micros;
+
+	if (slowthreshold && micros > slowthreshold) {
+		char duration[32];
+		snprintf(duration, sizeof(duration), "%.2f ms", micros / 1000.0);
+		LOG("Slow handler for " + url + " took " + duration + ", defined at " + source);
+	}
+}
+
+void setSlowHandlerThreshold(uint64 micros) {
+	slowthreshold = micros;
+}
+
+void pushHandlerStats(Lua::ILuaBase *LUA) {
+	LUA->CreateTable();
+
+	for (auto const& e : handlers) {
+		LUA->CreateTable();
+
+		LUA->PushNumber(e.second.count);
+		LUA->SetField(-2, "count");
+		LUA->PushNumber(e.second.total / 1000.0);
+		LUA->SetField(-2, "total");
+		LUA->PushNumber(e.second.count ? e.second.total / 1000.0 / e.second.count : 0);
+		LUA->SetField(-2, "avg");
+		LUA->PushNumber(e.second.max / 1000.0);
+		LUA->SetField(-2, "max");
+
+		LUA->SetField(-2, e.first.c_str());
+	}
+}
+
+void resetHandlerStats() {
+	handlers.clear();
+}
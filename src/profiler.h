@@ -0,0 +1,19 @@
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#include <string>
+#include <GarrysMod/Lua/LuaBase.h>
+#include "steamtypes.h"
+
+// Adds a handler run to the per-source totals, and logs it if it took
+// longer than the slow handler threshold. `source` is "file:line".
+void recordHandlerTime(GarrysMod::Lua::ILuaBase *LUA, const std::string& source, const std::string& url, uint64 micros);
+
+// Handlers running longer than this are logged, 0 to never log
+void setSlowHandlerThreshold(uint64 micros);
+
+// Pushes { [source] = { count, total, avg, max } } with times in milliseconds
+void pushHandlerStats(GarrysMod::Lua::ILuaBase *LUA);
+void resetHandlerStats();
+
+#endif
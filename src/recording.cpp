@@ -0,0 +1,263 @@
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include "recording.h"
+#include "util.h"
+
+#define RECORDING_MAGIC "SHRL"
+#define RECORDING_VERSION 1
+
+HTTPRecorder recorder;
+
+uint64 hashBody(const std::string& body) {
+	uint64 hash = 14695981039346656037ULL;
+
+	for (unsigned char c : body) {
+		hash ^= c;
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+static void writeVarint(std::string *out, uint64 value) {
+	while (value >= 0x80) {
+		out->push_back((char)(value | 0x80));
+		value >>= 7;
+	}
+
+	out->push_back((char)value);
+}
+
+static void writeString(std::string *out, const std::string& str) {
+	writeVarint(out, str.size());
+	out->append(str);
+}
+
+static void writeMap(std::string *out, const std::map<std::string, std::string>& map) {
+	writeVarint(out, map.size());
+
+	for (auto const& e : map) {
+		writeString(out, e.first);
+		writeString(out, e.second);
+	}
+}
+
+static bool readVarint(const char **data, const char *end, uint64 *value) {
+	*value = 0;
+
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (*data >= end)
+			return false;
+
+		unsigned char byte = *(*data)++;
+		*value |= (uint64)(byte & 0x7f) << shift;
+
+		if (!(byte & 0x80))
+			return true;
+	}
+
+	return false;
+}
+
+static bool readString(const char **data, const char *end, std::string *str) {
+	uint64 size;
+
+	if (!readVarint(data, end, &size) || size > (uint64)(end - *data))
+		return false;
+
+	str->assign(*data, size);
+	*data += size;
+	return true;
+}
+
+static bool readMap(const char **data, const char *end, std::map<std::string, std::string> *map) {
+	uint64 count;
+	std::string key, value;
+
+	if (!readVarint(data, end, &count))
+		return false;
+
+	for (uint64 i = 0; i < count; i++) {
+		if (!readString(data, end, &key) || !readString(data, end, &value))
+			return false;
+
+		(*map)[key] = value;
+	}
+
+	return true;
+}
+
+// Layout of an exchange:
+//   flags (bit 0: successful, bit 1: full request body)
+//   offset, duration, method, url, request headers,
+//   request body or (body size, body hash),
+//   then either (code, response headers, response body) or fail reason
+void encodeExchange(std::string *out, const RecordedExchange& exchange) {
+	writeVarint(out, (exchange.successful ? 1 : 0) | (exchange.hasbody ? 2 : 0));
+	writeVarint(out, exchange.offset);
+	writeVarint(out, exchange.duration);
+	writeVarint(out, exchange.method);
+	writeString(out, exchange.url);
+	writeMap(out, exchange.headers);
+
+	if (exchange.hasbody) {
+		writeString(out, exchange.body);
+	} else {
+		writeVarint(out, exchange.bodysize);
+		writeVarint(out, exchange.bodyhash);
+	}
+
+	if (exchange.successful) {
+		writeVarint(out, exchange.code);
+		writeMap(out, exchange.responseheaders);
+		writeString(out, exchange.responsebody);
+	} else {
+		writeString(out, exchange.failreason);
+	}
+}
+
+bool decodeExchange(const char **data, const char *end, RecordedExchange *exchange) {
+	uint64 flags, method, code;
+
+	if (!readVarint(data, end, &flags)
+	    || !readVarint(data, end, &exchange->offset)
+	    || !readVarint(data, end, &exchange->duration)
+	    || !readVarint(data, end, &method)
+	    || !readString(data, end, &exchange->url)
+	    || !readMap(data, end, &exchange->headers))
+		return false;
+
+	exchange->method = (EHTTPMethod)method;
+	exchange->successful = flags & 1;
+	exchange->hasbody = flags & 2;
+
+	if (exchange->hasbody) {
+		if (!readString(data, end, &exchange->body))
+			return false;
+		exchange->bodysize = exchange->body.size();
+		exchange->bodyhash = hashBody(exchange->body);
+	} else {
+		if (!readVarint(data, end, &exchange->bodysize) || !readVarint(data, end, &exchange->bodyhash))
+			return false;
+	}
+
+	if (!exchange->successful)
+		return readString(data, end, &exchange->failreason);
+
+	if (!readVarint(data, end, &code)
+	    || !readMap(data, end, &exchange->responseheaders)
+	    || !readString(data, end, &exchange->responsebody))
+		return false;
+
+	exchange->code = code;
+	return true;
+}
+
+bool loadRecording(const std::string& path, std::vector<RecordedExchange> *exchanges) {
+	std::ifstream file(path, std::ios::binary);
+
+	if (!file)
+		return false;
+
+	std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	const char *data = contents.data();
+	const char *end = data + contents.size();
+
+	if (contents.size() < 5 || contents.compare(0, 4, RECORDING_MAGIC) != 0 || data[4] != RECORDING_VERSION)
+		return false;
+
+	data += 5;
+
+	while (data < end) {
+		RecordedExchange exchange;
+
+		// A truncated last record (e.g. after a crash) is not an error
+		if (!decodeExchange(&data, end, &exchange))
+			break;
+
+		exchanges->push_back(exchange);
+	}
+
+	return true;
+}
+
+HTTPRecorder::~HTTPRecorder() {
+	stop();
+}
+
+bool HTTPRecorder::start(const std::string& path, bool fullbodies) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (file)
+		return false;
+
+	file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	fwrite(RECORDING_MAGIC, 1, 4, file);
+	fputc(RECORDING_VERSION, file);
+
+	bodies = fullbodies;
+	started = nowMicros();
+	running = true;
+	writer = std::thread(&HTTPRecorder::writeLoop, this);
+
+	return true;
+}
+
+void HTTPRecorder::stop() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (!file)
+		return;
+
+	running = false;
+	writer.join();
+
+	fclose(file);
+	file = nullptr;
+}
+
+bool HTTPRecorder::active() {
+	return running;
+}
+
+uint64 HTTPRecorder::offset(uint64 sendtime) {
+	return sendtime > started ? sendtime - started : 0;
+}
+
+bool HTTPRecorder::fullBodies() {
+	return bodies;
+}
+
+void HTTPRecorder::record(const RecordedExchange& exchange) {
+	std::string encoded;
+
+	encodeExchange(&encoded, exchange);
+
+	// Under the lock, so an exchange either goes out before stop() drains
+	// the queue or is dropped. It can't end up in the next recording.
+	std::lock_guard<std::mutex> lock(mutex);
+	if (file)
+		pending.push(std::move(encoded));
+}
+
+void HTTPRecorder::writeLoop() {
+	while (true) {
+		// Check before draining, so that nothing queued before stop() is lost
+		bool stopping = !running;
+
+		while (!pending.empty()) {
+			std::string encoded = pending.pop();
+			fwrite(encoded.data(), 1, encoded.size(), file);
+		}
+
+		if (stopping)
+			break;
+
+		fflush(file);
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+}
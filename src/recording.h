@@ -0,0 +1,85 @@
+#ifndef _RECORDING_H
+#define _RECORDING_H
+
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "isteamhttp.h"
+#include "lockqueue.h"
+
+// One recorded request/response pair.
+struct RecordedExchange {
+	// Microseconds since the recording was started, at the time of sending
+	uint64 offset = 0;
+
+	// Microseconds between sending and completion
+	uint64 duration = 0;
+
+	EHTTPMethod method = k_EHTTPMethodGET;
+	std::string url;
+	std::map<std::string, std::string> headers;
+
+	// Either the full body is kept, or only its size and hash
+	bool hasbody = false;
+	std::string body;
+	uint64 bodysize = 0;
+	uint64 bodyhash = 0;
+
+	// False if the request failed, `failreason` says why
+	bool successful = false;
+	std::string failreason;
+
+	long code = 0;
+	std::map<std::string, std::string> responseheaders;
+	std::string responsebody;
+};
+
+// FNV-1a, good enough to tell request bodies apart
+uint64 hashBody(const std::string& body);
+
+// Recording log format:
+//   "SHRL" magic, one version byte, then a sequence of exchanges.
+// Integers are LEB128 varints, strings are a varint length plus bytes.
+void encodeExchange(std::string *out, const RecordedExchange& exchange);
+bool decodeExchange(const char **data, const char *end, RecordedExchange *exchange);
+
+// Reads a whole recording log
+bool loadRecording(const std::string& path, std::vector<RecordedExchange> *exchanges);
+
+// Appends exchanges to a recording log. Encoding happens on the caller's
+// thread, writing to disk on a background thread.
+class HTTPRecorder {
+	std::mutex mutex;
+	FILE *file = nullptr;
+	bool bodies = false;
+	uint64 started = 0;
+
+	LockableQueue<std::string> pending;
+	std::thread writer;
+	std::atomic<bool> running{false};
+
+	void writeLoop();
+
+public:
+	~HTTPRecorder();
+
+	// Starts recording into `path`. With `fullbodies`, request bodies are
+	// stored completely instead of as a size and hash.
+	bool start(const std::string& path, bool fullbodies);
+	void stop();
+	bool active();
+
+	// Offset to store for a request sent at `sendtime` (see nowMicros)
+	uint64 offset(uint64 sendtime);
+	bool fullBodies();
+
+	void record(const RecordedExchange& exchange);
+};
+
+extern HTTPRecorder recorder;
+
+#endif
@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <cctype>
+#include "responseobject.h"
+#include "lua.h"
+#include "util.h"
+
+// Type id of the metatable, from CreateMetaTable
+static int responsetype = -1;
+
+static bool equalsIgnoringCase(const std::string& a, const char *b) {
+	size_t i = 0;
+
+	for (; i < a.size() && b[i]; i++) {
+		if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i]))
+			return false;
+	}
+
+	return i == a.size() && !b[i];
+}
+
+// The response behind the object at stack position 1, errors if it was closed
+static HTTPResponse *checkResponse(Lua::ILuaBase *LUA) {
+	HTTPResponse *response = LUA->GetUserType<HTTPResponse>(1, responsetype);
+
+	if (!response)
+		LUA->ArgError(1, "open STEAMHTTP response expected");
+
+	return response;
+}
+
+LUA_FUNCTION(responseStatus) {
+	LUA->PushNumber(checkResponse(LUA)->code);
+	return 1;
+}
+
+LUA_FUNCTION(responseBody) {
+	HTTPResponse *response = checkResponse(LUA);
+	LUA->PushString(response->body.c_str(), response->body.size());
+	return 1;
+}
+
+LUA_FUNCTION(responseSize) {
+	LUA->PushNumber(checkResponse(LUA)->body.size());
+	return 1;
+}
+
+// :Header(name), header names are compared case-insensitively
+LUA_FUNCTION(responseHeader) {
+	HTTPResponse *response = checkResponse(LUA);
+	const char *name = LUA->CheckString(2);
+
+	for (auto const& e : response->headers) {
+		if (equalsIgnoringCase(e.first, name)) {
+			LUA->PushString(e.second.c_str(), e.second.size());
+			return 1;
+		}
+	}
+
+	LUA->PushNil();
+	return 1;
+}
+
+LUA_FUNCTION(responseHeaders) {
+	mapToLuaTable(LUA, checkResponse(LUA)->headers);
+	return 1;
+}
+
+// :Json(), the decoded body if the request had `decode` or `extract`,
+// otherwise the body is parsed as JSON right here. Returns nil and the
+// error if it isn't valid.
+LUA_FUNCTION(responseJson) {
+	HTTPResponse *response = checkResponse(LUA);
+
+	if (!response->decoded) {
+		std::string error;
+
+		if (!parseJSON(response->body.data(), response->body.size(), &response->json, &error)) {
+			response->json = JSONTape();
+			LUA->PushNil();
+			LUA->PushString(("JSON Error: " + error).c_str());
+			return 2;
+		}
+
+		response->decoded = true;
+	}
+
+	pushJSON(LUA, response->json);
+	return 1;
+}
+
+// :Sub(i[, j]), like string.sub on the body
+LUA_FUNCTION(responseSub) {
+	HTTPResponse *response = checkResponse(LUA);
+	long long size = response->body.size();
+	// Anything past either end of the body acts like the end itself
+	long long i = (long long)clampNumber(LUA->CheckNumber(2), -size - 1, size + 1);
+	long long j = LUA->IsType(3, Lua::Type::NUMBER) ? (long long)clampNumber(LUA->GetNumber(3), -size - 1, size + 1) : -1;
+
+	if (i < 0)
+		i = std::max(size + i + 1, 1LL);
+	else if (i == 0)
+		i = 1;
+
+	if (j < 0)
+		j = size + j + 1;
+	else if (j > size)
+		j = size;
+
+	if (i > j) {
+		LUA->PushString("", 0);
+		return 1;
+	}
+
+	LUA->PushString(response->body.c_str() + i - 1, j - i + 1);
+	return 1;
+}
+
+// :Close(), frees the response before the garbage collector gets to it
+LUA_FUNCTION(responseClose) {
+	HTTPResponse *response = LUA->GetUserType<HTTPResponse>(1, responsetype);
+
+	delete response;
+	LUA->SetUserType(1, nullptr);
+	return 0;
+}
+
+LUA_FUNCTION(responseToString) {
+	HTTPResponse *response = LUA->GetUserType<HTTPResponse>(1, responsetype);
+
+	if (response)
+		LUA->PushString(("STEAMHTTP response: " + std::to_string(response->code) + ", " + std::to_string(response->body.size()) + " bytes").c_str());
+	else
+		LUA->PushString("STEAMHTTP response: closed");
+
+	return 1;
+}
+
+void registerResponseObject(Lua::ILuaBase *LUA) {
+	responsetype = LUA->CreateMetaTable("STEAMHTTPResponse");
+
+	// Methods live on the metatable itself
+	LUA->Push(-1);
+	LUA->SetField(-2, "__index");
+
+	LUA->PushCFunction(responseStatus);
+	LUA->SetField(-2, "Status");
+	LUA->PushCFunction(responseBody);
+	LUA->SetField(-2, "Body");
+	LUA->PushCFunction(responseHeader);
+	LUA->SetField(-2, "Header");
+	LUA->PushCFunction(responseHeaders);
+	LUA->SetField(-2, "Headers");
+	LUA->PushCFunction(responseJson);
+	LUA->SetField(-2, "Json");
+	LUA->PushCFunction(responseSize);
+	LUA->SetField(-2, "Size");
+	LUA->PushCFunction(responseSub);
+	LUA->SetField(-2, "Sub");
+	LUA->PushCFunction(responseClose);
+	LUA->SetField(-2, "Close");
+	LUA->PushCFunction(responseClose);
+	LUA->SetField(-2, "__gc");
+	LUA->PushCFunction(responseToString);
+	LUA->SetField(-2, "__tostring");
+
+	LUA->Pop();
+}
+
+void pushResponseObject(Lua::ILuaBase *LUA, HTTPResponse&& response) {
+	LUA->PushUserType(new HTTPResponse(std::move(response)), responsetype);
+}
@@ -0,0 +1,16 @@
+#ifndef _RESPONSEOBJECT_H
+#define _RESPONSEOBJECT_H
+
+#include <GarrysMod/Lua/Interface.h>
+#include "http.h"
+
+// Creates the metatable of response objects, on module load
+void registerResponseObject(GarrysMod::Lua::ILuaBase *LUA);
+
+// Pushes a response object that takes over `response`. Its methods
+// (Status, Body, Header, Headers, Json, Size, Sub, Close) only create Lua
+// values for what they are asked for. The response is freed on Close or
+// when the object is garbage collected.
+void pushResponseObject(GarrysMod::Lua::ILuaBase *LUA, HTTPResponse&& response);
+
+#endif
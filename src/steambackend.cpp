@@ -0,0 +1,114 @@
+#include "steam_api.h"
+#include "steambackend.h"
+
+// Every call through these two interfaces is an IPC round trip to the
+// Steam client. Counted per thread, so callers can attribute the calls
+// they made themselves by taking differences.
+static thread_local uint64 ipccalls = 0;
+
+static ISteamHTTP *steamHTTP() {
+	ipccalls++;
+	return SteamHTTP();
+}
+
+static ISteamUtils *steamUtils() {
+	ipccalls++;
+	return SteamUtils();
+}
+
+HTTPRequestHandle SteamBackend::createRequest(EHTTPMethod method, const char *url) {
+	return steamHTTP()->CreateHTTPRequest(method, url);
+}
+
+bool SteamBackend::setHeader(HTTPRequestHandle request, const char *name, const char *value) {
+	return steamHTTP()->SetHTTPRequestHeaderValue(request, name, value);
+}
+
+bool SteamBackend::setUserAgent(HTTPRequestHandle request, const char *useragent) {
+	return steamHTTP()->SetHTTPRequestUserAgentInfo(request, useragent);
+}
+
+bool SteamBackend::setParameter(HTTPRequestHandle request, const char *name, const char *value) {
+	return steamHTTP()->SetHTTPRequestGetOrPostParameter(request, name, value);
+}
+
+bool SteamBackend::setBody(HTTPRequestHandle request, const char *type, uint8 *body, uint32 size) {
+	return steamHTTP()->SetHTTPRequestRawPostBody(request, type, body, size);
+}
+
+bool SteamBackend::sendRequest(HTTPRequestHandle request, SteamAPICall_t *apicall) {
+	return steamHTTP()->SendHTTPRequest(request, apicall);
+}
+
+bool SteamBackend::setTimeout(HTTPRequestHandle request, uint32 ms) {
+	return steamHTTP()->SetHTTPRequestAbsoluteTimeoutMS(request, ms);
+}
+
+HTTPCookieContainerHandle SteamBackend::createCookieContainer(bool allowresponses) {
+	return steamHTTP()->CreateCookieContainer(allowresponses);
+}
+
+bool SteamBackend::releaseCookieContainer(HTTPCookieContainerHandle container) {
+	return steamHTTP()->ReleaseCookieContainer(container);
+}
+
+bool SteamBackend::setCookieContainer(HTTPRequestHandle request, HTTPCookieContainerHandle container) {
+	return steamHTTP()->SetHTTPRequestCookieContainer(request, container);
+}
+
+bool SteamBackend::isCompleted(SteamAPICall_t apicall, bool *failed) {
+	return steamUtils()->IsAPICallCompleted(apicall, failed);
+}
+
+std::string SteamBackend::getFailureReason(SteamAPICall_t apicall) {
+	switch (steamUtils()->GetAPICallFailureReason(apicall)) {
+	case k_ESteamAPICallFailureNone:
+		return "No failure.";
+	case k_ESteamAPICallFailureSteamGone:
+		return "The local Steam process has gone away.";
+	case k_ESteamAPICallFailureNetworkFailure:
+		return "Network connection to Steam has been broken.";
+	case k_ESteamAPICallFailureInvalidHandle:
+		return "The API call handle is invalid.";
+	case k_ESteamAPICallFailureMismatchedCallback:
+		return "Mismatched callback type.";
+	}
+
+	return "Unknown failure.";
+}
+
+bool SteamBackend::getResult(SteamAPICall_t apicall, HTTPRequestCompleted_t *result, bool *failed) {
+	return steamUtils()->GetAPICallResult(apicall, result, sizeof(*result), result->k_iCallback, failed);
+}
+
+bool SteamBackend::getDownloadProgress(HTTPRequestHandle request, float *percent, uint64 *received) {
+	// Steam only reports a percentage
+	*received = 0;
+	return steamHTTP()->GetHTTPDownloadProgressPct(request, percent);
+}
+
+bool SteamBackend::getBodyData(HTTPRequestHandle request, uint8 *buffer, uint32 size) {
+	return steamHTTP()->GetHTTPResponseBodyData(request, buffer, size);
+}
+
+bool SteamBackend::getHeaderSize(HTTPRequestHandle request, const char *name, uint32 *size) {
+	return steamHTTP()->GetHTTPResponseHeaderSize(request, name, size);
+}
+
+bool SteamBackend::getHeaderValue(HTTPRequestHandle request, const char *name, uint8 *buffer, uint32 size) {
+	return steamHTTP()->GetHTTPResponseHeaderValue(request, name, buffer, size);
+}
+
+bool SteamBackend::releaseRequest(HTTPRequestHandle request) {
+	return steamHTTP()->ReleaseHTTPRequest(request);
+}
+
+uint64 SteamBackend::ipcCalls() {
+	return ipccalls;
+}
+
+uint64 SteamBackend::reportedIPCCalls() {
+	// Not counted itself, and covers every IPC call of the process,
+	// including the engine's own
+	return SteamUtils()->GetIPCCallCount();
+}
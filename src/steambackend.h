@@ -0,0 +1,36 @@
+#ifndef _STEAMBACKEND_H
+#define _STEAMBACKEND_H
+
+#include "backend.h"
+
+// Backend that forwards everything to the Steam client via ISteamHTTP.
+class SteamBackend : public HTTPBackend {
+public:
+	HTTPRequestHandle createRequest(EHTTPMethod method, const char *url);
+	bool setHeader(HTTPRequestHandle request, const char *name, const char *value);
+	bool setUserAgent(HTTPRequestHandle request, const char *useragent);
+	bool setParameter(HTTPRequestHandle request, const char *name, const char *value);
+	bool setBody(HTTPRequestHandle request, const char *type, uint8 *body, uint32 size);
+	bool sendRequest(HTTPRequestHandle request, SteamAPICall_t *apicall);
+	bool setTimeout(HTTPRequestHandle request, uint32 ms);
+
+	HTTPCookieContainerHandle createCookieContainer(bool allowresponses);
+	bool releaseCookieContainer(HTTPCookieContainerHandle container);
+	bool setCookieContainer(HTTPRequestHandle request, HTTPCookieContainerHandle container);
+
+	bool isCompleted(SteamAPICall_t apicall, bool *failed);
+	std::string getFailureReason(SteamAPICall_t apicall);
+	bool getResult(SteamAPICall_t apicall, HTTPRequestCompleted_t *result, bool *failed);
+	bool getDownloadProgress(HTTPRequestHandle request, float *percent, uint64 *received);
+
+	bool getBodyData(HTTPRequestHandle request, uint8 *buffer, uint32 size);
+	bool getHeaderSize(HTTPRequestHandle request, const char *name, uint32 *size);
+	bool getHeaderValue(HTTPRequestHandle request, const char *name, uint8 *buffer, uint32 size);
+
+	bool releaseRequest(HTTPRequestHandle request);
+
+	uint64 ipcCalls();
+	uint64 reportedIPCCalls();
+};
+
+#endif
@@ -1,9 +1,25 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
 #include <string>
 #include <vector>
 #include "steam_api.h"
 #include "steamhttp.h"
 #include "lockqueue.h"
+#include "recording.h"
+#include "metrics.h"
+#include "trace.h"
+#include "profiler.h"
+#include "inflight.h"
+#include "submission.h"
+#include "completion.h"
+#include "util.h"
 #include "lua.h"
+#include "deflate.h"
+#include "responseobject.h"
+#include "client.h"
+#include "batch.h"
 
 using namespace GarrysMod;
 
@@ -41,9 +57,26 @@ std::string HEADERS[] = {
 	"ETag",
 };
 
-LockableQueue<QueuedRequestData> requests;
+HTTPBackend *backend = nullptr;
 
-void runFailedHandler(Lua::ILuaBase *LUA, int handler, std::string reason) {
+// Calls the handler below its `args` arguments on the stack. The call is
+// timed and attributed to where the handler was defined. Errors are logged
+// instead of raised, so whatever follows the handler (batch and client
+// bookkeeping, the rest of the tick's results) still happens.
+void callHandler(Lua::ILuaBase *LUA, int args, const std::string& url) {
+	LUA->Push(-(args + 1));
+	std::string source = functionSource(LUA);
+
+	uint64 start = nowMicros();
+	if (LUA->PCall(args, 0, 0)) {
+		const char *error = LUA->GetString(-1);
+		LOG("Handler defined at " + source + " failed: " + (error ? error : "(error object is not a string)"));
+		LUA->Pop();
+	}
+	recordHandlerTime(LUA, source, url, nowMicros() - start);
+}
+
+void runFailedHandler(Lua::ILuaBase *LUA, int handler, std::string reason, const std::string& url, const RequestTiming *timing) {
 	if (!handler)
 		return;
 
@@ -54,11 +87,18 @@ void runFailedHandler(Lua::ILuaBase *LUA, int handler, std::string reason) {
 	// Push the argument
 	LUA->PushString(reason.c_str());
 
-	// Call the fail handler with one argument
-	LUA->Call(1, 0);
+	// Call the fail handler with one argument (plus the optional timing)
+	if (timing) {
+		pushRequestTiming(LUA, *timing);
+		callHandler(LUA, 2, url);
+	} else {
+		callHandler(LUA, 1, url);
+	}
 }
 
-void runSuccessHandler(Lua::ILuaBase *LUA, int handler, HTTPResponse response) {
+void runSuccessHandler(Lua::ILuaBase *LUA, int handler, HTTPResponse& response, const std::string& url, const RequestTiming *timing, bool asobject) {
+	int args = 3;
+
 	if (!handler)
 		return;
 
@@ -66,13 +106,26 @@ void runSuccessHandler(Lua::ILuaBase *LUA, int handler, HTTPResponse response) {
 	LUA->ReferencePush(handler);
 	LUA->ReferenceFree(handler);
 
-	// Push the arguments
-	LUA->PushNumber(response.code);
-	LUA->PushString(response.body.c_str());
-	mapToLuaTable(LUA, response.headers);
+	// Push the arguments, or a single response object that takes the response over
+	if (asobject) {
+		pushResponseObject(LUA, std::move(response));
+		args = 1;
+	} else {
+		LUA->PushNumber(response.code);
+		if (response.decoded)
+			pushJSON(LUA, response.json);
+		else
+			LUA->PushString(response.body.c_str(), response.body.size());
+		mapToLuaTable(LUA, response.headers);
+	}
+
+	// Call the success handler (plus the optional timing)
+	if (timing) {
+		pushRequestTiming(LUA, *timing);
+		args++;
+	}
 
-	// Call the success handler with three arguments
-	LUA->Call(3, 0);
+	callHandler(LUA, args, url);
 }
 
 // Turns a string method into an int
@@ -95,11 +148,53 @@ EHTTPMethod methodFromString(std::string method) {
 	return k_EHTTPMethodInvalid;
 }
 
+// And back again, for display
+std::string methodToString(EHTTPMethod method) {
+	switch (method) {
+	case k_EHTTPMethodGET:
+		return "GET";
+	case k_EHTTPMethodPOST:
+		return "POST";
+	case k_EHTTPMethodHEAD:
+		return "HEAD";
+	case k_EHTTPMethodPUT:
+		return "PUT";
+	case k_EHTTPMethodDELETE:
+		return "DELETE";
+	case k_EHTTPMethodPATCH:
+		return "PATCH";
+	case k_EHTTPMethodOPTIONS:
+		return "OPTIONS";
+	default:
+		return "?";
+	}
+}
+
+// Turns the `decode` option into a BodyDecoding, -1 if unknown
+static int decodingFromString(std::string decode) {
+	if (decode.compare("json") == 0)
+		return DECODE_JSON;
+	if (decode.compare("msgpack") == 0)
+		return DECODE_MSGPACK;
+
+	return -1;
+}
+
+// Turns the `compress` option into a BodyCompression, -1 if unknown
+static int compressionFromString(std::string compress) {
+	if (compress.compare("gzip") == 0)
+		return COMPRESS_GZIP;
+	if (compress.compare("deflate") == 0)
+		return COMPRESS_DEFLATE;
+
+	return -1;
+}
+
 bool createHTTPResponse(HTTPRequestHandle request, SteamAPICall_t apicall, HTTPResponse *response, std::string *failreason) {
 	bool failed = true;
 	HTTPRequestCompleted_t reqcomplete;
 
-	if (!SteamUtils()->GetAPICallResult(apicall, &reqcomplete, sizeof(reqcomplete), reqcomplete.k_iCallback, &failed)) {
+	if (!backend->getResult(apicall, &reqcomplete, &failed)) {
 		failreason->assign("Could not fetch API Call Result.");
 		return false;
 	}
@@ -116,21 +211,21 @@ bool createHTTPResponse(HTTPRequestHandle request, SteamAPICall_t apicall, HTTPR
 
 	response->code = reqcomplete.m_eStatusCode;
 
-	// Initialize char* with correct size and copy it over
-	std::vector<uint8> buffer(reqcomplete.m_unBodySize);
-	SteamHTTP()->GetHTTPResponseBodyData(request, &buffer[0], reqcomplete.m_unBodySize);
-	response->body = std::string(buffer.begin(), buffer.end());
+	// Read the body straight into the response
+	response->body.resize(reqcomplete.m_unBodySize);
+	if (reqcomplete.m_unBodySize)
+		backend->getBodyData(request, (uint8 *)&response->body[0], reqcomplete.m_unBodySize);
 
 	for (std::string header : HEADERS) {
 		uint32 headersize;
 
-		if (!SteamHTTP()->GetHTTPResponseHeaderSize(request, header.c_str(), &headersize)
+		if (!backend->getHeaderSize(request, header.c_str(), &headersize)
 		    || headersize <= 0)
 			continue;
 
 		std::vector<uint8> headerbuf(headersize);
 
-		if (!SteamHTTP()->GetHTTPResponseHeaderValue(request, header.c_str(), &headerbuf[0], headersize))
+		if (!backend->getHeaderValue(request, header.c_str(), &headerbuf[0], headersize))
 			continue;
 
 		response->headers[header] = std::string(headerbuf.begin(), headerbuf.end());
@@ -139,232 +234,986 @@ bool createHTTPResponse(HTTPRequestHandle request, SteamAPICall_t apicall, HTTPR
 	return true;
 }
 
-void addHeaders(HTTPRequestHandle handle, HTTPRequest request) {
+void addHeaders(HTTPRequestHandle handle, const HTTPRequest& request) {
+	auto useragent = request.headers.find("User-Agent");
+
 	// Check if we have to append something to the User-Agent
 	// The `useragent` parameter overwrites the header
 	if (request.useragent.size() != 0)
-		SteamHTTP()->SetHTTPRequestUserAgentInfo(handle, request.useragent.c_str());
-	else if (request.headers.count("User-Agent") != 0)
-		SteamHTTP()->SetHTTPRequestUserAgentInfo(handle, request.headers["User-Agent"].c_str());
+		backend->setUserAgent(handle, request.useragent.c_str());
+	else if (useragent != request.headers.end())
+		backend->setUserAgent(handle, useragent->second.c_str());
 
-	// Add the Content-Type header if not already set
-	if (request.headers.count("Content-Type") == 0)
-		SteamHTTP()->SetHTTPRequestHeaderValue(handle, "Content-Type", request.type.c_str());
+	// Add the Content-Type header if not already set. A body brings its
+	// type along in setBody, so that saves a call.
+	if (request.headers.count("Content-Type") == 0 && request.body.empty())
+		backend->setHeader(handle, "Content-Type", request.type.c_str());
 
 	// Add all the headers from the request struct
 	for (auto const& e : request.headers)
-		SteamHTTP()->SetHTTPRequestHeaderValue(handle, e.first.c_str(), e.second.c_str());
+		backend->setHeader(handle, e.first.c_str(), e.second.c_str());
 }
 
-bool processRequest(Lua::ILuaBase *LUA, HTTPRequest request) {
+// Compresses the body if that makes it smaller, small or already
+// compressed bodies are sent as they are
+static void compressBody(HTTPRequest& request) {
+	std::string compressed;
+
+	if (request.compress == COMPRESS_NONE || request.body.empty()
+	    || request.headers.count("Content-Encoding") != 0)
+		return;
+
+	compressed.reserve(request.body.size() / 4);
+
+	if (request.compress == COMPRESS_GZIP)
+		gzipCompress(request.body.data(), request.body.size(), request.compresslevel, &compressed);
+	else
+		zlibCompress(request.body.data(), request.body.size(), request.compresslevel, &compressed);
+
+	if (compressed.size() >= request.body.size())
+		return;
+
+	request.body = std::move(compressed);
+	request.headers["Content-Encoding"] = request.compress == COMPRESS_GZIP ? "gzip" : "deflate";
+}
+
+// Queues a request that could not be sent, for callbackHook to run its fail handler
+static void failSubmission(HTTPRequest& request, std::string reason) {
+	QueuedRequestData queued = QueuedRequestData();
+
+	queued.request = std::move(request);
+	queued.reqhandle = INVALID_HTTPREQUEST_HANDLE;
+	queued.failurekind = FAILURE_SEND;
+	queued.failure = reason;
+
+	completions.add(std::move(queued));
+}
+
+void processRequest(HTTPRequest request) {
 	HTTPRequestHandle reqhandle;
 	SteamAPICall_t apicall;
+	uint64 ipcmark = backend->ipcCalls();
 
-	reqhandle = SteamHTTP()->CreateHTTPRequest(request.method, request.url.c_str());
+	metrics.started++;
+	reqhandle = backend->createRequest(request.method, request.url.c_str());
 
 	if (reqhandle == INVALID_HTTPREQUEST_HANDLE) {
-		runFailedHandler(LUA, request.failed, "Failed to init request handle!");
-		return false;
+		failSubmission(request, "Failed to init request handle!");
+		return;
 	}
 
+	compressBody(request);
 	addHeaders(reqhandle, request);
 
+	if (request.timeout)
+		backend->setTimeout(reqhandle, request.timeout);
+	if (request.cookies != INVALID_HTTPCOOKIE_HANDLE)
+		backend->setCookieContainer(reqhandle, request.cookies);
+
 	// Adding body (if available)
 	if (request.body.size() != 0)
-		SteamHTTP()->SetHTTPRequestRawPostBody(reqhandle, request.type.c_str(), std::vector<uint8>(request.body.begin(), request.body.end()).data(), request.body.size());
+		backend->setBody(reqhandle, request.type.c_str(), (uint8 *)&request.body[0], request.body.size());
 
 	// Adding parameters
 	for (auto const& e : request.parameters)
-		SteamHTTP()->SetHTTPRequestGetOrPostParameter(reqhandle, e.first.c_str(), e.second.c_str());
+		backend->setParameter(reqhandle, e.first.c_str(), e.second.c_str());
 
-	if (!SteamHTTP()->SendHTTPRequest(reqhandle, &apicall)) {
-		runFailedHandler(LUA, request.failed, "Failure while sending HTTP request.");
-		SteamHTTP()->ReleaseHTTPRequest(reqhandle);
-		return false;
+	if (!backend->sendRequest(reqhandle, &apicall)) {
+		backend->releaseRequest(reqhandle);
+		failSubmission(request, "Failure while sending HTTP request.");
+		return;
 	}
 
-	requests.push({request, reqhandle, apicall});
+	request.timing.sent = nowMicros();
+	metrics.bytesout += request.body.size();
 
-	return true;
+	uint64 ipccalls = backend->ipcCalls() - ipcmark;
+	metrics.ipccalls += ipccalls;
+
+	std::string host = urlHost(request.url);
+	trackRequest({apicall, reqhandle, request.timing.sent, methodToString(request.method), request.url, host, request.addon, false, -1, 0});
+
+	QueuedRequestData queued = QueuedRequestData();
+	queued.request = std::move(request);
+	queued.reqhandle = reqhandle;
+	queued.apicall = apicall;
+	queued.latency = hostLatency(host);
+	queued.ipccalls = ipccalls;
+
+	completions.add(std::move(queued));
 }
 
-// At the moment, this is handling one request per tick.
-LUA_FUNCTION(callbackHook) {
-	if (requests.empty())
-		return 0;
+// Runs on the game thread for every request that the completion pool
+// made ready: bookkeeping and the Lua handler.
+static void finishRequest(Lua::ILuaBase *LUA, QueuedRequestData& queued) {
+	HTTPRequest& request = queued.request;
+	RequestTiming& timing = request.timing;
+	bool failed = !queued.failure.empty();
+	uint64 handlerstart;
 
-	QueuedRequestData queued = requests.pop();
-	bool failed = true;
+	// Undecodable bodies fail the request, but there still was a response
+	bool responded = !failed || queued.failurekind == FAILURE_DECODE;
 
-	// If this isn't done, push back onto the queue and stop
-	if (!SteamUtils()->IsAPICallCompleted(queued.apicall, &failed)) {
-		requests.push(queued);
-		return 0;
+	timing.pickedup = nowMicros();
+	metrics.finished++;
+
+	// The client's next request can go out right away
+	if (request.client)
+		clientFinished(request.client.get());
+
+	if (failed)
+		metrics.failed[queued.failurekind]++;
+
+	// Only one of the handlers runs, the other one's reference goes now
+	int unused = failed ? request.success : request.failed;
+	if (unused)
+		LUA->ReferenceFree(unused);
+
+	if (request.batch)
+		recordBatchResult(LUA, request, responded ? &queued.response : nullptr, queued.failure);
+	if (request.client)
+		recordClientResult(LUA, request, responded ? &queued.response : nullptr, queued.failure);
+
+	// Requests that never made it to the backend have nothing else to report
+	if (failed && queued.failurekind == FAILURE_SEND) {
+		runFailedHandler(LUA, request.failed, queued.failure, request.url);
+
+		if (request.batch)
+			finishBatchRequest(LUA, request.batch.get());
+		return;
 	}
 
-	if (failed) {
-		runFailedHandler(LUA, queued.request.failed,
-		                 "API Error: " + SteamUtils()->GetAPICallFailureReason(queued.apicall));
-		SteamHTTP()->ReleaseHTTPRequest(queued.reqhandle);
-		return 0;
+	tracer.add(TRACE_REQUEST, timing.sent, timing.completed, queued.apicall, request.url);
+	tracer.add(TRACE_RESPONSE, timing.noticed, timing.materialized);
+	recordLatency(queued.latency, timing.completed - timing.sent, responded ? queued.response.code : 0);
+	metrics.requestipc.record(queued.ipccalls);
+
+	if (responded) {
+		if (queued.response.code >= 100 && queued.response.code < 600)
+			metrics.completed[queued.response.code / 100]++;
+		metrics.bytesin += queued.response.body.size();
 	}
 
-	HTTPResponse response = HTTPResponse();
-	std::string failreason = "";
+	handlerstart = nowMicros();
 
-	if (!createHTTPResponse(queued.reqhandle, queued.apicall, &response, &failreason)) {
-		runFailedHandler(LUA, queued.request.failed, "HTTP Error: " + failreason);
-		SteamHTTP()->ReleaseHTTPRequest(queued.reqhandle);
-		return 0;
-        }
+	if (failed)
+		runFailedHandler(LUA, request.failed, queued.failure, request.url, request.wanttiming ? &timing : nullptr);
+	else
+		runSuccessHandler(LUA, request.success, queued.response, request.url, request.wanttiming ? &timing : nullptr, request.lazy);
+
+	if (request.batch)
+		finishBatchRequest(LUA, request.batch.get());
+
+	timing.handled = nowMicros();
+	tracer.add(TRACE_HANDLER, handlerstart, timing.handled);
+	aggregateRequestTiming(timing);
+}
+
+// Microseconds per tick that callbackHook may spend on ready requests
+static uint64 dispatchbudget = 2000;
+
+// metrics.ipccalls at the end of the previous tick
+static uint64 lasttickipc = 0;
+
+// Pushes ready requests into Lua until the tick's budget is spent. At
+// least one request is handled per tick, so a slow handler can't stall
+// the queue.
+LUA_FUNCTION(callbackHook) {
+	uint64 start = nowMicros();
+	uint64 ipcmark = backend->ipcCalls();
+	uint64 end = start;
+	QueuedRequestData queued;
+
+	pumpClients();
 
-	runSuccessHandler(LUA, queued.request.success, response);
+	// The budget is checked after each request, so even a budget of 0
+	// lets the first one through
+	while (completions.takeReady(&queued)) {
+		finishRequest(LUA, queued);
+		end = nowMicros();
+
+		if (end - start >= dispatchbudget)
+			break;
+	}
+
+	deliverClientResults(LUA);
+
+	metrics.ipccalls += backend->ipcCalls() - ipcmark;
+
+	// The backend counts per thread and nearly all calls happen on the
+	// submission and completion threads, so a tick's share is what every
+	// thread added to the total since the previous tick
+	uint64 ipctotal = metrics.ipccalls;
+	metrics.tickipc.record(ipctotal - lasttickipc);
+	lasttickipc = ipctotal;
+
+	end = nowMicros();
+	metrics.queuedepth = completions.readyCount();
+	metrics.dispatch.record(end - start);
+	tracer.add(TRACE_HOOK, start, end);
 
 	return 0;
 }
 
-/*
- * See https://wiki.garrysmod.com/page/Global/HTTP for documentation.
- * The function takes a single table argument, based off the HTTPRequest structure.
- * It returns a boolean whether a request was sent or not.
- */
-LUA_FUNCTION(STEAMHTTP) {
-	HTTPRequest request = HTTPRequest();
-	bool ret;
+// Reads the `extract` list at the top of the stack
+static bool extractFromLua(Lua::ILuaBase *LUA, std::vector<ExtractPath> *paths, std::string *error) {
+	for (int i = 1; ; i++) {
+		ExtractPath path;
 
-	if (!LUA->IsType(1, Lua::Type::TABLE)) {
-		LOG("No HTTPRequest table set.");
-		ret = false;
-		goto exit;
+		LUA->PushNumber(i);
+		LUA->GetTable(-2);
+
+		if (LUA->IsType(-1, Lua::Type::NIL)) {
+			LUA->Pop();
+			return true;
+		}
+
+		if (!LUA->IsType(-1, Lua::Type::STRING)) {
+			error->assign("paths must be strings");
+			LUA->Pop();
+			return false;
+		}
+
+		bool parsed = parseExtractPath(LUA->GetString(-1), &path, error);
+		LUA->Pop();
+
+		if (!parsed)
+			return false;
+
+		paths->push_back(std::move(path));
 	}
+}
 
+// Size of the last `json` or `msgpack` body, so that similar uploads are
+// serialized into a buffer of the right size right away
+static size_t encodedsizehint = 0;
+
+void readRequestHandlers(Lua::ILuaBase *LUA, int index, HTTPRequest& request) {
 	// Fetch failed handler
-	LUA->GetField(1, "failed");
+	LUA->GetField(index, "failed");
 	if (LUA->IsType(-1, Lua::Type::FUNCTION)) {
 		request.failed = LUA->ReferenceCreate();
 	} else {
 		LUA->Pop();
 	}
 
+	// Fetch success handler
+	LUA->GetField(index, "success");
+	if (LUA->IsType(-1, Lua::Type::FUNCTION)) {
+		request.success = LUA->ReferenceCreate();
+	} else {
+		LUA->Pop();
+	}
+}
+
+bool readRequestOptions(Lua::ILuaBase *LUA, int index, HTTPRequest& request, std::string *error) {
 	// Fetch method
-	LUA->GetField(1, "method");
+	LUA->GetField(index, "method");
 	if (LUA->IsType(-1, Lua::Type::STRING)) {
 		request.method = methodFromString(LUA->GetString(-1));
-	} else {
-		request.method = k_EHTTPMethodGET;
-	}
-	if (request.method == k_EHTTPMethodInvalid) {
-		runFailedHandler(LUA, request.failed, "Unsupported request method: " + std::string(LUA->GetString(-1)));
-		ret = false;
-		goto exit;
+
+		if (request.method == k_EHTTPMethodInvalid) {
+			error->assign("Unsupported request method: " + std::string(LUA->GetString(-1)));
+			LUA->Pop();
+			return false;
+		}
 	}
 	LUA->Pop();
 
 	// Fetch url
-	LUA->GetField(1, "url");
+	LUA->GetField(index, "url");
 	if (LUA->IsType(-1, Lua::Type::STRING)) {
 		request.url = LUA->GetString(-1);
-	} else {
-		runFailedHandler(LUA, request.failed, "invalid url");
-		ret = false;
-		goto exit;
 	}
 	LUA->Pop();
 
-	// Fetch success handler
-	LUA->GetField(1, "success");
-	if (LUA->IsType(-1, Lua::Type::FUNCTION)) {
-		request.success = LUA->ReferenceCreate();
-	} else {
-		LUA->Pop();
+	// Fetch headers, added to the ones already there
+	LUA->GetField(index, "headers");
+	if (LUA->IsType(-1, Lua::Type::TABLE)) {
+		for (auto& e : mapFromLuaTable(LUA, -1))
+			request.headers[e.first] = std::move(e.second);
 	}
+	LUA->Pop();
 
-	// Fetch headers
-	LUA->GetField(1, "headers");
-	if (LUA->IsType(-1, Lua::Type::TABLE)) {
-		request.headers = mapFromLuaTable(LUA, -1);
+	// Fetch type
+	LUA->GetField(index, "type");
+	if (LUA->IsType(-1, Lua::Type::STRING)) {
+		request.type = LUA->GetString(-1);
 	}
 	LUA->Pop();
 
-	// Fetch parameters
-	LUA->GetField(1, "parameters");
-	if (LUA->IsType(-1, Lua::Type::TABLE)) {
-		request.parameters = mapFromLuaTable(LUA, -1);
+	// Fetch useragent
+	LUA->GetField(index, "useragent");
+	if (LUA->IsType(-1, Lua::Type::STRING)) {
+		request.useragent = LUA->GetString(-1);
 	}
 	LUA->Pop();
 
-	// Fetch type
-	LUA->GetField(1, "type");
+	// Fetch timing
+	LUA->GetField(index, "timing");
+	if (!LUA->IsType(-1, Lua::Type::NIL)) {
+		request.wanttiming = LUA->GetBool(-1);
+	}
+	LUA->Pop();
+
+	// Fetch lazy, whether the success handler gets a response object
+	LUA->GetField(index, "lazy");
+	if (!LUA->IsType(-1, Lua::Type::NIL)) {
+		request.lazy = LUA->GetBool(-1);
+	}
+	LUA->Pop();
+
+	// Fetch timeout, in milliseconds
+	LUA->GetField(index, "timeout");
+	if (LUA->IsType(-1, Lua::Type::NUMBER)) {
+		double timeout = LUA->GetNumber(-1);
+
+		if (std::isnan(timeout)) {
+			error->assign("Invalid timeout: nan");
+			LUA->Pop();
+			return false;
+		}
+
+		request.timeout = (uint32)clampNumber(timeout, 0, UINT32_MAX);
+	}
+	LUA->Pop();
+
+	// Fetch compress
+	LUA->GetField(index, "compress");
 	if (LUA->IsType(-1, Lua::Type::STRING)) {
-		request.type = LUA->GetString(-1);
-	} else {
-		request.type = "text/plain; charset=utf-8";
+		request.compress = compressionFromString(LUA->GetString(-1));
+
+		if (request.compress < 0) {
+			error->assign("Unsupported compress: " + std::string(LUA->GetString(-1)));
+			LUA->Pop();
+			return false;
+		}
 	}
 	LUA->Pop();
 
-	// Fetch body
-	LUA->GetField(1, "body");
+	// Fetch compresslevel
+	LUA->GetField(index, "compresslevel");
+	if (LUA->IsType(-1, Lua::Type::NUMBER)) {
+		double level = LUA->GetNumber(-1);
+
+		if (std::isnan(level)) {
+			error->assign("Invalid compresslevel: nan");
+			LUA->Pop();
+			return false;
+		}
+
+		request.compresslevel = (int)clampNumber(level, 0, 9);
+	}
+	LUA->Pop();
+
+	// Fetch decode
+	LUA->GetField(index, "decode");
 	if (LUA->IsType(-1, Lua::Type::STRING)) {
-		request.body = LUA->GetString(-1);
+		request.decode = decodingFromString(LUA->GetString(-1));
+
+		if (request.decode < 0) {
+			error->assign("Unsupported decode: " + std::string(LUA->GetString(-1)));
+			LUA->Pop();
+			return false;
+		}
 	}
 	LUA->Pop();
 
-	// Fetch useragent
-	LUA->GetField(1, "useragent");
+	// Fetch extract, a list of paths that implies decode = "json"
+	LUA->GetField(index, "extract");
+	if (LUA->IsType(-1, Lua::Type::TABLE)) {
+		std::string extracterror;
+
+		request.extract.clear();
+
+		if (!extractFromLua(LUA, &request.extract, &extracterror)) {
+			error->assign("Invalid extract path: " + extracterror);
+			LUA->Pop();
+			return false;
+		}
+
+		if (request.decode == DECODE_NONE)
+			request.decode = DECODE_JSON;
+	}
+	LUA->Pop();
+
+	return true;
+}
+
+bool readRequestBody(Lua::ILuaBase *LUA, int index, HTTPRequest& request, std::string *error) {
+	// Fetch parameters, added to the ones already there
+	LUA->GetField(index, "parameters");
+	if (LUA->IsType(-1, Lua::Type::TABLE)) {
+		for (auto& e : mapFromLuaTable(LUA, -1))
+			request.parameters[e.first] = std::move(e.second);
+	}
+	LUA->Pop();
+
+	// Fetch body, which may be binary
+	LUA->GetField(index, "body");
 	if (LUA->IsType(-1, Lua::Type::STRING)) {
-		request.useragent = LUA->GetString(-1);
+		unsigned int length;
+		const char *body = LUA->GetString(-1, &length);
+		request.body.assign(body, length);
+	}
+	LUA->Pop();
+
+	// Fetch json, serialized into the body (and replacing it)
+	LUA->GetField(index, "json");
+	if (LUA->IsType(-1, Lua::Type::TABLE)) {
+		request.body.clear();
+		request.body.reserve(encodedsizehint);
+
+		if (!encodeJSON(LUA, -1, &request.body, error)) {
+			error->insert(0, "JSON Error: ");
+			LUA->Pop();
+			return false;
+		}
+
+		encodedsizehint = request.body.size();
+		request.bodytype = "application/json";
 	}
 	LUA->Pop();
 
-	ret = processRequest(LUA, request);
+	// Fetch msgpack, same as json
+	LUA->GetField(index, "msgpack");
+	if (LUA->IsType(-1, Lua::Type::TABLE)) {
+		request.body.clear();
+		request.body.reserve(encodedsizehint);
+
+		if (!encodeMsgPack(LUA, -1, &request.body, error)) {
+			error->insert(0, "MessagePack Error: ");
+			LUA->Pop();
+			return false;
+		}
+
+		encodedsizehint = request.body.size();
+		request.bodytype = "application/msgpack";
+	}
+	LUA->Pop();
+
+	return true;
+}
+
+// An explicit `type` wins over the one of `json` or `msgpack`
+static void defaultType(HTTPRequest& request) {
+	if (request.type.empty())
+		request.type = request.bodytype ? request.bodytype : "text/plain; charset=utf-8";
+}
+
+void submitRequest(HTTPRequest&& request) {
+	defaultType(request);
+
+	// The rest happens on the submission thread, failures to send are
+	// reported through the fail handler from callbackHook
+	submitter.submit(std::move(request));
+}
+
+void submitRequests(std::vector<HTTPRequest>& requests) {
+	for (HTTPRequest& request : requests)
+		defaultType(request);
+
+	submitter.submitAll(requests);
+}
+
+void failRequest(Lua::ILuaBase *LUA, HTTPRequest& request, const std::string& reason) {
+	// Only one of the handlers ever runs
+	if (request.success)
+		LUA->ReferenceFree(request.success);
+
+	runFailedHandler(LUA, request.failed, reason, request.url);
+}
+
+HTTPRequest defaultRequest() {
+	HTTPRequest request = HTTPRequest();
+
+	request.method = k_EHTTPMethodGET;
+	request.compresslevel = 6; // like zlib's default
+	return request;
+}
+
+/*
+ * See https://wiki.garrysmod.com/page/Global/HTTP for documentation.
+ * The function takes a single table argument, based off the HTTPRequest structure.
+ * It returns a boolean whether a request was sent or not.
+ */
+static int requestFromLua(Lua::ILuaBase *LUA) {
+	HTTPRequest request = defaultRequest();
+	std::string error;
+	bool ret;
+
+	request.timing.parsed = nowMicros();
+
+	// The Lua function calling STEAMHTTP, above STEAMHTTP itself
+	request.addon = callerAddon(LUA, 2);
+
+	if (!LUA->IsType(1, Lua::Type::TABLE)) {
+		LOG("No HTTPRequest table set.");
+		ret = false;
+		goto exit;
+	}
+
+	readRequestHandlers(LUA, 1, request);
+
+	if (!readRequestOptions(LUA, 1, request, &error) || !readRequestBody(LUA, 1, request, &error)) {
+		failRequest(LUA, request, error);
+		ret = false;
+		goto exit;
+	}
+
+	if (request.url.empty()) {
+		failRequest(LUA, request, "invalid url");
+		ret = false;
+		goto exit;
+	}
+
+	submitRequest(std::move(request));
+	ret = true;
 
 exit:
 	LUA->PushBool(ret); // Push result to the stack
 	return 1; // We are returning a single value
 }
 
-GMOD_MODULE_OPEN() {
-	// Initialize the SteamAPI
-	if (!SteamAPI_Init()) {
-		LUA->ThrowError("SteamAPI did not initialize correctly! STEAMHTTP will not be available!");
+LUA_FUNCTION(STEAMHTTP) {
+	return requestFromLua(LUA);
+}
+
+// __call of the STEAMHTTP table, the table itself is the first argument
+LUA_FUNCTION(callSTEAMHTTP) {
+	LUA->Remove(1);
+	return requestFromLua(LUA);
+}
+
+/*
+ * STEAMHTTP.StartRecording(filename[, fullbodies])
+ * Starts writing every completed request to garrysmod/data/<filename>.
+ * Request bodies are only stored as size and hash unless `fullbodies` is set.
+ * Returns whether recording was started.
+ */
+LUA_FUNCTION(StartRecording) {
+	std::string path = dataPath(LUA->CheckString(1));
+	bool fullbodies = LUA->IsType(2, Lua::Type::BOOL) && LUA->GetBool(2);
+
+	if (path.empty()) {
+		LOG("Invalid recording file name.");
+		LUA->PushBool(false);
+		return 1;
+	}
+
+	LUA->PushBool(recorder.start(path, fullbodies));
+	return 1;
+}
+
+// STEAMHTTP.StopRecording(), flushes and closes the recording log.
+LUA_FUNCTION(StopRecording) {
+	recorder.stop();
+	return 0;
+}
+
+/*
+ * STEAMHTTP.Timings()
+ * Returns the lifecycle stages aggregated over all finished requests:
+ * { queue = { count, avg, max, total }, upstream = ..., poll = ...,
+ *   materialize = ..., dispatch = ..., handler = ..., total = ... },
+ * all in milliseconds.
+ */
+LUA_FUNCTION(Timings) {
+	pushAggregatedTimings(LUA);
+	return 1;
+}
+
+// STEAMHTTP.ResetTimings(), starts aggregating from scratch.
+LUA_FUNCTION(ResetTimings) {
+	resetAggregatedTimings();
+	return 0;
+}
+
+/*
+ * STEAMHTTP.Percentile(host, q[, class])
+ * Returns the upstream latency in milliseconds at quantile q (0 to 1) of
+ * requests to `host`, or "*" for all hosts. `class` restricts it to one
+ * status class: "1xx" to "5xx" or "failed". Returns nil without samples.
+ */
+LUA_FUNCTION(Percentile) {
+	std::string host = LUA->CheckString(1);
+	double q = LUA->CheckNumber(2);
+	const LatencyHistogram *histogram;
+
+	// Written so that NaN fails too
+	if (!(q >= 0 && q <= 1))
+		LUA->ArgError(2, "quantile must be between 0 and 1");
+
+	HostLatency *latency = findHostLatency(host == "*" ? host : urlHost(host));
+
+	if (!latency) {
+		LUA->PushNil();
+		return 1;
+	}
+
+	histogram = &latency->all;
+
+	if (LUA->IsType(3, Lua::Type::STRING)) {
+		int statusclass = statusClassFromName(LUA->GetString(3));
+		if (statusclass < 0)
+			LUA->ArgError(3, "expected \"1xx\" to \"5xx\" or \"failed\"");
+
+		histogram = &latency->classes[statusclass];
+	}
+
+	if (!histogram->count()) {
+		LUA->PushNil();
+		return 1;
+	}
+
+	LUA->PushNumber(histogram->percentile(q) / 1000.0);
+	return 1;
+}
+
+// STEAMHTTP.ResetLatency([host]), clears one host's histograms or all of them.
+LUA_FUNCTION(ResetLatency) {
+	if (LUA->IsType(1, Lua::Type::STRING))
+		resetLatencies(urlHost(LUA->GetString(1)));
+	else
+		resetLatencies();
+
+	return 0;
+}
+
+/*
+ * STEAMHTTP.ExportMetrics(options)
+ * Publishes the module's metrics in Prometheus text format from a
+ * background thread. `options` is either
+ *   { file = "steamhttp.prom", interval = 15 } rewriting garrysmod/data/<file>
+ *   { socket = "steamhttp.sock" } serving garrysmod/data/<socket> (not on Windows)
+ * Returns whether the export was started.
+ */
+LUA_FUNCTION(ExportMetrics) {
+	LUA->CheckType(1, Lua::Type::TABLE);
+	bool ret = false;
+
+	LUA->GetField(1, "file");
+	LUA->GetField(1, "interval");
+	LUA->GetField(1, "socket");
+
+	if (LUA->IsType(-3, Lua::Type::STRING)) {
+		std::string path = dataPath(LUA->GetString(-3));
+		double interval = LUA->IsType(-2, Lua::Type::NUMBER) ? LUA->GetNumber(-2) : 15;
+
+		if (!path.empty())
+			ret = exporter.startFile(path, interval);
+	} else if (LUA->IsType(-1, Lua::Type::STRING)) {
+		std::string path = dataPath(LUA->GetString(-1));
+
+		if (!path.empty())
+			ret = exporter.startSocket(path);
+	} else {
+		LOG("ExportMetrics needs a file or socket name.");
+	}
+
+	LUA->Pop(3);
+
+	LUA->PushBool(ret);
+	return 1;
+}
+
+// STEAMHTTP.StopMetrics(), stops the export started by ExportMetrics.
+LUA_FUNCTION(StopMetrics) {
+	exporter.stop();
+	return 0;
+}
+
+// STEAMHTTP.Metrics(), returns what ExportMetrics would publish right now.
+LUA_FUNCTION(Metrics) {
+	std::string text = renderMetrics();
+	LUA->PushString(text.c_str(), text.size());
+	return 1;
+}
+
+// Turns a requested ring capacity into a span count, 0 if it isn't a
+// positive number. Larger values are cut down to TRACE_MAX_CAPACITY.
+static size_t traceCapacity(double capacity) {
+	if (!(capacity >= 1))
+		return 0;
+
+	return (size_t)clampNumber(capacity, 1, TRACE_MAX_CAPACITY);
+}
+
+/*
+ * STEAMHTTP.Trace(enabled[, capacity])
+ * Starts or stops recording spans of requests, callbackHook, response
+ * reading and handlers into a ring of the last `capacity` (default
+ * 65536, at most 1048576) spans. Starting again clears the ring.
+ */
+LUA_FUNCTION(Trace) {
+	if (!LUA->GetBool(1)) {
+		tracer.disable();
 		return 0;
 	}
 
-	// We are working on the global table today
+	size_t capacity = TRACE_DEFAULT_CAPACITY;
+	if (LUA->IsType(2, Lua::Type::NUMBER)) {
+		capacity = traceCapacity(LUA->GetNumber(2));
+		if (!capacity)
+			LUA->ArgError(2, "capacity must be a positive number");
+	}
+
+	tracer.enable(capacity);
+	return 0;
+}
+
+/*
+ * STEAMHTTP.FlushTrace([filename])
+ * Writes the ring as a Chrome trace_event file to garrysmod/data/<filename>
+ * (steamhttp_trace.json by default). Returns whether it was written.
+ */
+LUA_FUNCTION(FlushTrace) {
+	std::string path = dataPath(LUA->IsType(1, Lua::Type::STRING) ? LUA->GetString(1) : "steamhttp_trace.json");
+
+	LUA->PushBool(!path.empty() && tracer.flush(path));
+	return 1;
+}
+
+// Console commands can be run by players too, only allow the server console
+static bool fromServerConsole(Lua::ILuaBase *LUA) {
+	bool valid;
+
 	LUA->PushSpecial(Lua::SPECIAL_GLOB);
+	LUA->GetField(-1, "IsValid");
+	LUA->Push(1);
+	LUA->Call(1, 1);
+	valid = LUA->GetBool(-1);
+	LUA->Pop(2);
 
-	// Push the function mapping (first is the key/function name,
-	// second is the value/actual function)
-	LUA->PushString("STEAMHTTP");
-	LUA->PushCFunction(STEAMHTTP);
+	return !valid;
+}
 
-	// SetTable takes the item at the top of the stack (value) and
-	// the second item from the top (key) and adds them to the table
-	// at the stack offset mentioned in the parameter (again, -1 is the top)
-	LUA->SetTable(-3);
+// Pushes argument `n` of a console command (args table at index 3), or nil
+static void pushCommandArgument(Lua::ILuaBase *LUA, int n) {
+	if (!LUA->IsType(3, Lua::Type::TABLE)) {
+		LUA->PushNil();
+		return;
+	}
 
+	LUA->PushNumber(n);
+	LUA->GetTable(3);
+}
 
-	// Get the hook.Add method
-	LUA->GetField(-1, "hook");
-	LUA->GetField(-1, "Add");
+// steamhttp_trace <0|1> [capacity]
+LUA_FUNCTION(traceCommand) {
+	if (!fromServerConsole(LUA))
+		return 0;
 
-	// Push the new hook data
-	LUA->PushString("Think");
-	LUA->PushString("__steamhttpCallback");
-	LUA->PushCFunction(callbackHook);
+	pushCommandArgument(LUA, 1);
+	pushCommandArgument(LUA, 2);
+	bool enable = LUA->IsType(-2, Lua::Type::STRING) && std::string(LUA->GetString(-2)) != "0";
+	size_t capacity = LUA->IsType(-1, Lua::Type::STRING) ? traceCapacity(strtod(LUA->GetString(-1), nullptr)) : TRACE_DEFAULT_CAPACITY;
+	LUA->Pop(2);
 
-	// Add the hook
-	LUA->Call(3, 0);
+	if (enable && !capacity) {
+		LOG("The capacity must be a positive number.");
+		return 0;
+	}
 
-	// Pop the "hook" table
-	LUA->Pop();
+	if (enable)
+		tracer.enable(capacity);
+	else
+		tracer.disable();
+
+	LOG(enable ? "Tracing enabled." : "Tracing disabled.");
+	return 0;
+}
 
-	// Pop the global table from the stack again
+// steamhttp_trace_flush [filename]
+LUA_FUNCTION(traceFlushCommand) {
+	if (!fromServerConsole(LUA))
+		return 0;
+
+	pushCommandArgument(LUA, 1);
+	std::string name = LUA->IsType(-1, Lua::Type::STRING) ? LUA->GetString(-1) : "steamhttp_trace.json";
 	LUA->Pop();
 
+	std::string path = dataPath(name);
+	if (!path.empty() && tracer.flush(path)) {
+		LOG("Trace written to " + path);
+	} else {
+		LOG("Could not write trace to " + name);
+	}
+
+	return 0;
+}
+
+/*
+ * STEAMHTTP.HandlerStats()
+ * Returns the time spent in success and fail handlers, keyed by where
+ * the handler was defined: { ["file:line"] = { count, total, avg, max } }
+ * in milliseconds.
+ */
+LUA_FUNCTION(HandlerStats) {
+	pushHandlerStats(LUA);
+	return 1;
+}
+
+// STEAMHTTP.ResetHandlerStats(), starts counting from scratch.
+LUA_FUNCTION(ResetHandlerStats) {
+	resetHandlerStats();
+	return 0;
+}
+
+/*
+ * STEAMHTTP.SlowHandlerThreshold(ms)
+ * Handlers that run longer than this are logged with their URL and
+ * source location. Defaults to 5 ms, 0 disables the log, at most a day.
+ */
+LUA_FUNCTION(SlowHandlerThreshold) {
+	double ms = clampNumber(LUA->CheckNumber(1), 0, 86400000);
+	setSlowHandlerThreshold((uint64)(ms * 1000));
+	return 0;
+}
+
+static void pushCountStats(Lua::ILuaBase *LUA, const LatencyHistogram& histogram, const char *name) {
+	LUA->CreateTable();
+
+	LUA->PushNumber(histogram.count());
+	LUA->SetField(-2, "count");
+	LUA->PushNumber(histogram.count() ? (double)histogram.valueSum() / histogram.count() : 0);
+	LUA->SetField(-2, "avg");
+	LUA->PushNumber(histogram.percentile(0.5));
+	LUA->SetField(-2, "p50");
+	LUA->PushNumber(histogram.percentile(0.99));
+	LUA->SetField(-2, "p99");
+	LUA->PushNumber(histogram.percentile(1));
+	LUA->SetField(-2, "max");
+
+	LUA->SetField(-2, name);
+}
+
+/*
+ * STEAMHTTP.IPCStats()
+ * Returns how many backend IPC calls (one per ISteamHTTP/ISteamUtils call
+ * on the Steam backend) requests and ticks cost:
+ *   { perrequest = { count, avg, p50, p99, max }, pertick = { ... },
+ *     counted = n, reported = n }
+ * `pertick` counts the calls made on all of the module's threads from one
+ * tick to the next, not just those on the game thread.
+ * `counted` and `reported` are the calls since the previous IPCStats(),
+ * as counted by the module and as reported by ISteamUtils::GetIPCCallCount.
+ * The latter covers the whole process, so it is an upper bound.
+ */
+LUA_FUNCTION(IPCStats) {
+	static uint64 lastcounted = 0;
+	uint64 counted = metrics.ipccalls;
+
+	LUA->CreateTable();
+
+	pushCountStats(LUA, metrics.requestipc, "perrequest");
+	pushCountStats(LUA, metrics.tickipc, "pertick");
+
+	LUA->PushNumber(counted - lastcounted);
+	LUA->SetField(-2, "counted");
+	LUA->PushNumber(backend->reportedIPCCalls());
+	LUA->SetField(-2, "reported");
+
+	lastcounted = counted;
+	return 1;
+}
+
+// Pushes the in-flight requests as a list of tables, oldest first
+static void pushStatus(Lua::ILuaBase *LUA) {
+	std::vector<InFlightRequest> inflight = inFlightRequests(backend);
+	uint64 now = nowMicros();
+	int i = 1;
+
+	LUA->CreateTable();
+
+	for (const InFlightRequest& request : inflight) {
+		LUA->PushNumber(i++);
+		LUA->CreateTable();
+
+		LUA->PushNumber((now - request.sent) / 1000.0);
+		LUA->SetField(-2, "age");
+		LUA->PushString(request.method.c_str());
+		LUA->SetField(-2, "method");
+		LUA->PushString(request.host.c_str());
+		LUA->SetField(-2, "host");
+		LUA->PushString(request.url.c_str());
+		LUA->SetField(-2, "url");
+		LUA->PushString(request.addon.c_str());
+		LUA->SetField(-2, "addon");
+		LUA->PushNumber(request.progress);
+		LUA->SetField(-2, "progress");
+		LUA->PushNumber(request.received);
+		LUA->SetField(-2, "received");
+
+		LUA->SetTable(-3);
+	}
+}
+
+/*
+ * STEAMHTTP.Status()
+ * Lists the requests in flight, oldest first, as tables with
+ * age (ms), method, host, url, addon, progress (percent, -1 if unknown)
+ * and received (bytes, 0 if unknown).
+ */
+LUA_FUNCTION(Status) {
+	pushStatus(LUA);
+	return 1;
+}
+
+// steamhttp_status, prints what STEAMHTTP.Status() returns
+LUA_FUNCTION(statusCommand) {
+	if (!fromServerConsole(LUA))
+		return 0;
+
+	std::vector<InFlightRequest> inflight = inFlightRequests(backend);
+	uint64 now = nowMicros();
+	char line[512];
+
+	LOG(std::to_string(inflight.size()) + " requests in flight");
+
+	if (inflight.empty())
+		return 0;
+
+	snprintf(line, sizeof(line), "%10s  %-7s  %-8s  %-24s  %-20s  %s", "age", "method", "progress", "host", "addon", "url");
+	LOG(line);
+
+	for (const InFlightRequest& request : inflight) {
+		char progress[32] = "?";
+
+		if (request.progressknown) {
+			if (request.received)
+				snprintf(progress, sizeof(progress), "%lluB", (unsigned long long)request.received);
+			else if (request.progress >= 0)
+				snprintf(progress, sizeof(progress), "%.0f%%", request.progress);
+		}
+
+		snprintf(line, sizeof(line), "%8.0fms  %-7s  %-8s  %-24s  %-20s  %s", (now - request.sent) / 1000.0,
+		         request.method.c_str(), progress, request.host.c_str(), request.addon.c_str(), request.url.c_str());
+		LOG(line);
+	}
+
 	return 0;
 }
 
-GMOD_MODULE_CLOSE() {
+/*
+ * STEAMHTTP.DispatchBudget(ms)
+ * How long callbackHook may spend on finished requests per tick
+ * (default 2 ms, at most a second). At least one request is handled per
+ * tick regardless.
+ */
+LUA_FUNCTION(DispatchBudget) {
+	double ms = clampNumber(LUA->CheckNumber(1), 0, 1000);
+	dispatchbudget = (uint64)(ms * 1000);
+	return 0;
+}
+
+/*
+ * STEAMHTTP.LatencyWindow(seconds)
+ * Clears all latency histograms every `seconds`, so percentiles only
+ * cover recent requests. 0 keeps them for the whole uptime (default),
+ * windows are at most a year.
+ */
+LUA_FUNCTION(LatencyWindow) {
+	setLatencyWindow(LUA->CheckNumber(1));
 	return 0;
 }
@@ -1,8 +1,90 @@
+#ifndef _STEAMHTTP_H
+#define _STEAMHTTP_H
+
+#include <string>
 #include "GarrysMod/Lua/Interface.h"
 #include "http.h"
+#include "backend.h"
+#include "histogram.h"
 
 struct QueuedRequestData {
 	HTTPRequest request;
 	HTTPRequestHandle reqhandle;
 	SteamAPICall_t apicall;
+
+	// Latency histograms of the request's host
+	HostLatency *latency;
+
+	// Backend IPC calls spent on this request so far
+	uint64 ipccalls;
+
+	// Filled in by the completion pool (see completion.h). `failure` is
+	// set for requests that failed, `failurekind` says at which stage.
+	bool apifailed;
+	HTTPResponse response;
+	std::string failure;
+	int failurekind;
 };
+
+// The backend that all requests go through, chosen on module load.
+extern HTTPBackend *backend;
+
+// Calls the function below `args` arguments on the stack as a handler,
+// timed and attributed to where it was defined
+void callHandler(GarrysMod::Lua::ILuaBase *LUA, int args, const std::string& url);
+
+void runFailedHandler(GarrysMod::Lua::ILuaBase *LUA, int handler, std::string reason, const std::string& url = "", const RequestTiming *timing = nullptr);
+// With `asobject`, the handler gets a response object (see responseobject.h)
+// instead of (code, body, headers), and `response` is moved into it
+void runSuccessHandler(GarrysMod::Lua::ILuaBase *LUA, int handler, HTTPResponse& response, const std::string& url = "", const RequestTiming *timing = nullptr, bool asobject = false);
+
+// Building requests from Lua tables. The readers take the fields of the
+// table at `index` that are set and leave everything else of the request
+// as it is, so they also apply call arguments on top of defaults.
+HTTPRequest defaultRequest();
+EHTTPMethod methodFromString(std::string method);
+std::string methodToString(EHTTPMethod method);
+void readRequestHandlers(GarrysMod::Lua::ILuaBase *LUA, int index, HTTPRequest& request);
+bool readRequestOptions(GarrysMod::Lua::ILuaBase *LUA, int index, HTTPRequest& request, std::string *error);
+bool readRequestBody(GarrysMod::Lua::ILuaBase *LUA, int index, HTTPRequest& request, std::string *error);
+
+// Hands a request read from Lua to the submission thread
+void submitRequest(HTTPRequest&& request);
+
+// The same for many requests at once
+void submitRequests(std::vector<HTTPRequest>& requests);
+
+// Runs the fail handler of a request that can't be sent, and drops its
+// success handler
+void failRequest(GarrysMod::Lua::ILuaBase *LUA, HTTPRequest& request, const std::string& reason);
+
+bool createHTTPResponse(HTTPRequestHandle request, SteamAPICall_t apicall, HTTPResponse *response, std::string *failreason);
+void processRequest(HTTPRequest request);
+
+// Lua entry points, registered by the module
+int callbackHook(lua_State *L);
+int STEAMHTTP(lua_State *L);
+int callSTEAMHTTP(lua_State *L);
+int StartRecording(lua_State *L);
+int StopRecording(lua_State *L);
+int Timings(lua_State *L);
+int ResetTimings(lua_State *L);
+int Percentile(lua_State *L);
+int ResetLatency(lua_State *L);
+int LatencyWindow(lua_State *L);
+int ExportMetrics(lua_State *L);
+int StopMetrics(lua_State *L);
+int Metrics(lua_State *L);
+int Trace(lua_State *L);
+int FlushTrace(lua_State *L);
+int HandlerStats(lua_State *L);
+int ResetHandlerStats(lua_State *L);
+int SlowHandlerThreshold(lua_State *L);
+int IPCStats(lua_State *L);
+int Status(lua_State *L);
+int DispatchBudget(lua_State *L);
+int statusCommand(lua_State *L);
+int traceCommand(lua_State *L);
+int traceFlushCommand(lua_State *L);
+
+#endif
@@ -0,0 +1,93 @@
+#include "submission.h"
+#include "steamhttp.h"
+
+RequestSubmitter submitter;
+
+RequestSubmitter::~RequestSubmitter() {
+	stop();
+}
+
+void RequestSubmitter::start() {
+	if (!running) {
+		running = true;
+		thread = std::thread(&RequestSubmitter::submitLoop, this);
+	}
+}
+
+void RequestSubmitter::submit(HTTPRequest request) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	start();
+
+	// The thread only sleeps while nothing is pending, so later pushes
+	// of a burst can skip the wakeup
+	bool wasempty = pending.empty();
+	pending.push_back(std::move(request));
+
+	if (wasempty)
+		wakeup.notify_one();
+}
+
+void RequestSubmitter::submitAll(std::vector<HTTPRequest>& requests) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	start();
+
+	bool wasempty = pending.empty();
+	for (HTTPRequest& request : requests)
+		pending.push_back(std::move(request));
+	requests.clear();
+
+	if (wasempty && !pending.empty())
+		wakeup.notify_one();
+}
+
+#ifdef TOOLS_BUILD
+void RequestSubmitter::wait() {
+	std::unique_lock<std::mutex> lock(mutex);
+	idle.wait(lock, [this]() { return pending.empty() && !busy; });
+}
+#endif
+
+void RequestSubmitter::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (!running)
+			return;
+
+		running = false;
+		pending.clear();
+		wakeup.notify_one();
+	}
+
+	thread.join();
+}
+
+void RequestSubmitter::submitLoop() {
+	std::deque<HTTPRequest> batch;
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (running) {
+		if (pending.empty()) {
+			busy = false;
+			idle.notify_all();
+			wakeup.wait(lock);
+			continue;
+		}
+
+		// Take everything at once, so a burst costs a single lock round trip
+		busy = true;
+		batch.swap(pending);
+		lock.unlock();
+
+		for (HTTPRequest& request : batch)
+			processRequest(std::move(request));
+
+		batch.clear();
+		lock.lock();
+	}
+
+	busy = false;
+	idle.notify_all();
+}
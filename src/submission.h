@@ -0,0 +1,50 @@
+#ifndef _SUBMISSION_H
+#define _SUBMISSION_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "http.h"
+
+// Hands requests to the backend from a thread of its own, so STEAMHTTP
+// only costs the game thread the parsing and a queue push, instead of
+// one backend (IPC) call per header and parameter. Sent requests, and
+// ones that failed to send, end up in the queue that callbackHook works
+// through, so every outcome reaches Lua from the game thread.
+class RequestSubmitter {
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	std::condition_variable idle;
+	std::deque<HTTPRequest> pending;
+	bool busy = false;
+	bool running = false;
+	std::thread thread;
+
+	void submitLoop();
+
+	// Starts the thread if it isn't running, with the mutex held
+	void start();
+
+public:
+	~RequestSubmitter();
+
+	// Queues a request, starting the thread on first use
+	void submit(HTTPRequest request);
+
+	// Queues all of `requests` (and empties it) under a single lock
+	void submitAll(std::vector<HTTPRequest>& requests);
+
+#ifdef TOOLS_BUILD
+	// Blocks until everything submitted so far was handed to the backend
+	void wait();
+#endif
+
+	// Stops the thread. Requests that were not sent yet are dropped.
+	void stop();
+};
+
+extern RequestSubmitter submitter;
+
+#endif
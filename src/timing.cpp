@@ -0,0 +1,99 @@
+#include "timing.h"
+
+using namespace GarrysMod;
+
+struct StageStats {
+	uint64 count;
+	uint64 total;
+	uint64 max;
+};
+
+enum {
+	STAGE_QUEUE,
+	STAGE_UPSTREAM,
+	STAGE_POLL,
+	STAGE_MATERIALIZE,
+	STAGE_DISPATCH,
+	STAGE_HANDLER,
+	STAGE_TOTAL,
+	STAGE_COUNT,
+};
+
+static const char *STAGE_NAMES[STAGE_COUNT] = {
+	"queue",
+	"upstream",
+	"poll",
+	"materialize",
+	"dispatch",
+	"handler",
+	"total",
+};
+
+// Only ever touched from the game thread
+static StageStats stages[STAGE_COUNT];
+
+static uint64 span(uint64 from, uint64 to) {
+	return from && to > from ? to - from : 0;
+}
+
+static void spans(const RequestTiming& timing, uint64 out[STAGE_COUNT]) {
+	out[STAGE_QUEUE] = span(timing.parsed, timing.sent);
+	out[STAGE_UPSTREAM] = span(timing.sent, timing.completed);
+	out[STAGE_POLL] = span(timing.completed, timing.noticed);
+	out[STAGE_MATERIALIZE] = span(timing.noticed, timing.materialized);
+	out[STAGE_DISPATCH] = span(timing.materialized, timing.pickedup);
+	out[STAGE_HANDLER] = span(timing.pickedup, timing.handled);
+	out[STAGE_TOTAL] = span(timing.parsed, timing.handled ? timing.handled : timing.pickedup);
+}
+
+void pushRequestTiming(Lua::ILuaBase *LUA, const RequestTiming& timing) {
+	uint64 values[STAGE_COUNT];
+	spans(timing, values);
+
+	LUA->CreateTable();
+
+	for (int i = 0; i < STAGE_COUNT; i++) {
+		// The handler is still running when this is pushed
+		if (i == STAGE_HANDLER)
+			continue;
+
+		LUA->PushNumber(values[i] / 1000.0);
+		LUA->SetField(-2, STAGE_NAMES[i]);
+	}
+}
+
+void aggregateRequestTiming(const RequestTiming& timing) {
+	uint64 values[STAGE_COUNT];
+	spans(timing, values);
+
+	for (int i = 0; i < STAGE_COUNT; i++) {
+		stages[i].count++;
+		stages[i].total += values[i];
+		if (values[i] > stages[i].max)
+			stages[i].max = values[i];
+	}
+}
+
+void pushAggregatedTimings(Lua::ILuaBase *LUA) {
+	LUA->CreateTable();
+
+	for (int i = 0; i < STAGE_COUNT; i++) {
+		LUA->CreateTable();
+
+		LUA->PushNumber(stages[i].count);
+		LUA->SetField(-2, "count");
+		LUA->PushNumber(stages[i].count ? stages[i].total / 1000.0 / stages[i].count : 0);
+		LUA->SetField(-2, "avg");
+		LUA->PushNumber(stages[i].max / 1000.0);
+		LUA->SetField(-2, "max");
+		LUA->PushNumber(stages[i].total / 1000.0);
+		LUA->SetField(-2, "total");
+
+		LUA->SetField(-2, STAGE_NAMES[i]);
+	}
+}
+
+void resetAggregatedTimings() {
+	for (int i = 0; i < STAGE_COUNT; i++)
+		stages[i] = StageStats();
+}
@@ -0,0 +1,44 @@
+#ifndef _TIMING_H
+#define _TIMING_H
+
+#include "steamtypes.h"
+#include <GarrysMod/Lua/LuaBase.h>
+
+// Timestamps (see nowMicros) of the stages a request goes through.
+// Stages that were not reached yet are 0.
+struct RequestTiming {
+	// The request table was parsed in STEAMHTTP
+	uint64 parsed;
+
+	// The request was handed to the backend
+	uint64 sent;
+
+	// The backend finished the request. Backends that can't tell
+	// report the time at which the completion was noticed.
+	uint64 completed;
+
+	// The completion pool noticed the completion
+	uint64 noticed;
+
+	// A worker read the response into an HTTPResponse
+	uint64 materialized;
+
+	// callbackHook took the ready request
+	uint64 pickedup;
+
+	// The Lua handler returned
+	uint64 handled;
+};
+
+// Pushes the breakdown as a table of stage durations in milliseconds:
+// queue, upstream, poll, materialize, dispatch and total.
+void pushRequestTiming(GarrysMod::Lua::ILuaBase *LUA, const RequestTiming& timing);
+
+// Adds a finished request to the global per-stage aggregates.
+void aggregateRequestTiming(const RequestTiming& timing);
+
+// Pushes the global aggregates as { stage = { count, avg, max, total } }, in milliseconds.
+void pushAggregatedTimings(GarrysMod::Lua::ILuaBase *LUA);
+void resetAggregatedTimings();
+
+#endif
@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <cstdio>
+#include "trace.h"
+
+TraceRing tracer;
+
+static const char *TRACE_NAMES[] = {
+	"callbackHook",
+	"createHTTPResponse",
+	"handler",
+	"request",
+};
+
+static std::string escapeJSON(const std::string& str) {
+	std::string escaped;
+
+	for (unsigned char c : str) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+			escaped += c;
+		} else if (c < 0x20) {
+			char buffer[8];
+			snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+			escaped += buffer;
+		} else {
+			escaped += c;
+		}
+	}
+
+	return escaped;
+}
+
+void TraceRing::enable(size_t capacity) {
+	events.assign(std::max<size_t>(1, std::min<size_t>(capacity, TRACE_MAX_CAPACITY)), TraceEvent());
+	next = 0;
+	wrapped = false;
+	enabled = true;
+}
+
+void TraceRing::disable() {
+	enabled = false;
+}
+
+void TraceRing::add(int kind, uint64 start, uint64 end, uint64 id, const std::string& detail) {
+	if (!enabled)
+		return;
+
+	TraceEvent& event = events[next];
+	event.kind = kind;
+	event.start = start;
+	event.end = end;
+	event.id = id;
+	event.detail = detail;
+
+	if (++next == events.size()) {
+		next = 0;
+		wrapped = true;
+	}
+}
+
+bool TraceRing::flush(const std::string& path) {
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+	fputs("{\"ph\":\"M\",\"pid\":1,\"tid\":1,\"name\":\"thread_name\",\"args\":{\"name\":\"Game thread\"}}", file);
+	fputs(",\n{\"ph\":\"M\",\"pid\":1,\"tid\":2,\"name\":\"thread_name\",\"args\":{\"name\":\"Response workers\"}}", file);
+
+	size_t count = wrapped ? events.size() : next;
+	size_t first = wrapped ? next : 0;
+
+	for (size_t i = 0; i < count; i++) {
+		const TraceEvent& event = events[(first + i) % events.size()];
+		unsigned long long start = event.start, end = event.end;
+
+		// Requests overlap, so they are async spans on their own tracks
+		if (event.kind == TRACE_REQUEST) {
+			std::string url = escapeJSON(event.detail);
+			fprintf(file, ",\n{\"ph\":\"b\",\"cat\":\"request\",\"name\":\"%s\",\"id\":%llu,\"pid\":1,\"tid\":1,\"ts\":%llu,\"args\":{\"url\":\"%s\"}}",
+			        url.c_str(), (unsigned long long)event.id, start, url.c_str());
+			fprintf(file, ",\n{\"ph\":\"e\",\"cat\":\"request\",\"name\":\"%s\",\"id\":%llu,\"pid\":1,\"tid\":1,\"ts\":%llu}",
+			        url.c_str(), (unsigned long long)event.id, end);
+		} else {
+			// Responses are read on the worker threads
+			int tid = event.kind == TRACE_RESPONSE ? 2 : 1;
+			fprintf(file, ",\n{\"ph\":\"X\",\"cat\":\"steamhttp\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%llu,\"dur\":%llu}",
+			        TRACE_NAMES[event.kind], tid, start, end - start);
+		}
+	}
+
+	fputs("\n]}\n", file);
+	fclose(file);
+
+	return true;
+}
@@ -0,0 +1,57 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <string>
+#include <vector>
+#include "steamtypes.h"
+
+enum {
+	TRACE_HOOK,     // one callbackHook invocation
+	TRACE_RESPONSE, // createHTTPResponse, on a completion worker
+	TRACE_HANDLER,  // a Lua success or fail handler
+	TRACE_REQUEST,  // a request from sending until the backend finished it
+};
+
+struct TraceEvent {
+	int kind;
+	uint64 start;
+	uint64 end;
+
+	// Identifies requests, which overlap each other
+	uint64 id;
+
+	// URL for requests, empty otherwise
+	std::string detail;
+};
+
+// Default and largest number of spans the ring holds. Each span is about
+// 64 bytes plus its URL.
+#define TRACE_DEFAULT_CAPACITY 65536
+#define TRACE_MAX_CAPACITY 1048576
+
+// Ring of recent spans that can be written out in Chrome's trace_event
+// format (load it in chrome://tracing or Perfetto). Spans are added
+// from the game thread only, so it needs no locking; while disabled, adding a span is
+// a single branch.
+class TraceRing {
+	std::vector<TraceEvent> events;
+	size_t next = 0;
+	bool wrapped = false;
+	bool enabled = false;
+
+public:
+	// Clears the ring and starts recording into `capacity` spans, at most
+	// TRACE_MAX_CAPACITY
+	void enable(size_t capacity);
+	void disable();
+	bool active() { return enabled; }
+
+	void add(int kind, uint64 start, uint64 end, uint64 id = 0, const std::string& detail = "");
+
+	// Writes the ring, oldest span first. The ring is left as it is.
+	bool flush(const std::string& path);
+};
+
+extern TraceRing tracer;
+
+#endif
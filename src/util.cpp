@@ -0,0 +1,54 @@
+#include <chrono>
+#include "util.h"
+
+uint64 nowMicros() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double clampNumber(double value, double min, double max) {
+	if (!(value >= min))
+		return min;
+
+	return value > max ? max : value;
+}
+
+std::string dataPath(const std::string& name) {
+	if (name.empty() || name[0] == '/' || name[0] == '\\' || name.find(':') != std::string::npos)
+		return "";
+
+	if (name.find("..") != std::string::npos)
+		return "";
+
+	return "garrysmod/data/" + name;
+}
+
+std::string urlHost(const std::string& url) {
+	size_t start = url.find("://");
+	start = start == std::string::npos ? 0 : start + 3;
+
+	size_t end = url.find_first_of("/?#", start);
+	std::string host = url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+
+	size_t at = host.rfind('@');
+	if (at != std::string::npos)
+		host.erase(0, at + 1);
+
+	if (!host.empty() && host[0] == '[') {
+		// IPv6 literal, keep the brackets
+		size_t close = host.find(']');
+		if (close != std::string::npos)
+			host.erase(close + 1);
+	} else {
+		size_t colon = host.find(':');
+		if (colon != std::string::npos)
+			host.erase(colon);
+	}
+
+	for (char& c : host) {
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+	}
+
+	return host;
+}
@@ -0,0 +1,22 @@
+#ifndef _UTIL_H
+#define _UTIL_H
+
+#include <string>
+#include "steamtypes.h"
+
+// Monotonic timestamp in microseconds, only meaningful as a difference
+uint64 nowMicros();
+
+// Maps a file name to a path inside garrysmod/data/, the only place that
+// the module writes to. Returns an empty string for names that would
+// escape that directory.
+std::string dataPath(const std::string& name);
+
+// Clamps a Lua number into [min, max] so it can be converted to an integer
+// type, which is undefined for NaN and out of range values. NaN gives `min`.
+double clampNumber(double value, double min, double max);
+
+// Lowercased host name of a URL, without scheme, credentials or port
+std::string urlHost(const std::string& url);
+
+#endif
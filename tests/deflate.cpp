@@ -0,0 +1,130 @@
+#include <cstdlib>
+#include <string>
+#include "test.h"
+#include "deflate.h"
+
+// zlib is the reference inflater. It isn't part of the Windows
+// toolchain, so the round trips only run elsewhere.
+#ifndef WINDOWS_BUILD
+#include <zlib.h>
+
+// Inflates a zlib (`windowbits` 15) or gzip (31) stream, false if zlib
+// finds it broken or it doesn't end where the data does
+static bool inflateStream(const std::string& compressed, int windowbits, std::string *out) {
+	z_stream stream = z_stream();
+	char buffer[16384];
+	int status = Z_OK;
+
+	if (inflateInit2(&stream, windowbits) != Z_OK)
+		return false;
+
+	stream.next_in = (Bytef *)compressed.data();
+	stream.avail_in = compressed.size();
+	out->clear();
+
+	while (status == Z_OK) {
+		stream.next_out = (Bytef *)buffer;
+		stream.avail_out = sizeof(buffer);
+		status = inflate(&stream, Z_NO_FLUSH);
+		out->append(buffer, sizeof(buffer) - stream.avail_out);
+	}
+
+	bool complete = status == Z_STREAM_END && stream.avail_in == 0;
+	inflateEnd(&stream);
+	return complete;
+}
+
+// Inputs that make the compressor pick each block type: random bytes
+// (stored or fixed, with literals from all of 0-255), a small alphabet
+// (dynamic), long runs (matches of 258) and mixed text
+static std::string sampleInput(int kind, size_t length, unsigned int seed) {
+	static const char TEXT[] = "{\"player\": \"STEAM_0:1:2345\", \"event\": \"kill\", \"weapon\": \"crowbar\"}\n";
+	std::string data(length, '\0');
+
+	srand(seed);
+
+	for (size_t i = 0; i < length; i++) {
+		switch (kind) {
+		case 0:
+			data[i] = (char)rand();
+			break;
+		case 1:
+			data[i] = "abcde"[rand() % 5];
+			break;
+		case 2:
+			data[i] = i % 1000 < 900 ? 'x' : (char)rand();
+			break;
+		default:
+			data[i] = rand() % 50 ? TEXT[i % (sizeof(TEXT) - 1)] : (char)rand();
+			break;
+		}
+	}
+
+	return data;
+}
+
+// Compresses `data` at every level in both framings and checks that zlib
+// gets the same data back
+static void checkRoundTrips(const std::string& data, const std::string& name) {
+	for (int level = 0; level <= 9; level++) {
+		std::string zlibbed, gzipped, inflated;
+
+		zlibCompress(data.data(), data.size(), level, &zlibbed);
+		bool ok = inflateStream(zlibbed, 15, &inflated) && inflated == data;
+		if (!ok)
+			failCheck(__FILE__, __LINE__, name + ": zlib stream at level " + std::to_string(level) + " doesn't inflate");
+
+		gzipCompress(data.data(), data.size(), level, &gzipped);
+		ok = inflateStream(gzipped, 31, &inflated) && inflated == data;
+		if (!ok)
+			failCheck(__FILE__, __LINE__, name + ": gzip stream at level " + std::to_string(level) + " doesn't inflate");
+	}
+}
+
+void registerDeflateTests() {
+	addTest("deflate/short", []() {
+		checkRoundTrips("", "empty");
+		checkRoundTrips("a", "one byte");
+		checkRoundTrips("aaaaaaaaaa", "run");
+		checkRoundTrips(std::string(1, '\xd2'), "high literal");
+	});
+
+	addTest("deflate/known-output", []() {
+		// What zlib itself produces for this input at level 6
+		std::string out;
+		zlibCompress("aaaaaaaaaa", 10, 6, &out);
+		CHECK_EQUAL(out, std::string("\x78\x9c\x4b\x84\x03\x00\x14\xe1\x03\xcb", 10));
+	});
+
+	addTest("deflate/all-bytes", []() {
+		std::string data;
+		for (int i = 0; i < 256; i++)
+			data += (char)i;
+
+		checkRoundTrips(data, "all bytes");
+	});
+
+	addTest("deflate/random-inputs", []() {
+		for (unsigned int seed = 1; seed <= 40; seed++) {
+			int kind = seed % 4;
+			size_t length = seed % 8 ? seed * 997 % 5000 : 65717 + seed * 1000;
+			checkRoundTrips(sampleInput(kind, length, seed), "kind " + std::to_string(kind) + ", seed " + std::to_string(seed));
+		}
+	});
+
+	addTest("deflate/compresses", []() {
+		std::string data = sampleInput(3, 100000, 1), out;
+
+		gzipCompress(data.data(), data.size(), 6, &out);
+		CHECK(out.size() < data.size() / 5);
+	});
+
+	addTest("deflate/checksums", []() {
+		CHECK_EQUAL(crc32("123456789", 9), 0xcbf43926u);
+		CHECK_EQUAL(adler32("Wikipedia", 9), 0x11e60398u);
+	});
+}
+#else
+void registerDeflateTests() {
+}
+#endif
@@ -0,0 +1,936 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "test.h"
+#include "fakelua.h"
+#include "mockbackend.h"
+#include "steamhttp.h"
+#include "submission.h"
+#include "completion.h"
+#include "recording.h"
+#include "metrics.h"
+#include "batch.h"
+#include "client.h"
+#include "profiler.h"
+#include "responseobject.h"
+
+static FakeLua lua;
+static MockBackend mock;
+
+// What a handler was called with
+struct HandlerCall {
+	int calls = 0;
+	int args = 0;
+	double code = 0;
+	std::string body;
+	bool decoded = false;
+	std::string contenttype;
+	std::string reason;
+};
+
+// Pushes a success handler that stores its arguments in `call`
+static void pushSuccessHandler(FakeLua *LUA, HandlerCall *call) {
+	LUA->pushFunction([call](FakeLua *LUA) {
+		call->calls++;
+		call->args = LUA->Top();
+		call->code = LUA->GetNumber(1);
+
+		unsigned int length = 0;
+		const char *body = LUA->GetString(2, &length);
+		call->body.assign(body ? body : "", length);
+		call->decoded = LUA->IsType(2, Lua::Type::TABLE);
+
+		if (LUA->IsType(3, Lua::Type::TABLE)) {
+			LUA->GetField(3, "Content-Type");
+			call->contenttype = LUA->IsType(-1, Lua::Type::STRING) ? LUA->GetString(-1) : "";
+			LUA->Pop();
+		}
+
+		return 0;
+	});
+}
+
+// The same for fail handlers
+static void pushFailHandler(FakeLua *LUA, HandlerCall *call) {
+	LUA->pushFunction([call](FakeLua *LUA) {
+		call->calls++;
+		call->args = LUA->Top();
+		call->reason = LUA->GetString(1) ? LUA->GetString(1) : "";
+		return 0;
+	});
+}
+
+// Sends a request to `url` through STEAMHTTP and ticks until it finished
+static void roundtrip(FakeLua *LUA, const char *url, HandlerCall *success, HandlerCall *failed, const char *decode = nullptr) {
+	LUA->PushCFunction(STEAMHTTP);
+	LUA->CreateTable();
+	LUA->PushString(url);
+	LUA->SetField(-2, "url");
+	if (decode) {
+		LUA->PushString(decode);
+		LUA->SetField(-2, "decode");
+	}
+	pushSuccessHandler(LUA, success);
+	LUA->SetField(-2, "success");
+	pushFailHandler(LUA, failed);
+	LUA->SetField(-2, "failed");
+	LUA->Call(1, 1);
+	LUA->Pop();
+
+	for (int tick = 0; tick < 1000 && !success->calls && !failed->calls; tick++) {
+		submitter.wait();
+		completions.settle();
+
+		LUA->PushCFunction(callbackHook);
+		LUA->Call(0, 0);
+	}
+}
+
+// The steamhttp_requests_in_flight gauge as renderMetrics reports it
+static long inFlightGauge() {
+	std::string rendered = renderMetrics();
+	const char *name = "\nsteamhttp_requests_in_flight ";
+	size_t at = rendered.find(name);
+
+	return at == std::string::npos ? -1 : strtol(rendered.c_str() + at + strlen(name), nullptr, 10);
+}
+
+// What a batch's done handler got for one request
+struct BatchResult {
+	double code = 0;
+	std::string body;
+	std::string error;
+};
+
+// Pushes a done handler that stores the results in `results`, and counts
+// its calls in `calls`
+static void pushDoneHandler(FakeLua *LUA, std::vector<BatchResult> *results, int *calls) {
+	LUA->pushFunction([results, calls](FakeLua *LUA) {
+		(*calls)++;
+		results->clear();
+
+		for (int i = 1; i <= LUA->ObjLen(1); i++) {
+			BatchResult result;
+
+			LUA->PushNumber(i);
+			LUA->GetTable(1);
+			LUA->GetField(-1, "code");
+			LUA->GetField(-2, "body");
+			LUA->GetField(-3, "error");
+			result.code = LUA->IsType(-3, Lua::Type::NUMBER) ? LUA->GetNumber(-3) : 0;
+			result.body = LUA->IsType(-2, Lua::Type::STRING) ? LUA->GetString(-2) : "";
+			result.error = LUA->IsType(-1, Lua::Type::STRING) ? LUA->GetString(-1) : "";
+			LUA->Pop(4);
+
+			results->push_back(result);
+		}
+
+		return 0;
+	});
+}
+
+// Calls method `name` of the object at stack position 1 with numbers as
+// arguments, and returns its first result as a string ("nil" for nil)
+static std::string callMethod(FakeLua *LUA, const char *name, std::vector<double> args = {}) {
+	LUA->GetField(1, name);
+	LUA->Push(1);
+	for (double arg : args)
+		LUA->PushNumber(arg);
+	LUA->Call(1 + args.size(), 1);
+
+	std::string result = "nil";
+	if (LUA->IsType(-1, Lua::Type::NUMBER))
+		result = std::to_string((long)LUA->GetNumber(-1));
+	else if (LUA->IsType(-1, Lua::Type::STRING))
+		result = LUA->GetString(-1);
+	else if (!LUA->IsType(-1, Lua::Type::NIL))
+		result = LUA->GetTypeName(LUA->GetType(-1));
+
+	LUA->Pop();
+	return result;
+}
+
+void registerHandlerTests() {
+	FakeLua *LUA = &lua;
+
+	addTest("handlers/runSuccessHandler", [=]() {
+		HandlerCall call;
+		HTTPResponse response = HTTPResponse();
+		response.code = 201;
+		response.body = std::string("a\0b", 3);
+		response.headers["Content-Type"] = "text/plain";
+
+		size_t references = LUA->referenceCount();
+		pushSuccessHandler(LUA, &call);
+		runSuccessHandler(LUA, LUA->ReferenceCreate(), response);
+
+		CHECK_EQUAL(call.calls, 1);
+		CHECK_EQUAL(call.args, 3);
+		CHECK_EQUAL(call.code, 201.0);
+		CHECK_EQUAL(call.body, std::string("a\0b", 3));
+		CHECK_EQUAL(call.contenttype, "text/plain");
+		CHECK_EQUAL(LUA->referenceCount(), references);
+	});
+
+	addTest("handlers/runFailedHandler", [=]() {
+		HandlerCall call;
+
+		size_t references = LUA->referenceCount();
+		pushFailHandler(LUA, &call);
+		runFailedHandler(LUA, LUA->ReferenceCreate(), "broken");
+
+		CHECK_EQUAL(call.calls, 1);
+		CHECK_EQUAL(call.args, 1);
+		CHECK_EQUAL(call.reason, "broken");
+		CHECK_EQUAL(LUA->referenceCount(), references);
+	});
+
+	addTest("handlers/no-handler", [=]() {
+		HTTPResponse response = HTTPResponse();
+		size_t depth = LUA->depth();
+
+		runSuccessHandler(LUA, 0, response);
+		runFailedHandler(LUA, 0, "ignored");
+		CHECK_EQUAL(LUA->depth(), depth);
+	});
+
+	addTest("handlers/success", [=]() {
+		backend = &mock;
+
+		MockResponse scripted;
+		scripted.code = 404;
+		scripted.body = "not here";
+		scripted.headers["Content-Type"] = "text/html";
+		mock.script("http://127.0.0.1/success", scripted);
+
+		HandlerCall success, failed;
+		roundtrip(LUA, "http://127.0.0.1/success", &success, &failed);
+
+		CHECK_EQUAL(success.calls, 1);
+		CHECK_EQUAL(failed.calls, 0);
+		CHECK_EQUAL(success.code, 404.0);
+		CHECK_EQUAL(success.body, "not here");
+		CHECK_EQUAL(success.contenttype, "text/html");
+	});
+
+	addTest("handlers/unsuccessful", [=]() {
+		backend = &mock;
+
+		MockResponse scripted;
+		scripted.unsuccessful = true;
+		mock.script("http://127.0.0.1/unsuccessful", scripted);
+
+		HandlerCall success, failed;
+		roundtrip(LUA, "http://127.0.0.1/unsuccessful", &success, &failed);
+
+		CHECK_EQUAL(success.calls, 0);
+		CHECK_EQUAL(failed.calls, 1);
+		CHECK_EQUAL(failed.reason, "HTTP Error: HTTP Request was unsuccessful");
+	});
+
+	addTest("handlers/api-failure", [=]() {
+		backend = &mock;
+
+		MockResponse scripted;
+		scripted.apifailure = true;
+		mock.script("http://127.0.0.1/apifailure", scripted);
+
+		HandlerCall success, failed;
+		roundtrip(LUA, "http://127.0.0.1/apifailure", &success, &failed);
+
+		CHECK_EQUAL(success.calls, 0);
+		CHECK_EQUAL(failed.calls, 1);
+		CHECK(!failed.reason.empty());
+	});
+
+	addTest("handlers/send-failure", [=]() {
+		backend = &mock;
+
+		// The mock refuses anything that isn't http(s)
+		HandlerCall success, failed;
+		roundtrip(LUA, "ftp://127.0.0.1/file", &success, &failed);
+
+		CHECK_EQUAL(success.calls, 0);
+		CHECK_EQUAL(failed.calls, 1);
+	});
+
+	addTest("handlers/decode", [=]() {
+		backend = &mock;
+
+		MockResponse scripted;
+		scripted.body = "{\"a\": 1}";
+		mock.script("http://127.0.0.1/decode", scripted);
+
+		HandlerCall success, failed;
+		roundtrip(LUA, "http://127.0.0.1/decode", &success, &failed, "json");
+
+		CHECK_EQUAL(success.calls, 1);
+		CHECK_EQUAL(failed.calls, 0);
+		CHECK(success.decoded);
+	});
+
+	// Error pages and empty bodies keep their status code
+	addTest("handlers/decode-skipped", [=]() {
+		backend = &mock;
+
+		MockResponse errorpage;
+		errorpage.code = 502;
+		errorpage.body = "<html>Bad Gateway</html>";
+		mock.script("http://127.0.0.1/errorpage", errorpage);
+
+		MockResponse nocontent;
+		nocontent.code = 204;
+		mock.script("http://127.0.0.1/nocontent", nocontent);
+
+		const char *decodings[] = {"json", "msgpack"};
+
+		for (const char *decode : decodings) {
+			HandlerCall success, failed;
+			roundtrip(LUA, "http://127.0.0.1/errorpage", &success, &failed, decode);
+
+			CHECK_EQUAL(success.calls, 1);
+			CHECK_EQUAL(failed.calls, 0);
+			CHECK_EQUAL(success.code, 502.0);
+			CHECK_EQUAL(success.body, "<html>Bad Gateway</html>");
+
+			HandlerCall emptysuccess, emptyfailed;
+			roundtrip(LUA, "http://127.0.0.1/nocontent", &emptysuccess, &emptyfailed, decode);
+
+			CHECK_EQUAL(emptysuccess.calls, 1);
+			CHECK_EQUAL(emptyfailed.calls, 0);
+			CHECK_EQUAL(emptysuccess.code, 204.0);
+			CHECK_EQUAL(emptysuccess.body, "");
+		}
+	});
+
+	// Invalid JSON in a 2xx response is still a failure
+	addTest("handlers/decode-invalid", [=]() {
+		backend = &mock;
+
+		MockResponse scripted;
+		scripted.body = "{not json";
+		mock.script("http://127.0.0.1/invalid", scripted);
+
+		HandlerCall success, failed;
+		roundtrip(LUA, "http://127.0.0.1/invalid", &success, &failed, "json");
+
+		CHECK_EQUAL(success.calls, 0);
+		CHECK_EQUAL(failed.calls, 1);
+		CHECK_EQUAL(failed.reason.compare(0, 11, "JSON Error:"), 0);
+	});
+
+	addTest("handlers/recording", [=]() {
+		backend = &mock;
+
+		MockResponse scripted;
+		scripted.code = 201;
+		scripted.body = "recorded";
+		mock.script("http://127.0.0.1/recorded", scripted);
+
+		const char *path = "steamhttp_test.shrl";
+		CHECK(recorder.start(path, false));
+
+		HandlerCall success, failed;
+		roundtrip(LUA, "http://127.0.0.1/recorded", &success, &failed);
+		recorder.stop();
+
+		std::vector<RecordedExchange> exchanges;
+		CHECK(loadRecording(path, &exchanges));
+		remove(path);
+
+		CHECK_EQUAL(exchanges.size(), 1u);
+		if (!exchanges.empty()) {
+			CHECK_EQUAL(exchanges[0].url, "http://127.0.0.1/recorded");
+			CHECK(exchanges[0].successful);
+			CHECK_EQUAL(exchanges[0].code, 201);
+			CHECK_EQUAL(exchanges[0].responsebody, "recorded");
+		}
+	});
+
+	// Exchanges recorded after stop() don't leak into the next recording
+	addTest("handlers/recording-restart", [=]() {
+		const char *path = "steamhttp_test.shrl";
+		RecordedExchange exchange;
+		exchange.url = "http://127.0.0.1/late";
+
+		CHECK(recorder.start(path, false));
+		recorder.stop();
+		recorder.record(exchange);
+
+		CHECK(recorder.start(path, false));
+		recorder.stop();
+
+		std::vector<RecordedExchange> exchanges;
+		CHECK(loadRecording(path, &exchanges));
+		remove(path);
+		CHECK_EQUAL(exchanges.size(), 0u);
+	});
+
+	// Every finished request leaves the gauge once, however it ended
+	addTest("handlers/in-flight-gauge", [=]() {
+		backend = &mock;
+
+		MockResponse invalid;
+		invalid.body = "{not json";
+		mock.script("http://127.0.0.1/gauge-decode", invalid);
+
+		MockResponse odd;
+		odd.code = 999;
+		mock.script("http://127.0.0.1/gauge-odd", odd);
+
+		// One request stays in flight throughout, so a gauge that drifts
+		// either way shows
+		MockResponse slow;
+		slow.latency = 1000;
+		mock.script("http://127.0.0.1/gauge-slow", slow);
+
+		HandlerCall slowsuccess, slowfailed;
+		LUA->PushCFunction(STEAMHTTP);
+		LUA->CreateTable();
+		LUA->PushString("http://127.0.0.1/gauge-slow");
+		LUA->SetField(-2, "url");
+		pushSuccessHandler(LUA, &slowsuccess);
+		LUA->SetField(-2, "success");
+		LUA->Call(1, 1);
+		LUA->Pop();
+		submitter.wait();
+
+		long before = inFlightGauge();
+		CHECK(before >= 1);
+
+		HandlerCall oddsuccess, oddfailed;
+		roundtrip(LUA, "http://127.0.0.1/gauge-odd", &oddsuccess, &oddfailed);
+		CHECK_EQUAL(oddsuccess.code, 999.0);
+		CHECK_EQUAL(inFlightGauge(), before);
+
+		HandlerCall success, failed;
+		roundtrip(LUA, "http://127.0.0.1/gauge-decode", &success, &failed, "json");
+		CHECK_EQUAL(failed.calls, 1);
+		CHECK_EQUAL(inFlightGauge(), before);
+
+		mock.advance(1000);
+		for (int tick = 0; tick < 1000 && !slowsuccess.calls; tick++) {
+			completions.settle();
+			LUA->PushCFunction(callbackHook);
+			LUA->Call(0, 0);
+		}
+		CHECK_EQUAL(inFlightGauge(), before - 1);
+	});
+
+	// A budget of 0 still handles one request per tick
+	addTest("handlers/dispatch-budget-zero", [=]() {
+		backend = &mock;
+
+		HandlerCall first, second, failed;
+		HandlerCall *calls[2] = {&first, &second};
+
+		for (HandlerCall *call : calls) {
+			LUA->PushCFunction(STEAMHTTP);
+			LUA->CreateTable();
+			LUA->PushString("http://127.0.0.1/budget");
+			LUA->SetField(-2, "url");
+			pushSuccessHandler(LUA, call);
+			LUA->SetField(-2, "success");
+			pushFailHandler(LUA, &failed);
+			LUA->SetField(-2, "failed");
+			LUA->Call(1, 1);
+			LUA->Pop();
+		}
+
+		submitter.wait();
+		completions.settle();
+
+		LUA->PushCFunction(DispatchBudget);
+		LUA->PushNumber(0);
+		LUA->Call(1, 0);
+
+		LUA->PushCFunction(callbackHook);
+		LUA->Call(0, 0);
+		CHECK_EQUAL(first.calls + second.calls, 1);
+
+		LUA->PushCFunction(callbackHook);
+		LUA->Call(0, 0);
+		CHECK_EQUAL(first.calls + second.calls, 2);
+		CHECK_EQUAL(failed.calls, 0);
+
+		LUA->PushCFunction(DispatchBudget);
+		LUA->PushNumber(2);
+		LUA->Call(1, 0);
+	});
+
+	// A handler error is logged, and the batch still finishes
+	addTest("handlers/handler-error", [=]() {
+		backend = &mock;
+
+		int done = 0;
+		HandlerCall success, failed;
+
+		LUA->PushCFunction(Batch);
+		LUA->CreateTable();
+		for (int i = 1; i <= 2; i++) {
+			LUA->PushNumber(i);
+			LUA->CreateTable();
+			LUA->PushString("http://127.0.0.1/handler-error");
+			LUA->SetField(-2, "url");
+			if (i == 1) {
+				LUA->pushFunction([](FakeLua *LUA) {
+					LUA->ThrowError("broken handler");
+					return 0;
+				});
+			} else {
+				pushSuccessHandler(LUA, &success);
+			}
+			LUA->SetField(-2, "success");
+			pushFailHandler(LUA, &failed);
+			LUA->SetField(-2, "failed");
+			LUA->SetTable(-3);
+		}
+		LUA->CreateTable();
+		LUA->pushFunction([&done](FakeLua *LUA) {
+			done = LUA->ObjLen(1);
+			return 0;
+		});
+		LUA->SetField(-2, "done");
+		LUA->Call(2, 1);
+		LUA->Pop();
+
+		lua.printed.clear();
+		for (int tick = 0; tick < 1000 && !done; tick++) {
+			submitter.wait();
+			completions.settle();
+
+			LUA->PushCFunction(callbackHook);
+			LUA->Call(0, 0);
+		}
+
+		CHECK_EQUAL(done, 2);
+		CHECK_EQUAL(success.calls, 1);
+		CHECK_EQUAL(failed.calls, 0);
+
+		bool logged = false;
+		for (const std::string& line : lua.printed)
+			logged = logged || line.find("broken handler") != std::string::npos;
+		CHECK(logged);
+	});
+
+	// Handler time goes to where the handler was defined, which is looked
+	// up once per function
+	addTest("handlers/profiler", [=]() {
+		backend = &mock;
+
+		int lookups = 0;
+		LUA->CreateTable();
+		// callerAddon asks about stack levels, only count functions
+		LUA->pushFunction([&lookups](FakeLua *LUA) {
+			if (LUA->IsType(1, Lua::Type::FUNCTION))
+				lookups++;
+			LUA->CreateTable();
+			LUA->PushString("addons/test/lua/handler.lua");
+			LUA->SetField(-2, "short_src");
+			LUA->PushNumber(12);
+			LUA->SetField(-2, "linedefined");
+			return 1;
+		});
+		LUA->SetField(-2, "getinfo");
+		lua.setGlobal("debug");
+
+		resetHandlerStats();
+
+		int calls = 0;
+		LUA->pushFunction([&calls](FakeLua *) {
+			calls++;
+			return 0;
+		});
+
+		for (int i = 1; i <= 2; i++) {
+			LUA->PushCFunction(STEAMHTTP);
+			LUA->CreateTable();
+			LUA->PushString("http://127.0.0.1/profiler");
+			LUA->SetField(-2, "url");
+			LUA->Push(-3);
+			LUA->SetField(-2, "success");
+			LUA->Call(1, 1);
+			LUA->Pop();
+
+			for (int tick = 0; tick < 1000 && calls < i; tick++) {
+				submitter.wait();
+				completions.settle();
+
+				LUA->PushCFunction(callbackHook);
+				LUA->Call(0, 0);
+			}
+		}
+		LUA->Pop();
+
+		CHECK_EQUAL(calls, 2);
+		CHECK_EQUAL(lookups, 1);
+
+		pushHandlerStats(LUA);
+		LUA->GetField(-1, "addons/test/lua/handler.lua:12");
+		CHECK(LUA->IsType(-1, Lua::Type::TABLE));
+		if (LUA->IsType(-1, Lua::Type::TABLE)) {
+			LUA->GetField(-1, "count");
+			CHECK_EQUAL(LUA->GetNumber(-1), 2.0);
+			LUA->Pop();
+		}
+		LUA->Pop(2);
+
+		LUA->PushNil();
+		lua.setGlobal("debug");
+		resetHandlerStats();
+	});
+
+	addTest("handlers/lazy", [=]() {
+		backend = &mock;
+		registerResponseObject(LUA);
+
+		MockResponse response;
+		response.body = "{\"a\": 1}";
+		response.headers["Content-Type"] = "application/json";
+		mock.script("http://127.0.0.1/lazy", response);
+
+		std::vector<std::string> results;
+		int args = 0;
+		bool closed = false;
+
+		LUA->PushCFunction(STEAMHTTP);
+		LUA->CreateTable();
+		LUA->PushString("http://127.0.0.1/lazy");
+		LUA->SetField(-2, "url");
+		LUA->PushBool(true);
+		LUA->SetField(-2, "lazy");
+		LUA->pushFunction([&](FakeLua *LUA) {
+			args = LUA->Top();
+			results.push_back(callMethod(LUA, "Status"));
+			results.push_back(callMethod(LUA, "Body"));
+			results.push_back(callMethod(LUA, "Size"));
+			results.push_back(callMethod(LUA, "Sub", {2, 3}));
+			results.push_back(callMethod(LUA, "Sub", {-2}));
+			results.push_back(callMethod(LUA, "Sub", {0, 1e300}));
+			results.push_back(callMethod(LUA, "Sub", {-1e300, NAN}));
+			results.push_back(callMethod(LUA, "Sub", {1e300}));
+			results.push_back(callMethod(LUA, "Json"));
+
+			LUA->GetField(1, "Header");
+			LUA->Push(1);
+			LUA->PushString("content-TYPE");
+			LUA->Call(2, 1);
+			results.push_back(LUA->IsType(-1, Lua::Type::STRING) ? LUA->GetString(-1) : "nil");
+			LUA->Pop();
+
+			callMethod(LUA, "Close");
+			results.push_back(callMethod(LUA, "__tostring"));
+
+			LUA->GetField(1, "Status");
+			LUA->Push(1);
+			closed = LUA->PCall(1, 1, 0) != 0;
+			LUA->Pop();
+			return 0;
+		});
+		LUA->SetField(-2, "success");
+		LUA->Call(1, 1);
+		LUA->Pop();
+
+		for (int tick = 0; tick < 1000 && !args; tick++) {
+			submitter.wait();
+			completions.settle();
+
+			LUA->PushCFunction(callbackHook);
+			LUA->Call(0, 0);
+		}
+
+		std::vector<std::string> expected = {
+			"200", "{\"a\": 1}", "8", "\"a", "1}", "{\"a\": 1}", "", "", "table",
+			"application/json", "STEAMHTTP response: closed",
+		};
+
+		CHECK_EQUAL(args, 1);
+		CHECK_EQUAL(results.size(), expected.size());
+		for (size_t i = 0; i < results.size() && i < expected.size(); i++)
+			CHECK_EQUAL(results[i], expected[i]);
+		CHECK(closed);
+	});
+
+	addTest("handlers/extract", [=]() {
+		backend = &mock;
+
+		MockResponse response;
+		response.body = "{\"response\": {\"players\": [{\"steamid\": \"1\", \"name\": \"a\"}, {\"steamid\": \"2\"}], \"count\": 2}}";
+		mock.script("http://127.0.0.1/extract", response);
+
+		const char *paths[] = {"response.players[*].steamid", "response.count", "response.players[0].name", "response.players[1].name"};
+		std::vector<std::string> steamids;
+		double count = 0;
+		std::string name;
+		bool missing = false, others = false;
+		int calls = 0;
+
+		LUA->PushCFunction(STEAMHTTP);
+		LUA->CreateTable();
+		LUA->PushString("http://127.0.0.1/extract");
+		LUA->SetField(-2, "url");
+		LUA->CreateTable();
+		for (int i = 0; i < 4; i++) {
+			LUA->PushNumber(i + 1);
+			LUA->PushString(paths[i]);
+			LUA->SetTable(-3);
+		}
+		LUA->SetField(-2, "extract");
+		LUA->pushFunction([&](FakeLua *LUA) {
+			calls++;
+
+			LUA->GetField(2, paths[0]);
+			for (int i = 1; LUA->IsType(-1, Lua::Type::TABLE); i++) {
+				LUA->PushNumber(i);
+				LUA->GetTable(-2);
+				if (!LUA->IsType(-1, Lua::Type::STRING)) {
+					LUA->Pop();
+					break;
+				}
+				steamids.push_back(LUA->GetString(-1));
+				LUA->Pop();
+			}
+			LUA->Pop();
+
+			LUA->GetField(2, paths[1]);
+			count = LUA->GetNumber(-1);
+			LUA->GetField(2, paths[2]);
+			name = LUA->IsType(-1, Lua::Type::STRING) ? LUA->GetString(-1) : "";
+			LUA->GetField(2, paths[3]);
+			missing = LUA->IsType(-1, Lua::Type::NIL);
+			LUA->GetField(2, "response");
+			others = !LUA->IsType(-1, Lua::Type::NIL);
+			LUA->Pop(4);
+			return 0;
+		});
+		LUA->SetField(-2, "success");
+		LUA->Call(1, 1);
+		LUA->Pop();
+
+		for (int tick = 0; tick < 1000 && !calls; tick++) {
+			submitter.wait();
+			completions.settle();
+
+			LUA->PushCFunction(callbackHook);
+			LUA->Call(0, 0);
+		}
+
+		CHECK_EQUAL(calls, 1);
+		CHECK_EQUAL(steamids.size(), 2u);
+		if (steamids.size() == 2) {
+			CHECK_EQUAL(steamids[0], "1");
+			CHECK_EQUAL(steamids[1], "2");
+		}
+		CHECK_EQUAL(count, 2.0);
+		CHECK_EQUAL(name, "a");
+		CHECK(missing);
+		CHECK(!others);
+	});
+
+	// Results are in the order of the requests, not the order they finished
+	addTest("handlers/batch-order", [=]() {
+		backend = &mock;
+
+		MockResponse slow;
+		slow.body = "slow";
+		slow.latency = 1000;
+		mock.script("http://127.0.0.1/batch-slow", slow);
+
+		MockResponse fast;
+		fast.body = "fast";
+		mock.script("http://127.0.0.1/batch-fast", fast);
+
+		std::vector<BatchResult> results;
+		int done = 0;
+		HandlerCall fastsuccess, failed;
+
+		LUA->PushCFunction(Batch);
+		LUA->CreateTable();
+		LUA->PushNumber(1);
+		LUA->CreateTable();
+		LUA->PushString("http://127.0.0.1/batch-slow");
+		LUA->SetField(-2, "url");
+		LUA->SetTable(-3);
+		// No url, rejected while the batch is read
+		LUA->PushNumber(2);
+		LUA->CreateTable();
+		pushFailHandler(LUA, &failed);
+		LUA->SetField(-2, "failed");
+		LUA->SetTable(-3);
+		LUA->PushNumber(3);
+		LUA->CreateTable();
+		LUA->PushString("http://127.0.0.1/batch-fast");
+		LUA->SetField(-2, "url");
+		pushSuccessHandler(LUA, &fastsuccess);
+		LUA->SetField(-2, "success");
+		LUA->SetTable(-3);
+		LUA->CreateTable();
+		pushDoneHandler(LUA, &results, &done);
+		LUA->SetField(-2, "done");
+		LUA->Call(2, 1);
+		CHECK_EQUAL(LUA->GetNumber(-1), 2.0);
+		LUA->Pop();
+
+		CHECK_EQUAL(failed.calls, 1);
+		CHECK_EQUAL(failed.reason, "invalid url");
+
+		for (int tick = 0; tick < 1000 && !fastsuccess.calls; tick++) {
+			submitter.wait();
+			completions.settle();
+
+			LUA->PushCFunction(callbackHook);
+			LUA->Call(0, 0);
+		}
+
+		// Still waiting for the slow one
+		CHECK_EQUAL(fastsuccess.calls, 1);
+		CHECK_EQUAL(done, 0);
+
+		mock.advance(1000);
+		for (int tick = 0; tick < 1000 && !done; tick++) {
+			completions.settle();
+
+			LUA->PushCFunction(callbackHook);
+			LUA->Call(0, 0);
+		}
+
+		CHECK_EQUAL(done, 1);
+		CHECK_EQUAL(results.size(), 3u);
+		if (results.size() == 3) {
+			CHECK_EQUAL(results[0].code, 200.0);
+			CHECK_EQUAL(results[0].body, "slow");
+			CHECK_EQUAL(results[1].error, "invalid url");
+			CHECK_EQUAL(results[2].code, 200.0);
+			CHECK_EQUAL(results[2].body, "fast");
+		}
+	});
+
+	// With nothing sent, done runs right away
+	addTest("handlers/batch-nothing-sent", [=]() {
+		backend = &mock;
+
+		std::vector<BatchResult> results;
+		int done = 0;
+
+		LUA->PushCFunction(Batch);
+		LUA->CreateTable();
+		LUA->PushNumber(1);
+		LUA->CreateTable();
+		LUA->SetTable(-3);
+		LUA->PushNumber(2);
+		LUA->PushString("http://127.0.0.1/not-a-table");
+		LUA->SetTable(-3);
+		LUA->CreateTable();
+		pushDoneHandler(LUA, &results, &done);
+		LUA->SetField(-2, "done");
+		LUA->Call(2, 1);
+		CHECK_EQUAL(LUA->GetNumber(-1), 0.0);
+		LUA->Pop();
+
+		CHECK_EQUAL(done, 1);
+		CHECK_EQUAL(results.size(), 2u);
+		if (results.size() == 2) {
+			CHECK_EQUAL(results[0].error, "invalid url");
+			CHECK_EQUAL(results[1].error, "invalid request");
+		}
+
+		// And an empty batch too
+		LUA->PushCFunction(Batch);
+		LUA->CreateTable();
+		LUA->CreateTable();
+		pushDoneHandler(LUA, &results, &done);
+		LUA->SetField(-2, "done");
+		LUA->Call(2, 1);
+		LUA->Pop();
+
+		CHECK_EQUAL(done, 2);
+		CHECK_EQUAL(results.size(), 0u);
+	});
+
+	// A client's results from one tick arrive in a single ondone_batch call
+	addTest("handlers/ondone-batch", [=]() {
+		backend = &mock;
+		registerClient(LUA);
+
+		MockResponse refused;
+		refused.unsuccessful = true;
+		mock.script("http://127.0.0.1/ondone/refused", refused);
+
+		std::vector<std::vector<BatchResult>> deliveries;
+		std::vector<double> ids;
+
+		LUA->PushCFunction(Client);
+		LUA->CreateTable();
+		LUA->PushString("http://127.0.0.1/ondone");
+		LUA->SetField(-2, "base");
+		LUA->pushFunction([&](FakeLua *LUA) {
+			std::vector<BatchResult> results;
+
+			for (int i = 1; i <= LUA->ObjLen(1); i++) {
+				BatchResult result;
+
+				LUA->PushNumber(i);
+				LUA->GetTable(1);
+				LUA->GetField(-1, "id");
+				LUA->GetField(-2, "code");
+				LUA->GetField(-3, "error");
+				ids.push_back(LUA->GetNumber(-3));
+				result.code = LUA->IsType(-2, Lua::Type::NUMBER) ? LUA->GetNumber(-2) : 0;
+				result.error = LUA->IsType(-1, Lua::Type::STRING) ? LUA->GetString(-1) : "";
+				LUA->Pop(4);
+
+				results.push_back(result);
+			}
+
+			deliveries.push_back(results);
+			return 0;
+		});
+		LUA->SetField(-2, "ondone_batch");
+		LUA->Call(1, 1);
+
+		const char *paths[] = {"1", "refused", "3"};
+		for (const char *path : paths) {
+			LUA->GetField(-1, "Request");
+			LUA->Push(-2);
+			LUA->PushString(path);
+			LUA->Call(2, 1);
+			LUA->Pop();
+		}
+
+		submitter.wait();
+		completions.settle();
+		LUA->PushCFunction(callbackHook);
+		LUA->Call(0, 0);
+
+		CHECK_EQUAL(deliveries.size(), 1u);
+		if (deliveries.size() == 1) {
+			CHECK_EQUAL(deliveries[0].size(), 3u);
+
+			for (size_t i = 0; i < deliveries[0].size(); i++) {
+				if (ids[i] == 2) {
+					CHECK(!deliveries[0][i].error.empty());
+				} else {
+					CHECK_EQUAL(deliveries[0][i].code, 200.0);
+					CHECK(deliveries[0][i].error.empty());
+				}
+			}
+		}
+
+		std::sort(ids.begin(), ids.end());
+		CHECK(ids == std::vector<double>({1, 2, 3}));
+
+		// Nothing left over for the next tick
+		LUA->PushCFunction(callbackHook);
+		LUA->Call(0, 0);
+		CHECK_EQUAL(deliveries.size(), 1u);
+
+		// Collect the client, FakeLua has no garbage collector
+		LUA->GetField(-1, "__gc");
+		LUA->Insert(-2);
+		LUA->Call(1, 0);
+	});
+}
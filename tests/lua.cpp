@@ -0,0 +1,101 @@
+#include <map>
+#include <string>
+#include "test.h"
+#include "fakelua.h"
+#include "lua.h"
+
+static FakeLua lua;
+
+// The string at `key` of the table at the top of the stack, "<nil>" if unset
+static std::string field(FakeLua *LUA, const char *key) {
+	LUA->GetField(-1, key);
+	std::string value = LUA->IsType(-1, Lua::Type::STRING) ? LUA->GetString(-1) : "<nil>";
+	LUA->Pop();
+	return value;
+}
+
+void registerLuaTests() {
+	FakeLua *LUA = &lua;
+
+	addTest("lua/mapToLuaTable", [=]() {
+		std::map<std::string, std::string> map;
+		map["Content-Type"] = "application/json";
+		map["X-Empty"] = "";
+
+		size_t depth = LUA->depth();
+		mapToLuaTable(LUA, map);
+
+		CHECK_EQUAL(LUA->depth(), depth + 1);
+		CHECK(LUA->IsType(-1, Lua::Type::TABLE));
+		CHECK_EQUAL(field(LUA, "Content-Type"), "application/json");
+		CHECK_EQUAL(field(LUA, "X-Empty"), "");
+		CHECK_EQUAL(field(LUA, "X-Missing"), "<nil>");
+		LUA->Pop();
+	});
+
+	addTest("lua/mapToLuaTable-empty", [=]() {
+		mapToLuaTable(LUA, std::map<std::string, std::string>());
+
+		LUA->PushNil();
+		CHECK_EQUAL(LUA->Next(-2), 0);
+		LUA->Pop();
+	});
+
+	addTest("lua/mapFromLuaTable", [=]() {
+		LUA->CreateTable();
+		LUA->PushString("value");
+		LUA->SetField(-2, "key");
+		LUA->PushNumber(42);
+		LUA->SetField(-2, "number");
+
+		// Only string keys are taken
+		LUA->PushNumber(1);
+		LUA->PushString("list entry");
+		LUA->SetTable(-3);
+
+		size_t depth = LUA->depth();
+		std::map<std::string, std::string> map = mapFromLuaTable(LUA, -1);
+
+		CHECK_EQUAL(LUA->depth(), depth);
+		CHECK_EQUAL(map.size(), 2u);
+		CHECK_EQUAL(map["key"], "value");
+		CHECK_EQUAL(map["number"], "42");
+		LUA->Pop();
+	});
+
+	addTest("lua/map-roundtrip", [=]() {
+		std::map<std::string, std::string> map;
+		map["Accept"] = "*/*";
+		map["Authorization"] = "Bearer abc";
+		map["X-Server-Id"] = "27015";
+
+		mapToLuaTable(LUA, map);
+		CHECK(mapFromLuaTable(LUA, -1) == map);
+		LUA->Pop();
+	});
+
+	addTest("lua/pushJSON", [=]() {
+		std::string json = "{\"name\": \"x\", \"list\": [1, null, 3], \"ok\": true}";
+		JSONTape tape;
+		std::string error;
+		CHECK(parseJSON(json.c_str(), json.size(), &tape, &error));
+
+		pushJSON(LUA, tape);
+		CHECK_EQUAL(field(LUA, "name"), "x");
+
+		LUA->GetField(-1, "ok");
+		CHECK(LUA->IsType(-1, Lua::Type::BOOL) && LUA->GetBool(-1));
+		LUA->Pop();
+
+		// Nulls leave holes in arrays
+		LUA->GetField(-1, "list");
+		LUA->PushNumber(2);
+		LUA->GetTable(-2);
+		CHECK(LUA->IsType(-1, Lua::Type::NIL));
+		LUA->Pop();
+		LUA->PushNumber(3);
+		LUA->GetTable(-2);
+		CHECK_EQUAL(LUA->GetNumber(-1), 3.0);
+		LUA->Pop(3);
+	});
+}
@@ -0,0 +1,81 @@
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+#include "test.h"
+
+struct Test {
+	std::string name;
+	TestFunc body;
+};
+
+static std::vector<Test> tests;
+static bool failed;
+
+void addTest(std::string name, TestFunc body) {
+	tests.push_back({name, body});
+}
+
+void failCheck(const char *file, int line, const std::string& message) {
+	printf("  %s:%d: %s\n", file, line, message.c_str());
+	failed = true;
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "Usage: %s [--filter <substring>] [--list]\n", argv0);
+}
+
+int main(int argc, char **argv) {
+	bool list = false;
+	std::string filter;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--list") == 0) {
+			list = true;
+		} else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+			filter = argv[++i];
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	registerLuaTests();
+	registerRequestTests();
+	registerHandlerTests();
+	registerMsgPackTests();
+	registerDeflateTests();
+	registerNativeTests();
+
+	size_t run = 0, failures = 0;
+
+	for (Test& test : tests) {
+		if (test.name.find(filter) == std::string::npos)
+			continue;
+
+		if (list) {
+			printf("%s\n", test.name.c_str());
+			continue;
+		}
+
+		printf("%s\n", test.name.c_str());
+		failed = false;
+
+		// Errors raised through the fake ILuaBase end up here
+		try {
+			test.body();
+		} catch (std::exception& e) {
+			failCheck(__FILE__, __LINE__, std::string("uncaught exception: ") + e.what());
+		}
+
+		run++;
+		if (failed)
+			failures++;
+	}
+
+	if (!list)
+		printf("%zu of %zu tests passed\n", run - failures, run);
+
+	return failures ? 1 : 0;
+}
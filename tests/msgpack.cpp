@@ -0,0 +1,41 @@
+#include <string>
+#include "test.h"
+#include "msgpack.h"
+
+// Parses `data`, true if it is a valid document
+static bool parses(const std::string& data) {
+	JSONTape tape;
+	std::string error;
+
+	return parseMsgPack(data.data(), data.size(), &tape, &error);
+}
+
+void registerMsgPackTests() {
+	addTest("msgpack/map-keys", []() {
+		std::string map;
+
+		// {"a": 1, 2: true, false: nil}
+		appendMsgPackMap(&map, 3);
+		appendMsgPackString(&map, "a", 1);
+		appendMsgPackNumber(&map, 1);
+		appendMsgPackNumber(&map, 2);
+		appendMsgPackBool(&map, true);
+		appendMsgPackBool(&map, false);
+		appendMsgPackNil(&map);
+		CHECK(parses(map));
+	});
+
+	// Lua can't index a table with them
+	addTest("msgpack/invalid-map-keys", []() {
+		// {NaN: 1} as float 64 and float 32
+		CHECK(!parses(std::string("\x81\xcb\x7f\xf8\x00\x00\x00\x00\x00\x00\x01", 11)));
+		CHECK(!parses(std::string("\x81\xca\x7f\xc0\x00\x00\x01", 7)));
+
+		// {nil: 1}, {[]: 1}
+		CHECK(!parses(std::string("\x81\xc0\x01", 3)));
+		CHECK(!parses(std::string("\x81\x90\x01", 3)));
+
+		// NaN is still fine as a value
+		CHECK(parses(std::string("\x81\x01\xcb\x7f\xf8\x00\x00\x00\x00\x00\x00", 11)));
+	});
+}
@@ -0,0 +1,151 @@
+#include "test.h"
+#include "nativebackend.h"
+
+#ifdef NATIVE_BACKEND_AVAILABLE
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+static NativeBackend *native;
+
+// Answers every request on a connection with 200 and "ok", or never
+// answers at all if `silent`
+static void serveConnection(int fd, bool silent) {
+	const std::string response = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+	std::string in;
+	char buffer[4096];
+	ssize_t received;
+
+	while ((received = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+		in.append(buffer, received);
+
+		size_t end;
+		while ((end = in.find("\r\n\r\n")) != std::string::npos) {
+			in.erase(0, end + 4);
+			if (!silent)
+				send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+		}
+	}
+
+	close(fd);
+}
+
+// Starts a server on an ephemeral local port and returns the port
+static int startServer(bool silent) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in addr = {};
+	socklen_t len = sizeof(addr);
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	bind(fd, (sockaddr *)&addr, sizeof(addr));
+	listen(fd, 16);
+	getsockname(fd, (sockaddr *)&addr, &len);
+
+	std::thread([=]() {
+		int client;
+		while ((client = accept(fd, nullptr, nullptr)) >= 0)
+			std::thread(serveConnection, client, silent).detach();
+	}).detach();
+
+	return ntohs(addr.sin_port);
+}
+
+// Sends `request` and waits up to 5 seconds for it to finish
+static bool sendAndWait(HTTPRequestHandle request, HTTPRequestCompleted_t *result) {
+	SteamAPICall_t apicall;
+	bool failed;
+
+	if (!native->sendRequest(request, &apicall))
+		return false;
+
+	for (int i = 0; i < 500; i++) {
+		if (native->isCompleted(apicall, &failed))
+			return native->getResult(apicall, result, &failed);
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	return false;
+}
+
+void registerNativeTests() {
+	native = new NativeBackend();
+
+	addTest("native/roundtrip", []() {
+		std::string url = "http://127.0.0.1:" + std::to_string(startServer(false)) + "/";
+		HTTPRequestHandle request = native->createRequest(k_EHTTPMethodGET, url.c_str());
+		HTTPRequestCompleted_t result = HTTPRequestCompleted_t();
+
+		CHECK(sendAndWait(request, &result));
+		CHECK(result.m_bRequestSuccessful);
+		CHECK_EQUAL((int)result.m_eStatusCode, 200);
+		CHECK_EQUAL(result.m_unBodySize, 2u);
+		native->releaseRequest(request);
+	});
+
+	addTest("native/queued-timeout", []() {
+		std::string url = "http://127.0.0.1:" + std::to_string(startServer(true)) + "/";
+		std::vector<HTTPRequestHandle> holders;
+		SteamAPICall_t apicall;
+
+		// Takes every connection the host gets, so the last one has to wait
+		for (int i = 0; i < 8; i++) {
+			holders.push_back(native->createRequest(k_EHTTPMethodGET, url.c_str()));
+			native->sendRequest(holders.back(), &apicall);
+		}
+
+		HTTPRequestHandle queued = native->createRequest(k_EHTTPMethodGET, url.c_str());
+		HTTPRequestCompleted_t result = HTTPRequestCompleted_t();
+
+		native->setTimeout(queued, 200);
+		CHECK(sendAndWait(queued, &result));
+		CHECK(!result.m_bRequestSuccessful);
+		native->releaseRequest(queued);
+
+		for (HTTPRequestHandle holder : holders)
+			native->releaseRequest(holder);
+	});
+
+	addTest("native/header-injection", []() {
+		HTTPRequestHandle request = native->createRequest(k_EHTTPMethodGET, "http://127.0.0.1/");
+		uint8 body[] = "{}";
+
+		CHECK(native->setHeader(request, "X-Fine", "value"));
+		CHECK(!native->setHeader(request, "X-Split", "a\r\nX-Injected: 1"));
+		CHECK(!native->setHeader(request, "X-Split", "a\nb"));
+		CHECK(!native->setHeader(request, "X-Injected: 1\r\nX-Name", "value"));
+		CHECK(!native->setHeader(request, "Two Words", "value"));
+		CHECK(!native->setHeader(request, "", "value"));
+		CHECK(!native->setUserAgent(request, "agent\r\n\r\nGET / HTTP/1.1"));
+		CHECK(!native->setBody(request, "text/plain\r\nX-Injected: 1", body, 2));
+		native->releaseRequest(request);
+
+		CHECK(native->createRequest(k_EHTTPMethodGET, "http://127.0.0.1/a b") == INVALID_HTTPREQUEST_HANDLE);
+		CHECK(native->createRequest(k_EHTTPMethodGET, "http://127.0.0.1/\r\nX-Injected: 1") == INVALID_HTTPREQUEST_HANDLE);
+	});
+
+	addTest("native/unresolvable", []() {
+		// .invalid never resolves (RFC 6761)
+		HTTPRequestHandle request = native->createRequest(k_EHTTPMethodGET, "http://steamhttp.invalid/");
+		HTTPRequestCompleted_t result = HTTPRequestCompleted_t();
+
+		CHECK(sendAndWait(request, &result));
+		CHECK(!result.m_bRequestSuccessful);
+		native->releaseRequest(request);
+	});
+}
+
+#else
+
+void registerNativeTests() {
+}
+
+#endif
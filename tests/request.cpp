@@ -0,0 +1,793 @@
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include "test.h"
+#include "fakelua.h"
+#include "mockbackend.h"
+#include "steamhttp.h"
+#include "submission.h"
+#include "completion.h"
+#include "lua.h"
+#include "metrics.h"
+#include "client.h"
+#include "histogram.h"
+#include "prepared.h"
+
+static FakeLua lua;
+static MockBackend mock;
+
+// Calls STEAMHTTP with the table at the top of the stack (popping it),
+// waits until the submission thread is done and returns what was sent
+static std::vector<MockRequest> send(FakeLua *LUA, bool *ret = nullptr) {
+	LUA->PushCFunction(STEAMHTTP);
+	LUA->Insert(-2);
+	LUA->Call(1, 1);
+
+	if (ret)
+		*ret = LUA->GetBool(-1);
+	LUA->Pop();
+
+	submitter.wait();
+	return mock.takeSent();
+}
+
+// Runs Think ticks until the pool has nothing left for callbackHook
+static void drain(FakeLua *LUA) {
+	completions.settle();
+
+	while (completions.readyCount()) {
+		LUA->PushCFunction(callbackHook);
+		LUA->Call(0, 0);
+	}
+}
+
+// Pushes a fail handler that stores its reason in `reason`
+static void pushFailHandler(FakeLua *LUA, std::string *reason) {
+	LUA->pushFunction([reason](FakeLua *LUA) {
+		*reason = LUA->GetString(1);
+		return 0;
+	});
+}
+
+// STEAMHTTP.Client with the options table at the top of the stack (popping
+// it), leaves the client there
+static void pushClient(FakeLua *LUA) {
+	LUA->PushCFunction(Client);
+	LUA->Insert(-2);
+	LUA->Call(1, 1);
+}
+
+// client:Request(path) on the client at the top of the stack
+static void clientSend(FakeLua *LUA, const char *path) {
+	LUA->GetField(-1, "Request");
+	LUA->Push(-2);
+	LUA->PushString(path);
+	LUA->Call(2, 1);
+	LUA->Pop();
+}
+
+// Collects the client at the top of the stack (popping it), like Lua's GC
+static void collectClient(FakeLua *LUA) {
+	LUA->GetField(-1, "__gc");
+	LUA->Insert(-2);
+	LUA->Call(1, 0);
+}
+
+void registerRequestTests() {
+	FakeLua *LUA = &lua;
+
+	addTest("request/defaults", [=]() {
+		backend = &mock;
+		mock.keepSent(true);
+
+		bool ret = false;
+		LUA->CreateTable();
+		LUA->PushString("http://127.0.0.1/api");
+		LUA->SetField(-2, "url");
+
+		std::vector<MockRequest> sent = send(LUA, &ret);
+		CHECK(ret);
+		CHECK_EQUAL(sent.size(), 1u);
+
+		if (sent.size() == 1) {
+			CHECK_EQUAL(sent[0].method, k_EHTTPMethodGET);
+			CHECK_EQUAL(sent[0].url, "http://127.0.0.1/api");
+			CHECK(sent[0].body.empty());
+			CHECK(sent[0].parameters.empty());
+		}
+
+		drain(LUA);
+	});
+
+	addTest("request/fields", [=]() {
+		backend = &mock;
+		mock.keepSent(true);
+
+		std::map<std::string, std::string> headers;
+		headers["Accept"] = "application/json";
+		headers["X-Server-Id"] = "27015";
+
+		std::map<std::string, std::string> parameters;
+		parameters["page"] = "2";
+
+		LUA->CreateTable();
+		LUA->PushString("PUT");
+		LUA->SetField(-2, "method");
+		LUA->PushString("http://127.0.0.1/api");
+		LUA->SetField(-2, "url");
+		mapToLuaTable(LUA, headers);
+		LUA->SetField(-2, "headers");
+		mapToLuaTable(LUA, parameters);
+		LUA->SetField(-2, "parameters");
+		LUA->PushString("a\0b", 3);
+		LUA->SetField(-2, "body");
+		LUA->PushString("application/octet-stream");
+		LUA->SetField(-2, "type");
+		LUA->PushString("tests");
+		LUA->SetField(-2, "useragent");
+
+		std::vector<MockRequest> sent = send(LUA);
+		CHECK_EQUAL(sent.size(), 1u);
+
+		if (sent.size() == 1) {
+			CHECK_EQUAL(sent[0].method, k_EHTTPMethodPUT);
+			CHECK_EQUAL(sent[0].headers["Accept"], "application/json");
+			CHECK_EQUAL(sent[0].headers["X-Server-Id"], "27015");
+			CHECK_EQUAL(sent[0].body, std::string("a\0b", 3));
+			CHECK_EQUAL(sent[0].type, "application/octet-stream");
+			CHECK_EQUAL(sent[0].useragent, "tests");
+		}
+
+		drain(LUA);
+	});
+
+	addTest("request/json-body", [=]() {
+		backend = &mock;
+		mock.keepSent(true);
+
+		LUA->CreateTable();
+		LUA->PushString("POST");
+		LUA->SetField(-2, "method");
+		LUA->PushString("http://127.0.0.1/api");
+		LUA->SetField(-2, "url");
+		LUA->CreateTable();
+		LUA->PushString("x");
+		LUA->SetField(-2, "name");
+		LUA->SetField(-2, "json");
+
+		std::vector<MockRequest> sent = send(LUA);
+		CHECK_EQUAL(sent.size(), 1u);
+
+		if (sent.size() == 1) {
+			CHECK_EQUAL(sent[0].body, "{\"name\":\"x\"}");
+			CHECK_EQUAL(sent[0].type, "application/json");
+		}
+
+		drain(LUA);
+	});
+
+	addTest("request/invalid-method", [=]() {
+		backend = &mock;
+		mock.keepSent(true);
+
+		bool ret = true;
+		std::string reason;
+
+		LUA->CreateTable();
+		LUA->PushString("FETCH");
+		LUA->SetField(-2, "method");
+		LUA->PushString("http://127.0.0.1/api");
+		LUA->SetField(-2, "url");
+		pushFailHandler(LUA, &reason);
+		LUA->SetField(-2, "failed");
+
+		CHECK(send(LUA, &ret).empty());
+		CHECK(!ret);
+		CHECK_EQUAL(reason, "Unsupported request method: FETCH");
+	});
+
+	addTest("request/missing-url", [=]() {
+		backend = &mock;
+		mock.keepSent(true);
+
+		bool ret = true;
+		std::string reason;
+
+		LUA->CreateTable();
+		pushFailHandler(LUA, &reason);
+		LUA->SetField(-2, "failed");
+
+		CHECK(send(LUA, &ret).empty());
+		CHECK(!ret);
+		CHECK_EQUAL(reason, "invalid url");
+	});
+
+	addTest("request/unsupported-option", [=]() {
+		backend = &mock;
+		mock.keepSent(true);
+
+		std::string reason;
+
+		LUA->CreateTable();
+		LUA->PushString("http://127.0.0.1/api");
+		LUA->SetField(-2, "url");
+		LUA->PushString("xml");
+		LUA->SetField(-2, "decode");
+		pushFailHandler(LUA, &reason);
+		LUA->SetField(-2, "failed");
+
+		CHECK(send(LUA).empty());
+		CHECK_EQUAL(reason, "Unsupported decode: xml");
+	});
+
+	addTest("request/invalid-extract", [=]() {
+		backend = &mock;
+		mock.keepSent(true);
+
+		const char *paths[] = {"response..count", "players[x]", "players[0"};
+		const char *reasons[] = {
+			"Invalid extract path: empty key in \"response..count\"",
+			"Invalid extract path: invalid index [x] in \"players[x]\"",
+			"Invalid extract path: missing ']' in \"players[0\"",
+		};
+
+		for (int i = 0; i < 3; i++) {
+			std::string reason;
+
+			LUA->CreateTable();
+			LUA->PushString("http://127.0.0.1/api");
+			LUA->SetField(-2, "url");
+			LUA->CreateTable();
+			LUA->PushNumber(1);
+			LUA->PushString(paths[i]);
+			LUA->SetTable(-3);
+			LUA->SetField(-2, "extract");
+			pushFailHandler(LUA, &reason);
+			LUA->SetField(-2, "failed");
+
+			CHECK(send(LUA).empty());
+			CHECK_EQUAL(reason, reasons[i]);
+		}
+	});
+
+	// The readers only apply what is set, which templates and clients rely on
+	addTest("request/readers-overlay", [=]() {
+		HTTPRequest request = defaultRequest();
+		std::string error;
+
+		request.method = k_EHTTPMethodPOST;
+		request.headers["Accept"] = "text/plain";
+		request.headers["X-Kept"] = "1";
+
+		std::map<std::string, std::string> headers;
+		headers["Accept"] = "application/json";
+
+		LUA->CreateTable();
+		LUA->PushString("http://127.0.0.1/other");
+		LUA->SetField(-2, "url");
+		mapToLuaTable(LUA, headers);
+		LUA->SetField(-2, "headers");
+
+		CHECK(readRequestOptions(LUA, -1, request, &error));
+		CHECK(readRequestBody(LUA, -1, request, &error));
+		LUA->Pop();
+
+		CHECK_EQUAL(request.method, k_EHTTPMethodPOST);
+		CHECK_EQUAL(request.url, "http://127.0.0.1/other");
+		CHECK_EQUAL(request.headers["Accept"], "application/json");
+		CHECK_EQUAL(request.headers["X-Kept"], "1");
+	});
+
+	addTest("request/no-leaked-references", [=]() {
+		backend = &mock;
+		mock.keepSent(false);
+
+		size_t references = LUA->referenceCount();
+
+		LUA->CreateTable();
+		LUA->PushString("http://127.0.0.1/api");
+		LUA->SetField(-2, "url");
+		LUA->pushFunction([](FakeLua *) { return 0; });
+		LUA->SetField(-2, "success");
+		LUA->pushFunction([](FakeLua *) { return 0; });
+		LUA->SetField(-2, "failed");
+
+		send(LUA);
+		drain(LUA);
+
+		CHECK_EQUAL(LUA->referenceCount(), references);
+	});
+
+	// Status lists what hasn't reached callbackHook yet, with its progress
+	addTest("request/status", [=]() {
+		backend = &mock;
+
+		MockResponse slow;
+		slow.latency = 1000;
+		mock.script("http://127.0.0.1/slow", slow);
+
+		LUA->CreateTable();
+		LUA->PushString("http://127.0.0.1/slow");
+		LUA->SetField(-2, "url");
+		send(LUA);
+
+		LUA->PushCFunction(Status);
+		LUA->Call(0, 1);
+		CHECK_EQUAL(LUA->ObjLen(-1), 1);
+
+		LUA->PushNumber(1);
+		LUA->GetTable(-2);
+		LUA->GetField(-1, "url");
+		CHECK_EQUAL(std::string(LUA->GetString(-1)), "http://127.0.0.1/slow");
+		LUA->GetField(-2, "progress");
+		CHECK_EQUAL(LUA->GetNumber(-1), 0.0);
+		LUA->Pop(4);
+
+		mock.advance(1000);
+		drain(LUA);
+
+		LUA->PushCFunction(Status);
+		LUA->Call(0, 1);
+		CHECK_EQUAL(LUA->ObjLen(-1), 0);
+		LUA->Pop();
+	});
+
+	// The calls the worker threads made show up in the next tick
+	addTest("request/ipc-per-tick", [=]() {
+		backend = &mock;
+		metrics.tickipc.reset();
+
+		LUA->CreateTable();
+		LUA->PushString("http://127.0.0.1/ipc");
+		LUA->SetField(-2, "url");
+		send(LUA);
+		drain(LUA);
+
+		CHECK(metrics.tickipc.count() > 0);
+		CHECK(metrics.tickipc.valueSum() > 0);
+	});
+
+	// Capacities that can't be allocated are refused before allocating
+	addTest("request/trace-capacity", [=]() {
+		const double invalid[] = {-1, 0, 0.5, NAN, -INFINITY};
+		const double valid[] = {1, 100, 1e300, INFINITY};
+
+		for (double capacity : invalid) {
+			LUA->PushCFunction(Trace);
+			LUA->PushBool(true);
+			LUA->PushNumber(capacity);
+			CHECK_EQUAL(LUA->PCall(2, 0, 0), 2);
+			LUA->Pop();
+		}
+
+		for (double capacity : valid) {
+			LUA->PushCFunction(Trace);
+			LUA->PushBool(true);
+			LUA->PushNumber(capacity);
+			CHECK_EQUAL(LUA->PCall(2, 0, 0), 0);
+		}
+
+		LUA->PushCFunction(Trace);
+		LUA->PushBool(false);
+		LUA->Call(1, 0);
+	});
+
+	// Lua numbers are range checked before they become integers
+	addTest("request/number-options", [=]() {
+		backend = &mock;
+		mock.keepSent(true);
+
+		const double timeouts[] = {-5, 1e20, INFINITY};
+		const uint32 expected[] = {0, UINT32_MAX, UINT32_MAX};
+
+		for (int i = 0; i < 3; i++) {
+			LUA->CreateTable();
+			LUA->PushString("http://127.0.0.1/api");
+			LUA->SetField(-2, "url");
+			LUA->PushNumber(timeouts[i]);
+			LUA->SetField(-2, "timeout");
+			LUA->PushNumber(1e20);
+			LUA->SetField(-2, "compresslevel");
+
+			std::vector<MockRequest> sent = send(LUA);
+			CHECK_EQUAL(sent.size(), 1u);
+			if (!sent.empty())
+				CHECK_EQUAL(sent[0].timeout, expected[i]);
+		}
+
+		const char *options[] = {"timeout", "compresslevel"};
+
+		for (const char *option : options) {
+			std::string reason;
+
+			LUA->CreateTable();
+			LUA->PushString("http://127.0.0.1/api");
+			LUA->SetField(-2, "url");
+			LUA->PushNumber(NAN);
+			LUA->SetField(-2, option);
+			pushFailHandler(LUA, &reason);
+			LUA->SetField(-2, "failed");
+
+			CHECK(send(LUA).empty());
+			CHECK_EQUAL(reason, "Invalid " + std::string(option) + ": nan");
+		}
+
+		mock.keepSent(false);
+		drain(LUA);
+	});
+
+	addTest("request/client-limits", [=]() {
+		backend = &mock;
+		registerClient(LUA);
+
+		const char *options[] = {"maxconcurrent", "ratelimit"};
+
+		for (const char *option : options) {
+			LUA->PushCFunction(Client);
+			LUA->CreateTable();
+			LUA->PushNumber(NAN);
+			LUA->SetField(-2, option);
+			LUA->Call(1, 2);
+
+			CHECK(LUA->IsType(-2, Lua::Type::NIL));
+			CHECK_EQUAL(std::string(LUA->GetString(-1)), "Invalid " + std::string(option) + ": nan");
+			LUA->Pop(2);
+
+			LUA->PushCFunction(Client);
+			LUA->CreateTable();
+			LUA->PushNumber(1e300);
+			LUA->SetField(-2, option);
+			LUA->Call(1, 1);
+
+			CHECK(!LUA->IsType(-1, Lua::Type::NIL));
+			collectClient(LUA);
+		}
+	});
+
+	addTest("request/client-ids", [=]() {
+		backend = &mock;
+		mock.keepSent(true);
+		registerClient(LUA);
+
+		MockResponse slow;
+		slow.latency = 1000;
+		mock.script("http://127.0.0.1/client-slow", slow);
+
+		LUA->PushCFunction(Client);
+		LUA->CreateTable();
+		LUA->PushString("http://127.0.0.1");
+		LUA->SetField(-2, "base");
+		LUA->PushNumber(1);
+		LUA->SetField(-2, "maxconcurrent");
+		LUA->Call(1, 1);
+
+		// client:Request(path, options), leaving the result on the stack
+		auto request = [=](const char *path, bool invalid, bool handlers) {
+			LUA->GetField(-1, "Request");
+			LUA->Push(-2);
+			LUA->PushString(path);
+			LUA->CreateTable();
+			if (invalid) {
+				LUA->PushNumber(NAN);
+				LUA->SetField(-2, "timeout");
+			}
+			if (handlers) {
+				LUA->pushFunction([](FakeLua *) { return 0; });
+				LUA->SetField(-2, "success");
+				LUA->pushFunction([](FakeLua *) { return 0; });
+				LUA->SetField(-2, "failed");
+			}
+			LUA->Call(3, 1);
+		};
+
+		request("/client-slow", false, false);
+		CHECK_EQUAL(LUA->GetNumber(-1), 1.0);
+		LUA->Pop();
+
+		// Rejected requests don't use up an id
+		request("/client-invalid", true, false);
+		CHECK(LUA->IsType(-1, Lua::Type::BOOL) && !LUA->GetBool(-1));
+		LUA->Pop();
+
+		// Held back behind the slow one
+		size_t refs = lua.referenceCount();
+		request("/client-held", false, true);
+		CHECK_EQUAL(LUA->GetNumber(-1), 2.0);
+		LUA->Pop();
+		CHECK_EQUAL(lua.referenceCount(), refs + 2);
+
+		stopClients(LUA);
+		CHECK_EQUAL(lua.referenceCount(), refs);
+
+		submitter.wait();
+		mock.advance(1000);
+		drain(LUA);
+		CHECK_EQUAL(mock.takeSent().size(), 1u);
+		collectClient(LUA);
+	});
+
+	addTest("request/prepare", [=]() {
+		backend = &mock;
+		mock.keepSent(true);
+		registerPreparedRequest(LUA);
+
+		std::map<std::string, std::string> headers;
+		headers["X-Server-Id"] = "27015";
+
+		LUA->PushCFunction(Prepare);
+		LUA->CreateTable();
+		LUA->PushString("POST");
+		LUA->SetField(-2, "method");
+		LUA->PushString("http://127.0.0.1/prepared");
+		LUA->SetField(-2, "url");
+		mapToLuaTable(LUA, headers);
+		LUA->SetField(-2, "headers");
+		LUA->PushNumber(500);
+		LUA->SetField(-2, "timeout");
+		LUA->Call(1, 1);
+		CHECK(LUA->IsType(-1, Lua::Type::USERDATA));
+
+		// template:Send{body = ..., url = ...}, only the body is taken
+		const char *bodies[] = {"first", "second"};
+		for (const char *body : bodies) {
+			LUA->GetField(-1, "Send");
+			LUA->Push(-2);
+			LUA->CreateTable();
+			LUA->PushString(body);
+			LUA->SetField(-2, "body");
+			LUA->PushString("http://127.0.0.1/elsewhere");
+			LUA->SetField(-2, "url");
+			LUA->Call(2, 1);
+			CHECK(LUA->GetBool(-1));
+			LUA->Pop();
+		}
+
+		LUA->GetField(-1, "__gc");
+		LUA->Insert(-2);
+		LUA->Call(1, 0);
+
+		submitter.wait();
+		std::vector<MockRequest> sent = mock.takeSent();
+		CHECK_EQUAL(sent.size(), 2u);
+
+		for (size_t i = 0; i < sent.size() && i < 2; i++) {
+			CHECK_EQUAL(sent[i].method, k_EHTTPMethodPOST);
+			CHECK_EQUAL(sent[i].url, "http://127.0.0.1/prepared");
+			CHECK_EQUAL(sent[i].headers["X-Server-Id"], "27015");
+			CHECK_EQUAL(sent[i].timeout, 500u);
+			CHECK_EQUAL(sent[i].body, bodies[i]);
+		}
+
+		drain(LUA);
+
+		// Invalid templates are nil and the reason
+		LUA->PushCFunction(Prepare);
+		LUA->CreateTable();
+		LUA->Call(1, 2);
+		CHECK(LUA->IsType(-2, Lua::Type::NIL));
+		CHECK_EQUAL(std::string(LUA->GetString(-1)), "invalid url");
+		LUA->Pop(2);
+
+		LUA->PushCFunction(Prepare);
+		LUA->CreateTable();
+		LUA->PushString("http://127.0.0.1/prepared");
+		LUA->SetField(-2, "url");
+		LUA->PushString("xml");
+		LUA->SetField(-2, "decode");
+		LUA->Call(1, 2);
+		CHECK(LUA->IsType(-2, Lua::Type::NIL));
+		CHECK_EQUAL(std::string(LUA->GetString(-1)), "Unsupported decode: xml");
+		LUA->Pop(2);
+	});
+
+	addTest("request/client-urls", [=]() {
+		backend = &mock;
+		mock.keepSent(true);
+		registerClient(LUA);
+
+		const char *bases[] = {"http://127.0.0.1/api", "http://127.0.0.1/api/"};
+		const char *paths[] = {"users", "/users", "?page=2", "", "http://127.0.0.2/full"};
+		const char *expected[2][5] = {
+			{"http://127.0.0.1/api/users", "http://127.0.0.1/api/users", "http://127.0.0.1/api?page=2", "http://127.0.0.1/api", "http://127.0.0.2/full"},
+			{"http://127.0.0.1/api/users", "http://127.0.0.1/api/users", "http://127.0.0.1/api/?page=2", "http://127.0.0.1/api/", "http://127.0.0.2/full"},
+		};
+
+		for (int b = 0; b < 2; b++) {
+			LUA->CreateTable();
+			LUA->PushString(bases[b]);
+			LUA->SetField(-2, "base");
+			pushClient(LUA);
+
+			for (const char *path : paths)
+				clientSend(LUA, path);
+			collectClient(LUA);
+
+			submitter.wait();
+			std::vector<MockRequest> sent = mock.takeSent();
+			CHECK_EQUAL(sent.size(), 5u);
+
+			for (size_t i = 0; i < sent.size() && i < 5; i++)
+				CHECK_EQUAL(sent[i].url, expected[b][i]);
+		}
+
+		drain(LUA);
+	});
+
+	addTest("request/client-maxconcurrent", [=]() {
+		backend = &mock;
+		mock.keepSent(true);
+		registerClient(LUA);
+
+		MockResponse slow;
+		slow.latency = 1000;
+		const char *urls[] = {"http://127.0.0.1/concurrent/1", "http://127.0.0.1/concurrent/2", "http://127.0.0.1/concurrent/3", "http://127.0.0.1/concurrent/4"};
+		for (const char *url : urls)
+			mock.script(url, slow);
+
+		LUA->CreateTable();
+		LUA->PushString("http://127.0.0.1/concurrent");
+		LUA->SetField(-2, "base");
+		LUA->PushNumber(2);
+		LUA->SetField(-2, "maxconcurrent");
+		pushClient(LUA);
+
+		const char *paths[] = {"1", "2", "3", "4"};
+		for (const char *path : paths)
+			clientSend(LUA, path);
+		collectClient(LUA);
+
+		submitter.wait();
+		std::vector<MockRequest> sent = mock.takeSent();
+		CHECK_EQUAL(sent.size(), 2u);
+
+		// The held back ones go out, in order, as the first ones finish
+		mock.advance(1000);
+		for (int tick = 0; tick < 1000 && sent.size() < 4; tick++) {
+			completions.settle();
+			LUA->PushCFunction(callbackHook);
+			LUA->Call(0, 0);
+			submitter.wait();
+
+			for (MockRequest& request : mock.takeSent())
+				sent.push_back(request);
+		}
+
+		CHECK_EQUAL(sent.size(), 4u);
+		for (size_t i = 0; i < sent.size() && i < 4; i++)
+			CHECK_EQUAL(sent[i].url, urls[i]);
+
+		mock.advance(1000);
+		drain(LUA);
+	});
+
+	addTest("request/client-ratelimit", [=]() {
+		backend = &mock;
+		mock.keepSent(true);
+		registerClient(LUA);
+
+		LUA->CreateTable();
+		LUA->PushString("http://127.0.0.1/limited");
+		LUA->SetField(-2, "base");
+		LUA->PushNumber(10);
+		LUA->SetField(-2, "ratelimit");
+		pushClient(LUA);
+
+		// A second's worth of requests go out at once, the next one waits
+		// for a token
+		for (int i = 0; i < 11; i++)
+			clientSend(LUA, "");
+
+		submitter.wait();
+		CHECK_EQUAL(mock.takeSent().size(), 10u);
+
+		// A token every 100 ms
+		std::this_thread::sleep_for(std::chrono::milliseconds(150));
+		LUA->PushCFunction(callbackHook);
+		LUA->Call(0, 0);
+		submitter.wait();
+		CHECK_EQUAL(mock.takeSent().size(), 1u);
+
+		collectClient(LUA);
+		drain(LUA);
+	});
+
+	addTest("request/client-cookies", [=]() {
+		backend = &mock;
+		mock.keepSent(true);
+		registerClient(LUA);
+
+		MockResponse slow;
+		slow.latency = 1000;
+		mock.script("http://127.0.0.1/cookies", slow);
+
+		size_t before = mock.cookieContainers();
+
+		LUA->CreateTable();
+		LUA->PushBool(false);
+		LUA->SetField(-2, "cookies");
+		pushClient(LUA);
+		CHECK_EQUAL(mock.cookieContainers(), before);
+		collectClient(LUA);
+
+		LUA->CreateTable();
+		pushClient(LUA);
+		CHECK_EQUAL(mock.cookieContainers(), before + 1);
+
+		clientSend(LUA, "http://127.0.0.1/cookies");
+		submitter.wait();
+		std::vector<MockRequest> sent = mock.takeSent();
+		CHECK_EQUAL(sent.size(), 1u);
+		if (sent.size() == 1)
+			CHECK(sent[0].cookies != INVALID_HTTPCOOKIE_HANDLE);
+
+		// The request in flight keeps the container until it finishes
+		collectClient(LUA);
+		CHECK_EQUAL(mock.cookieContainers(), before + 1);
+
+		mock.advance(1000);
+		drain(LUA);
+		CHECK_EQUAL(mock.cookieContainers(), before);
+	});
+
+	addTest("request/percentile", [=]() {
+		resetLatencies();
+		HostLatency *host = hostLatency("percentile.test");
+
+		for (int ms = 1; ms <= 100; ms++)
+			recordLatency(host, ms * 1000, 200);
+		for (int i = 0; i < 10; i++)
+			recordLatency(host, 500000, 0);
+
+		// STEAMHTTP.Percentile(host, q[, class]), nil if it returned nil
+		auto percentile = [=](const char *host, double q, const char *statusclass) {
+			LUA->PushCFunction(Percentile);
+			LUA->PushString(host);
+			LUA->PushNumber(q);
+			if (statusclass)
+				LUA->PushString(statusclass);
+			LUA->Call(statusclass ? 3 : 2, 1);
+
+			double ms = LUA->IsType(-1, Lua::Type::NUMBER) ? LUA->GetNumber(-1) : -1;
+			LUA->Pop();
+			return ms;
+		};
+
+		// Buckets are at most ~3% wide
+		double median = percentile("http://percentile.test/api", 0.5, "2xx");
+		CHECK(median >= 48 && median <= 52);
+		double top = percentile("percentile.test", 1, "2xx");
+		CHECK(top >= 97 && top <= 103);
+		double failed = percentile("percentile.test", 0.5, "failed");
+		CHECK(failed >= 485 && failed <= 515);
+
+		// All classes, and all hosts
+		double all = percentile("percentile.test", 0.95, nullptr);
+		CHECK(all >= 485 && all <= 515);
+		double everywhere = percentile("*", 0.5, nullptr);
+		CHECK(everywhere >= 53 && everywhere <= 57);
+
+		CHECK_EQUAL(percentile("percentile.test", 0.5, "4xx"), -1.0);
+		CHECK_EQUAL(percentile("unknown.test", 0.5, nullptr), -1.0);
+
+		double invalid[] = {-0.1, 1.5, NAN};
+		for (double q : invalid) {
+			LUA->PushCFunction(Percentile);
+			LUA->PushString("percentile.test");
+			LUA->PushNumber(q);
+			CHECK(LUA->PCall(2, 1, 0) != 0);
+			LUA->Pop();
+		}
+
+		LUA->PushCFunction(Percentile);
+		LUA->PushString("percentile.test");
+		LUA->PushNumber(0.5);
+		LUA->PushString("6xx");
+		CHECK(LUA->PCall(3, 1, 0) != 0);
+		LUA->Pop();
+
+		resetLatencies();
+	});
+}
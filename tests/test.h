@@ -0,0 +1,41 @@
+#ifndef _TEST_H
+#define _TEST_H
+
+#include <functional>
+#include <sstream>
+#include <string>
+
+typedef std::function<void()> TestFunc;
+
+// Registers a test. Tests run in the order they were added.
+void addTest(std::string name, TestFunc body);
+
+// Marks the running test as failed and reports where. The test keeps
+// running, so one run shows all failed checks.
+void failCheck(const char *file, int line, const std::string& message);
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) \
+			failCheck(__FILE__, __LINE__, #condition); \
+	} while (0)
+
+#define CHECK_EQUAL(actual, expected) \
+	do { \
+		auto checkactual = (actual); \
+		auto checkexpected = (expected); \
+		if (!(checkactual == checkexpected)) { \
+			std::ostringstream message; \
+			message << #actual << " is " << checkactual << ", expected " << checkexpected; \
+			failCheck(__FILE__, __LINE__, message.str()); \
+		} \
+	} while (0)
+
+void registerLuaTests();
+void registerRequestTests();
+void registerHandlerTests();
+void registerMsgPackTests();
+void registerDeflateTests();
+void registerNativeTests();
+
+#endif
@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "fakelua.h"
+#include "metrics.h"
+#include "mockbackend.h"
+#include "replaybackend.h"
+#include "recording.h"
+#include "steamhttp.h"
+#include "submission.h"
+#include "completion.h"
+
+#ifndef WINDOWS_BUILD
+#include <sys/resource.h>
+#endif
+
+// Replays a recorded request trace against the mock backend, going through
+// the real STEAMHTTP and callbackHook code at a simulated tick rate.
+//
+// The trace is a CSV file with one request per line:
+//   timestamp_ms,method,url,body_size,response_size,latency_ms
+// Empty lines and lines starting with '#' are ignored.
+//
+// With --recording, the file is a recording log written by
+// STEAMHTTP.StartRecording instead, and the requests get the recorded
+// responses (see replaybackend.h).
+
+struct TraceEntry {
+	uint64 timestamp;
+	std::string method;
+	std::string url;
+	size_t bodysize;
+	size_t responsesize;
+	uint64 latency;
+
+	// The request body, if the recording kept it
+	std::string body;
+
+	// Filled in during the replay
+	uint64 issuetick = 0;
+	uint64 readytick = 0;
+	uint64 donetick = 0;
+	bool done = false;
+	bool failed = false;
+};
+
+struct Stats {
+	double mean = 0;
+	double p50 = 0;
+	double p99 = 0;
+	double max = 0;
+};
+
+static Stats summarize(std::vector<double> values) {
+	Stats stats;
+
+	if (values.empty())
+		return stats;
+
+	std::sort(values.begin(), values.end());
+
+	for (double v : values)
+		stats.mean += v;
+
+	stats.mean /= values.size();
+	stats.p50 = values[values.size() / 2];
+	stats.p99 = values[std::min(values.size() - 1, (size_t)(values.size() * 0.99))];
+	stats.max = values.back();
+
+	return stats;
+}
+
+static bool loadTrace(const char *path, std::vector<TraceEntry> *trace) {
+	std::ifstream file(path);
+	std::string line;
+	int lineno = 0;
+
+	if (!file)
+		return false;
+
+	while (std::getline(file, line)) {
+		lineno++;
+
+		if (line.empty() || line[0] == '#' || line[0] == '\r')
+			continue;
+
+		std::stringstream ss(line);
+		std::string field;
+		std::vector<std::string> fields;
+
+		while (std::getline(ss, field, ','))
+			fields.push_back(field);
+
+		if (fields.size() != 6) {
+			fprintf(stderr, "%s:%d: expected 6 fields, got %zu\n", path, lineno, fields.size());
+			return false;
+		}
+
+		TraceEntry entry;
+		entry.timestamp = strtoull(fields[0].c_str(), nullptr, 10);
+		entry.method = fields[1];
+		entry.url = fields[2];
+		entry.bodysize = strtoull(fields[3].c_str(), nullptr, 10);
+		entry.responsesize = strtoull(fields[4].c_str(), nullptr, 10);
+		entry.latency = strtoull(fields[5].c_str(), nullptr, 10);
+		trace->push_back(entry);
+	}
+
+	std::stable_sort(trace->begin(), trace->end(), [](const TraceEntry& a, const TraceEntry& b) {
+		return a.timestamp < b.timestamp;
+	});
+
+	return true;
+}
+
+static bool loadRecordedTrace(const char *path, std::vector<TraceEntry> *trace, std::vector<RecordedExchange> *exchanges) {
+	if (!loadRecording(path, exchanges))
+		return false;
+
+	for (const RecordedExchange& exchange : *exchanges) {
+		TraceEntry entry;
+		entry.timestamp = exchange.offset / 1000;
+		entry.method = methodToString(exchange.method);
+		entry.url = exchange.url;
+		entry.bodysize = exchange.bodysize;
+		entry.responsesize = exchange.responsebody.size();
+		entry.latency = (exchange.duration + 999) / 1000;
+		if (exchange.hasbody)
+			entry.body = exchange.body;
+		trace->push_back(entry);
+	}
+
+	std::stable_sort(trace->begin(), trace->end(), [](const TraceEntry& a, const TraceEntry& b) {
+		return a.timestamp < b.timestamp;
+	});
+
+	return true;
+}
+
+static long peakRSS() {
+#ifndef WINDOWS_BUILD
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+#else
+	return 0;
+#endif
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "Usage: %s [--tickrate <hz>] [--max-ticks <n>] [--json] <trace.csv | --recording <log>>\n", argv0);
+}
+
+int main(int argc, char **argv) {
+	double tickrate = 66.6667;
+	uint64 maxticks = 1000000;
+	bool json = false;
+	bool recording = false;
+	const char *path = nullptr;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--tickrate") == 0 && i + 1 < argc) {
+			tickrate = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--max-ticks") == 0 && i + 1 < argc) {
+			maxticks = strtoull(argv[++i], nullptr, 10);
+		} else if (strcmp(argv[i], "--json") == 0) {
+			json = true;
+		} else if (strcmp(argv[i], "--recording") == 0 && i + 1 < argc && !path) {
+			recording = true;
+			path = argv[++i];
+		} else if (argv[i][0] != '-' && !path) {
+			path = argv[i];
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	std::vector<TraceEntry> trace;
+	std::vector<RecordedExchange> exchanges;
+
+	if (!path || tickrate <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (recording ? !loadRecordedTrace(path, &trace, &exchanges) : !loadTrace(path, &trace)) {
+		fprintf(stderr, "Could not load trace from %s\n", path);
+		return 1;
+	}
+
+	FakeLua lua;
+	FakeLua *LUA = &lua;
+	MockBackend scripted;
+	ReplayBackend replay;
+	MockBackend& mock = recording ? replay : scripted;
+	backend = &mock;
+
+	if (recording)
+		replay.load(exchanges);
+
+	double interval = 1000 / tickrate;
+	size_t next = 0, completed = 0, failed = 0;
+	size_t inflight = 0, peakinflight = 0;
+	size_t inflightbytes = 0, peakinflightbytes = 0;
+	std::vector<double> hooktimes, issuetimes;
+	uint64 tick;
+
+	for (tick = 0; tick < maxticks && completed < trace.size(); tick++) {
+		uint64 now = (uint64)(tick * interval);
+		mock.advance(now - mock.now());
+
+		// Issue everything that is due by now
+		auto start = std::chrono::steady_clock::now();
+		for (; next < trace.size() && trace[next].timestamp <= now; next++) {
+			TraceEntry *entry = &trace[next];
+
+			if (!recording) {
+				MockResponse response;
+				response.body = std::string(entry->responsesize, 'x');
+				response.latency = entry->latency;
+				mock.scriptNext(response);
+			}
+
+			LUA->PushCFunction(STEAMHTTP);
+			LUA->CreateTable();
+			LUA->PushString(entry->method.c_str());
+			LUA->SetField(-2, "method");
+			LUA->PushString(entry->url.c_str());
+			LUA->SetField(-2, "url");
+			if (!entry->body.empty()) {
+				LUA->PushString(entry->body.c_str(), entry->body.size());
+				LUA->SetField(-2, "body");
+			} else if (entry->bodysize) {
+				LUA->PushString(std::string(entry->bodysize, 'x').c_str());
+				LUA->SetField(-2, "body");
+			}
+			auto finish = [entry, &tick, &completed, &inflight, &inflightbytes](bool error) {
+				entry->done = true;
+				entry->failed = error;
+				entry->donetick = tick;
+				completed++;
+				inflight--;
+				inflightbytes -= entry->bodysize + entry->responsesize;
+			};
+			LUA->pushFunction([finish](FakeLua *) {
+				finish(false);
+				return 0;
+			});
+			LUA->SetField(-2, "success");
+			LUA->pushFunction([finish, &failed](FakeLua *) {
+				finish(true);
+				failed++;
+				return 0;
+			});
+			LUA->SetField(-2, "failed");
+
+			inflight++;
+			inflightbytes += entry->bodysize + entry->responsesize;
+			peakinflight = std::max(peakinflight, inflight);
+			peakinflightbytes = std::max(peakinflightbytes, inflightbytes);
+
+			LUA->Call(1, 1);
+			LUA->Pop();
+
+			// The mock completes on the first tick at least `latency` after sending
+			entry->issuetick = tick;
+			entry->readytick = tick;
+			while ((uint64)(entry->readytick * interval) - now < entry->latency)
+				entry->readytick++;
+		}
+		issuetimes.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+
+		// Requests are sent and polled on other threads; let them catch
+		// up with the mock clock, so latencies stay exact
+		submitter.wait();
+		completions.settle();
+
+		start = std::chrono::steady_clock::now();
+		LUA->PushCFunction(callbackHook);
+		LUA->Call(0, 0);
+		hooktimes.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	std::vector<double> delays;
+	for (TraceEntry& entry : trace) {
+		if (entry.done)
+			delays.push_back(entry.donetick > entry.readytick ? entry.donetick - entry.readytick : 0);
+	}
+
+	Stats hook = summarize(hooktimes);
+	Stats issue = summarize(issuetimes);
+	Stats delay = summarize(delays);
+
+	// Backend calls that would be Steam IPC calls, see HTTPBackend::ipcCalls
+	const LatencyHistogram& ipc = metrics.requestipc;
+	double ipcmean = ipc.count() ? (double)ipc.valueSum() / ipc.count() : 0;
+
+	if (json) {
+		printf("{\"ticks\": %llu, \"tickrate\": %.2f, \"requests\": %zu, \"completed\": %zu, \"failed\": %zu,\n",
+		       (unsigned long long)tick, tickrate, trace.size(), completed, failed);
+		printf(" \"hook_us\": {\"mean\": %.2f, \"p50\": %.2f, \"p99\": %.2f, \"max\": %.2f},\n", hook.mean, hook.p50, hook.p99, hook.max);
+		printf(" \"issue_us\": {\"mean\": %.2f, \"p50\": %.2f, \"p99\": %.2f, \"max\": %.2f},\n", issue.mean, issue.p50, issue.p99, issue.max);
+		printf(" \"delay_ticks\": {\"mean\": %.2f, \"p50\": %.0f, \"p99\": %.0f, \"max\": %.0f},\n", delay.mean, delay.p50, delay.p99, delay.max);
+		printf(" \"ipc_per_request\": {\"mean\": %.2f, \"p99\": %llu},\n", ipcmean, (unsigned long long)ipc.percentile(0.99));
+		printf(" \"peak_inflight\": %zu, \"peak_inflight_bytes\": %zu, \"peak_rss_kb\": %ld}\n", peakinflight, peakinflightbytes, peakRSS());
+	} else {
+		printf("Ticks:                %llu at %.2f Hz\n", (unsigned long long)tick, tickrate);
+		printf("Requests:             %zu issued, %zu completed, %zu failed\n", next, completed, failed);
+		printf("callbackHook per tick: mean %.2f us, p50 %.2f us, p99 %.2f us, max %.2f us\n", hook.mean, hook.p50, hook.p99, hook.max);
+		printf("STEAMHTTP per tick:    mean %.2f us, p50 %.2f us, p99 %.2f us, max %.2f us\n", issue.mean, issue.p50, issue.p99, issue.max);
+		printf("Completion delay:      mean %.2f, p50 %.0f, p99 %.0f, max %.0f ticks\n", delay.mean, delay.p50, delay.p99, delay.max);
+		printf("IPC calls per request: mean %.2f, p99 %llu\n", ipcmean, (unsigned long long)ipc.percentile(0.99));
+		printf("Peak in flight:        %zu requests, %zu bytes\n", peakinflight, peakinflightbytes);
+		printf("Peak RSS:              %ld kB\n", peakRSS());
+	}
+
+	return completed == trace.size() ? 0 : 2;
+}
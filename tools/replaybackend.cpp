@@ -0,0 +1,62 @@
+#include "replaybackend.h"
+
+static std::string exchangeKey(EHTTPMethod method, const std::string& url) {
+	return std::to_string(method) + " " + url;
+}
+
+void ReplayBackend::load(const std::vector<RecordedExchange>& recorded) {
+	std::lock_guard<std::mutex> lock(replaymutex);
+
+	for (const RecordedExchange& exchange : recorded)
+		exchanges[exchangeKey(exchange.method, exchange.url)].push_back(exchange);
+}
+
+HTTPRequestHandle ReplayBackend::createRequest(EHTTPMethod method, const char *url) {
+	HTTPRequestHandle handle = MockBackend::createRequest(method, url);
+
+	if (handle != INVALID_HTTPREQUEST_HANDLE) {
+		std::lock_guard<std::mutex> lock(replaymutex);
+		keys[handle] = exchangeKey(method, url);
+	}
+
+	return handle;
+}
+
+bool ReplayBackend::sendRequest(HTTPRequestHandle request, SteamAPICall_t *apicall) {
+	std::lock_guard<std::mutex> lock(replaymutex);
+	MockResponse response;
+
+	auto key = keys.find(request);
+	auto recorded = key != keys.end() ? exchanges.find(key->second) : exchanges.end();
+
+	if (recorded != exchanges.end()) {
+		std::deque<RecordedExchange>& queue = recorded->second;
+		RecordedExchange& exchange = queue.front();
+
+		response.unsuccessful = !exchange.successful;
+		response.code = exchange.code;
+		response.headers = exchange.responseheaders;
+		response.body = exchange.responsebody;
+		response.latency = (exchange.duration + 999) / 1000;
+
+		// Rotate, so that the next identical request gets the next response
+		queue.push_back(queue.front());
+		queue.pop_front();
+	} else {
+		// Requests that were never recorded fail right away
+		response.unsuccessful = true;
+	}
+
+	// Holding our lock keeps other senders from taking this response
+	scriptNext(response);
+	return MockBackend::sendRequest(request, apicall);
+}
+
+bool ReplayBackend::releaseRequest(HTTPRequestHandle request) {
+	{
+		std::lock_guard<std::mutex> lock(replaymutex);
+		keys.erase(request);
+	}
+
+	return MockBackend::releaseRequest(request);
+}
@@ -0,0 +1,31 @@
+#ifndef _REPLAYBACKEND_H
+#define _REPLAYBACKEND_H
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "mockbackend.h"
+#include "recording.h"
+
+// Serves responses from a recording log (see recording.h) instead of
+// going to the network. Requests are matched by method and URL; repeated
+// requests get the recorded responses in order, wrapping around at the
+// end. Every response completes after its recorded duration on the mock
+// clock, which the caller moves with advance().
+class ReplayBackend : public MockBackend {
+	std::mutex replaymutex;
+	std::map<std::string, std::deque<RecordedExchange>> exchanges;
+	std::map<HTTPRequestHandle, std::string> keys;
+
+public:
+	// Takes the exchanges of a recording, see loadRecording
+	void load(const std::vector<RecordedExchange>& recorded);
+
+	HTTPRequestHandle createRequest(EHTTPMethod method, const char *url);
+	bool sendRequest(HTTPRequestHandle request, SteamAPICall_t *apicall);
+	bool releaseRequest(HTTPRequestHandle request);
+};
+
+#endif